@@ -0,0 +1,66 @@
+#include "AmbientOcclusion.h"
+#include "Traversal.h"
+
+#include <cmath>
+
+#define TWO_PI 6.28318530718f
+
+// Cosine-weighted hemisphere directions around +z, from a Hammersley set so
+// every face is sampled with the same fixed pattern
+static glm::fvec3 sampleHemisphere(int i)
+{
+	uint32_t bits = i;
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+	bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+	bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+
+	float u = (i + 0.5f) / AO_SAMPLES;
+	float v = float(bits) * 2.3283064365386963e-10f;
+	float r = std::sqrt(u);
+	float phi = TWO_PI * v;
+	return glm::fvec3(r * std::cos(phi), r * std::sin(phi), std::sqrt(1.0f - u));
+}
+
+uint32_t voxelAO(const World& world, glm::ivec3 map)
+{
+	if (world.voxels[world.index(map)] == 0)
+		return 0;
+
+	// Axis index for each shader side (0 = x, 1 = z, 2 = y)
+	static const int sideAxis[3] = { 0, 2, 1 };
+
+	uint32_t packed = 0;
+	for (int face = 0; face < 6; face++)
+	{
+		int axis = sideAxis[face / 2];
+		int sign = (face & 1) ? 1 : -1;
+
+		glm::ivec3 neighbour = map;
+		neighbour[axis] += sign;
+		if (world.at(neighbour) != 0 || !world.contains(neighbour))
+			continue;
+
+		// Tangent frame with the face normal as +z
+		glm::fvec3 n(0), t(0), b(0);
+		n[axis] = float(sign);
+		t[(axis + 1) % 3] = 1;
+		b[(axis + 2) % 3] = 1;
+
+		glm::fvec3 centre = glm::fvec3(map) + 0.5f + n * 0.501f;
+
+		int open = 0;
+		for (int i = 0; i < AO_SAMPLES; i++)
+		{
+			glm::fvec3 s = sampleHemisphere(i);
+			glm::fvec3 dir = t * s.x + b * s.y + n * s.z;
+			if (!occluded(world, centre, dir, AO_RADIUS))
+				open++;
+		}
+
+		packed |= (uint32_t)((open * AO_MAX + AO_SAMPLES / 2) / AO_SAMPLES) << (face * AO_BITS);
+	}
+
+	return packed;
+}
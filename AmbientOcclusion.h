@@ -0,0 +1,21 @@
+#pragma once
+
+#include "World.h"
+
+#define AO_SAMPLES 32
+#define AO_RADIUS 3.0f
+#define AO_BITS 5
+#define AO_MAX ((1u << AO_BITS) - 1)
+// Editing a voxel can change the AO of voxels up to this far from it, the rays
+// being AO_RADIUS long and starting just off the face
+#define AO_REACH 4
+
+// Per-face ambient occlusion, one uint per voxel holding AO_BITS of openness
+// (AO_MAX = fully open) for each of its six faces. Face f occupies bits
+// [f * AO_BITS, (f + 1) * AO_BITS) with f = side * 2 + (normal is positive),
+// using the shader's side numbering (0 = x, 1 = z, 2 = y). Faces that are
+// not exposed are left at 0. It is computed a chunk at a time as chunks stream in,
+// see ChunkLoader.
+
+// AO of every face of the voxel at map; 0 for empty voxels
+uint32_t voxelAO(const World& world, glm::ivec3 map);
@@ -0,0 +1,95 @@
+#include "BatchRender.h"
+#include "CameraPath.h"
+#include "CpuRenderer.h"
+#include "Denoise.h"
+#include "Image.h"
+#include "SceneFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+std::string batchFramePath(const char* outDir, int frame)
+{
+	std::ostringstream path;
+	path << outDir << "/frame_" << std::setw(5) << std::setfill('0') << frame << ".ppm";
+	return path.str();
+}
+
+static void renderFrame(const Scene& scene, const Camera& camera, glm::ivec2 size, int samples, bool denoised, std::vector<uint8_t>& rgb)
+{
+	std::vector<glm::fvec3> accum;
+	std::vector<glm::fvec4> guide;
+	for (int i = 0; i < samples; i++)
+		accumulatePathSamples(scene, camera, size, i, accum, &guide);
+
+	if (!denoised)
+	{
+		resolveImage(accum, size, 1.0f / samples, rgb);
+		return;
+	}
+
+	std::vector<glm::fvec4> colour(accum.size());
+	for (size_t i = 0; i < accum.size(); i++)
+		colour[i] = glm::fvec4(accum[i] / float(samples), 1.0f);
+	denoise(colour, guide, size);
+
+	for (size_t i = 0; i < accum.size(); i++)
+		accum[i] = glm::fvec3(colour[i]);
+	resolveImage(accum, size, 1.0f, rgb);
+}
+
+int renderBatch(const BatchSettings& settings, float fov)
+{
+	World world;
+	std::vector<Light> lights;
+	MaterialTable materials;
+	std::vector<CameraKey> keys;
+	if (!loadScene(settings.scenePath, world, lights, materials) || !loadCameraPath(settings.pathPath, keys))
+		return EXIT_FAILURE;
+
+	LightGrid lightGrid;
+	buildLightGrid(lightGrid, lights, world.size);
+	Scene scene = { &world, &lights, &lightGrid, &materials };
+
+	int frames = cameraPathFrames(keys);
+	int samples = std::max(settings.samples, 1);
+	int rendered = 0, skipped = 0, failed = 0;
+	std::vector<uint8_t> rgb;
+
+	auto start = std::chrono::steady_clock::now();
+	for (int frame = settings.shard; frame < frames; frame += settings.shardCount)
+	{
+		// Only complete frames are ever renamed into place, so any file present is done
+		std::string path = batchFramePath(settings.outDir, frame);
+		if (std::ifstream(path))
+		{
+			skipped++;
+			continue;
+		}
+
+		renderFrame(scene, cameraPathAt(keys, frame, fov), settings.size, samples, settings.denoised, rgb);
+
+		std::string temp = path + ".tmp";
+		if (!writePPM(temp.c_str(), settings.size, rgb) || std::rename(temp.c_str(), path.c_str()) != 0)
+		{
+			std::cout << "ERROR::IMAGE::FAILED_TO_WRITE " << path << std::endl;
+			std::remove(temp.c_str());
+			failed++;
+			continue;
+		}
+
+		rendered++;
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Frame " << frame + 1 << "/" << frames << ", " << seconds / rendered << " s/frame" << std::endl;
+	}
+
+	std::cout << "Rendered " << rendered << ", skipped " << skipped << " already done, " << failed << " failed" << std::endl;
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
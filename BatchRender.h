@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <string>
+
+struct BatchSettings
+{
+	const char* scenePath; // See SceneFile.h
+	const char* pathPath;  // See CameraPath.h
+	const char* outDir;    // Must exist
+	glm::ivec2 size;
+	int samples;           // Path samples per pixel
+	bool denoised;
+	int shard;             // This process renders the frames where frame % shardCount == shard
+	int shardCount;
+};
+
+// Path traces every frame of a camera path on the CPU and writes them to outDir as
+// frame_00000.ppm, frame_00001.ppm, ... Each frame uses every core. Several
+// processes can split a job on one host by giving each its own shard. A frame is
+// written to a temporary file and renamed when complete, and frames whose image
+// already exists are skipped, so rerunning an interrupted job only renders what is
+// missing. Returns an exit code.
+int renderBatch(const BatchSettings& settings, float fov);
+
+// outDir/frame_<frame>.ppm, the name every batch mode writes frames under
+std::string batchFramePath(const char* outDir, int frame);
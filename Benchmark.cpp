@@ -0,0 +1,493 @@
+#include "Benchmark.h"
+#include "Camera.h"
+#include "ChunkCache.h"
+#include "CpuRenderer.h"
+#include "Denoise.h"
+#include "FixedTraversal.h"
+#include "RayQuery.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Steps each ray takes in dda_step before the next ray is set up
+#define BENCH_DDA_STEPS 64
+// Coordinates in each voxel_fetch access pattern
+#define BENCH_FETCHES (1 << 20)
+// Distinct materials in defaultMaterials(), plus one past the end of the table
+#define BENCH_MATERIALS 11
+// Side of the noisy image the denoiser filters
+#define BENCH_DENOISE_SIZE 128
+
+// Every benchmark folds its results into this so the work can't be optimised away
+static volatile uint64_t sink;
+
+// How voxels were coloured before the material table, as the baseline for material_table
+static glm::fvec3 switchColour(uint32_t voxel)
+{
+	switch (voxel)
+	{
+	case 1: return glm::fvec3(1, 0.5, 1);
+	case 2: return glm::fvec3(1, 1, 1);
+	case 3: return glm::fvec3(0.5, 1, 1);
+	case 4: return glm::fvec3(0.25, 0.75, 0.5);
+	case 5: return glm::fvec3(0.75, 0.25, 0.5);
+	case 6: return glm::fvec3(0.5, 0.75, 0.25);
+	case 7: return glm::fvec3(0.5, 0.25, 0.75);
+	case 8: return glm::fvec3(0.8, 0.1, 0.6);
+	case 9: return glm::fvec3(0.1, 0.8, 0.6);
+	default: return glm::fvec3(1, 1, 0.5);
+	}
+}
+
+// Does ops operations and returns something that depends on all of them
+typedef std::function<uint64_t(uint64_t ops)> BenchFn;
+
+struct BenchResult
+{
+	std::string name;
+	uint64_t ops; // Per run
+	double min, median, mean, stddev; // Nanoseconds per operation
+};
+
+// 16.16 origin and direction for castRayFixed()
+struct FixedRay
+{
+	glm::ivec3 origin;
+	glm::ivec3 dir;
+};
+
+static bool pinToCore()
+{
+#ifdef _WIN32
+	return SetThreadAffinityMask(GetCurrentThread(), 1) != 0;
+#else
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(0, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+static double runNanoseconds(const BenchFn& fn, uint64_t ops)
+{
+	auto start = std::chrono::steady_clock::now();
+	sink = sink + fn(ops);
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static BenchResult measure(const std::string& name, const BenchFn& fn)
+{
+	uint64_t ops = 1;
+	while (runNanoseconds(fn, ops) < BENCH_MIN_RUN_MS * 1e6)
+		ops *= 2;
+	for (int i = 0; i < BENCH_WARMUP_RUNS; i++)
+		runNanoseconds(fn, ops);
+
+	std::vector<double> samples;
+	for (int i = 0; i < BENCH_RUNS; i++)
+		samples.push_back(runNanoseconds(fn, ops) / ops);
+	std::sort(samples.begin(), samples.end());
+
+	BenchResult result = { name, ops, samples.front(), samples[samples.size() / 2], 0, 0 };
+	for (double s : samples)
+		result.mean += s / samples.size();
+	for (double s : samples)
+		result.stddev += (s - result.mean) * (s - result.mean) / samples.size();
+	result.stddev = std::sqrt(result.stddev);
+	return result;
+}
+
+static uint32_t floatBits(float f)
+{
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+
+// Rolling hills of materials 1 - 9 with empty sky above
+static void buildTerrain(World& world)
+{
+	world.size = glm::ivec3(BENCH_WORLD_X, BENCH_WORLD_Y, BENCH_WORLD_Z);
+	world.voxels.assign(world.size.x * world.size.y * world.size.z, 0);
+	for (int z = 0; z < world.size.z; z++)
+		for (int x = 0; x < world.size.x; x++)
+		{
+			float h = 0.5f + 0.2f * std::sin(x * 0.05f) * std::cos(z * 0.07f) + 0.05f * ((pcgHash(z * world.size.x + x) & 0xFF) / 255.0f);
+			int height = int(h * world.size.y);
+			for (int y = 0; y < height; y++)
+				world.voxels[world.index({ x, y, z })] = 1 + pcgHash(world.index({ x, y, z })) % 9;
+		}
+}
+
+// Voxel address in 8^3 bricks laid out like the chunk pool, bricks in y-major order
+static inline int brickIndex(glm::ivec3 bricks, glm::ivec3 map)
+{
+	glm::ivec3 brick = map >> CHUNK_SHIFT;
+	return ((brick.y * bricks.z + brick.z) * bricks.x + brick.x) * CHUNK_VOXELS + int(ChunkCache::voxelOffset(map, WORLD_LINEAR));
+}
+
+// Spreads the low 10 bits of v out to every third bit
+static inline uint32_t spreadBits(uint32_t v)
+{
+	v &= 0x3FF;
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8)) & 0x0300F00F;
+	v = (v | (v << 4)) & 0x030C30C3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+// Z-order over the cube bounding the world, so flat worlds leave holes at the top
+static inline int mortonIndex(glm::ivec3 map)
+{
+	return int(spreadBits(map.x) | (spreadBits(map.y) << 1) | (spreadBits(map.z) << 2));
+}
+
+template <typename Address>
+static BenchFn fetch(const std::vector<uint32_t>& voxels, const std::vector<glm::ivec3>& coords, Address address)
+{
+	return [&voxels, &coords, address](uint64_t ops)
+	{
+		uint64_t sum = 0;
+		for (uint64_t i = 0; i < ops; i++)
+			sum += voxels[address(coords[i & (BENCH_FETCHES - 1)])];
+		return sum;
+	};
+}
+
+static void writeJSON(std::ostream& out, const std::vector<BenchResult>& results, bool pinned)
+{
+	out << "{" << std::endl
+		<< "  \"pinned\": " << (pinned ? "true" : "false") << "," << std::endl
+		<< "  \"hardware_threads\": " << std::thread::hardware_concurrency() << "," << std::endl
+		<< "  \"world\": [" << BENCH_WORLD_X << ", " << BENCH_WORLD_Y << ", " << BENCH_WORLD_Z << "]," << std::endl
+		<< "  \"warmup_runs\": " << BENCH_WARMUP_RUNS << "," << std::endl
+		<< "  \"runs\": " << BENCH_RUNS << "," << std::endl
+		<< "  \"unit\": \"ns/op\"," << std::endl
+		<< "  \"results\": [" << std::endl;
+	out << std::setprecision(6);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult& r = results[i];
+		out << "    { \"name\": \"" << r.name << "\", \"ops\": " << r.ops << ", \"min\": " << r.min << ", \"median\": " << r.median
+			<< ", \"mean\": " << r.mean << ", \"stddev\": " << r.stddev << " }" << (i + 1 < results.size() ? "," : "") << std::endl;
+	}
+	out << "  ]" << std::endl << "}" << std::endl;
+}
+
+int runBenchmarks(const char* outPath, const char* filter)
+{
+	// The whole suite runs on this thread, which is pinned so results don't depend on
+	// where the scheduler moves it
+	bool pinned = pinToCore();
+	if (!pinned)
+		std::cout << "WARNING::BENCH::COULD_NOT_PIN_THREAD" << std::endl;
+
+	World world;
+	buildTerrain(world);
+
+	// Draws one component at a time, so the inputs don't depend on argument evaluation order
+	uint32_t seed = 1;
+	auto random3 = [&]()
+	{
+		glm::fvec3 v;
+		for (int i = 0; i < 3; i++)
+			v[i] = random01(seed);
+		return v;
+	};
+	auto randomVoxel = [&]() { return glm::ivec3(random3() * glm::fvec3(world.size)); };
+
+	// Rays from random empty voxels in random directions
+	std::vector<Ray> rays;
+	while (rays.size() < BENCH_INPUTS)
+	{
+		glm::ivec3 map = randomVoxel();
+		glm::fvec3 dir = random3() - 0.5f;
+		glm::fvec3 offset = random3();
+		if (world.voxels[world.index(map)] != 0 || glm::length(dir) < 0.01f)
+			continue;
+		rays.push_back({ glm::fvec3(map) + offset, glm::normalize(dir), FLT_MAX });
+	}
+
+	std::vector<glm::ivec3> coords(BENCH_INPUTS);
+	std::vector<float> angles(BENCH_INPUTS);
+	std::vector<uint32_t> materials(BENCH_INPUTS);
+	for (int i = 0; i < BENCH_INPUTS; i++)
+	{
+		coords[i] = randomVoxel();
+		angles[i] = random01(seed) * 6.2831853f;
+		materials[i] = uint32_t(random01(seed) * BENCH_MATERIALS);
+	}
+
+	// A noisy image over blocks of faces at varying distances, with some pixels missing the world
+	std::vector<glm::fvec4> noisy(BENCH_DENOISE_SIZE * BENCH_DENOISE_SIZE), denoiseGuide(noisy.size());
+	for (int i = 0; i < int(noisy.size()); i++)
+	{
+		int x = i % BENCH_DENOISE_SIZE, y = i / BENCH_DENOISE_SIZE;
+		noisy[i] = glm::fvec4(random01(seed), random01(seed), random01(seed), 1.0f);
+		float hit = random01(seed) < 0.05f ? 0.0f : 1.0f;
+		denoiseGuide[i] = glm::fvec4(float((x / 16 + y / 16) % 6), 2.0f + x * 0.05f + random01(seed) * 0.01f, 1.0f, hit);
+	}
+
+	// The same voxels in each layout, and the access patterns to fetch them in
+	glm::ivec3 bricks = (world.size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	int cube = 1;
+	while (cube < std::max(world.size.x, std::max(world.size.y, world.size.z)))
+		cube *= 2;
+	std::vector<uint32_t> brickVoxels(bricks.x * bricks.y * bricks.z * CHUNK_VOXELS, 0);
+	std::vector<uint32_t> mortonVoxels(cube * cube * cube, 0);
+	for (int y = 0; y < world.size.y; y++)
+		for (int z = 0; z < world.size.z; z++)
+			for (int x = 0; x < world.size.x; x++)
+			{
+				uint32_t voxel = world.voxels[world.index({ x, y, z })];
+				brickVoxels[brickIndex(bricks, { x, y, z })] = voxel;
+				mortonVoxels[mortonIndex({ x, y, z })] = voxel;
+			}
+
+	std::vector<glm::ivec3> sweep, walk, scatter;
+	for (int i = 0; i < BENCH_FETCHES; i++)
+	{
+		sweep.push_back({ i % world.size.x, (i / (world.size.x * world.size.z)) % world.size.y, (i / world.size.x) % world.size.z });
+		scatter.push_back(randomVoxel());
+	}
+	for (size_t r = 0; walk.size() < BENCH_FETCHES; r = (r + 1) % rays.size())
+	{
+		// The voxels a ray visits until it hits something or leaves the world
+		glm::ivec3 map, stepAmount;
+		glm::fvec3 tDelta, tMax;
+		initDDA(rays[r].origin, rays[r].dir, map, stepAmount, tDelta, tMax);
+		while (walk.size() < BENCH_FETCHES && world.contains(map))
+		{
+			walk.push_back(map);
+			if (world.voxels[world.index(map)] != 0)
+				break;
+			int axis = tMax.x < tMax.y ? (tMax.x < tMax.z ? 0 : 2) : (tMax.y < tMax.z ? 1 : 2);
+			map[axis] += stepAmount[axis];
+			tMax[axis] += tDelta[axis];
+		}
+	}
+
+	MaterialTable palette = defaultMaterials();
+
+	std::vector<std::pair<std::string, BenchFn>> benches;
+
+	benches.emplace_back("dda_step", [&](uint64_t ops)
+	{
+		uint64_t sum = 0;
+		for (uint64_t done = 0, r = 0; done < ops; r++)
+		{
+			const Ray& ray = rays[r & (BENCH_INPUTS - 1)];
+			glm::ivec3 map, stepAmount;
+			glm::fvec3 tDelta, tMax;
+			initDDA(ray.origin, ray.dir, map, stepAmount, tDelta, tMax);
+			uint64_t steps = std::min<uint64_t>(BENCH_DDA_STEPS, ops - done);
+			for (uint64_t s = 0; s < steps; s++)
+			{
+				int axis = tMax.x < tMax.y ? (tMax.x < tMax.z ? 0 : 2) : (tMax.y < tMax.z ? 1 : 2);
+				map[axis] += stepAmount[axis];
+				tMax[axis] += tDelta[axis];
+			}
+			sum += map.x + map.y + map.z;
+			done += steps;
+		}
+		return sum;
+	});
+
+	// The traversal and indexing benchmarks again over the same terrain in Z-order chunks
+	World mortonWorld = world;
+	setWorldLayout(mortonWorld, WORLD_MORTON);
+	const std::pair<const char*, const World*> layouts[] = { { "", &world }, { "/morton", &mortonWorld } };
+
+	for (const auto& layout : layouts)
+	{
+		const World& w = *layout.second;
+		benches.emplace_back(std::string("cast_ray") + layout.first, [&rays, &w](uint64_t ops)
+		{
+			uint64_t sum = 0;
+			for (uint64_t i = 0; i < ops; i++)
+			{
+				const Ray& ray = rays[i & (BENCH_INPUTS - 1)];
+				sum += castRay(w, ray.origin, ray.dir, ray.maxDist).voxel;
+			}
+			return sum;
+		});
+	}
+
+	// The same rays quantized to 16.16 up front, as a lockstep simulation would keep them
+	std::vector<FixedRay> fixedRays;
+	for (const Ray& ray : rays)
+		fixedRays.push_back({ toFixed(ray.origin), toFixed(ray.dir) });
+
+	for (const auto& layout : layouts)
+	{
+		const World& w = *layout.second;
+		benches.emplace_back(std::string("cast_ray_fixed") + layout.first, [&fixedRays, &w](uint64_t ops)
+		{
+			uint64_t sum = 0;
+			for (uint64_t i = 0; i < ops; i++)
+			{
+				const FixedRay& ray = fixedRays[i & (BENCH_INPUTS - 1)];
+				sum += castRayFixed(w, ray.origin, ray.dir).voxel;
+			}
+			return sum;
+		});
+	}
+
+	// In blocks small enough that castRays() stays on this thread
+	for (const auto& layout : layouts)
+	{
+		const World& w = *layout.second;
+		benches.emplace_back(std::string("cast_rays_sse") + layout.first, [&rays, &w](uint64_t ops)
+		{
+			uint64_t sum = 0;
+			RayHit hits[RAY_QUERY_BLOCK];
+			for (uint64_t done = 0; done < ops;)
+			{
+				size_t offset = size_t(done & (BENCH_INPUTS - 1));
+				size_t count = size_t(std::min<uint64_t>(std::min<size_t>(RAY_QUERY_BLOCK, BENCH_INPUTS - offset), ops - done));
+				castRays(w, &rays[offset], hits, count);
+				for (size_t i = 0; i < count; i++)
+					sum += hits[i].voxel;
+				done += count;
+			}
+			return sum;
+		});
+	}
+
+	for (const auto& layout : layouts)
+	{
+		const World& w = *layout.second;
+		benches.emplace_back(std::string("world_index") + layout.first, [&coords, &w](uint64_t ops)
+		{
+			uint64_t sum = 0;
+			for (uint64_t i = 0; i < ops; i++)
+				sum += w.index(coords[i & (BENCH_INPUTS - 1)]);
+			return sum;
+		});
+	}
+
+	// The same with each row and layer padded to a power of two so the multiplies become shifts
+	benches.emplace_back("world_index_pow2", [&](uint64_t ops)
+	{
+		int xBits = 0, zBits = 0;
+		while ((1 << xBits) < world.size.x)
+			xBits++;
+		while ((1 << zBits) < world.size.z)
+			zBits++;
+		uint64_t sum = 0;
+		for (uint64_t i = 0; i < ops; i++)
+		{
+			glm::ivec3 map = coords[i & (BENCH_INPUTS - 1)];
+			sum += (map.y << (zBits + xBits)) | (map.z << xBits) | map.x;
+		}
+		return sum;
+	});
+
+	const std::pair<const char*, const std::vector<glm::ivec3>*> patterns[] = { { "sweep", &sweep }, { "ray", &walk }, { "random", &scatter } };
+	for (const auto& pattern : patterns)
+	{
+		std::string suffix = std::string("/") + pattern.first;
+		const World* w = &world;
+		benches.emplace_back("voxel_fetch/linear" + suffix, fetch(world.voxels, *pattern.second, [w](glm::ivec3 map) { return w->index(map); }));
+		benches.emplace_back("voxel_fetch/brick" + suffix, fetch(brickVoxels, *pattern.second, [bricks](glm::ivec3 map) { return brickIndex(bricks, map); }));
+		benches.emplace_back("voxel_fetch/morton" + suffix, fetch(mortonVoxels, *pattern.second, [](glm::ivec3 map) { return mortonIndex(map); }));
+		const World* m = &mortonWorld;
+		benches.emplace_back("voxel_fetch/chunk_morton" + suffix, fetch(mortonWorld.voxels, *pattern.second, [m](glm::ivec3 map) { return m->index(map); }));
+	}
+
+	benches.emplace_back("rotation_matrix", [&](uint64_t ops)
+	{
+		float sum = 0;
+		for (uint64_t i = 0; i < ops; i++)
+		{
+			glm::fmat3 rot = rotationMatrix(glm::fvec3(0, 1, 0), angles[i & (BENCH_INPUTS - 1)]);
+			sum += rot[0][0] + rot[2][1];
+		}
+		return uint64_t(floatBits(sum));
+	});
+
+	benches.emplace_back("material_switch", [&](uint64_t ops)
+	{
+		glm::fvec3 sum(0);
+		for (uint64_t i = 0; i < ops; i++)
+			sum += switchColour(materials[i & (BENCH_INPUTS - 1)]);
+		return uint64_t(floatBits(sum.x + sum.y + sum.z));
+	});
+
+	benches.emplace_back("material_table", [&](uint64_t ops)
+	{
+		glm::fvec3 sum(0);
+		for (uint64_t i = 0; i < ops; i++)
+			sum += materialOf(palette, materials[i & (BENCH_INPUTS - 1)]).albedo;
+		return uint64_t(floatBits(sum.x + sum.y + sum.z));
+	});
+
+	// The row kernel alone, so the pinned thread times it rather than parallelFor's
+	// threads fighting over one core. Rows and passes cycle so every step width is covered.
+	std::vector<glm::fvec4> denoised(noisy.size());
+	benches.emplace_back("denoise_row", [&](uint64_t ops)
+	{
+		uint64_t sum = 0;
+		for (uint64_t i = 0; i < ops; i++)
+		{
+			int y = int(i % BENCH_DENOISE_SIZE), pass = int(i / BENCH_DENOISE_SIZE % DENOISE_PASSES);
+			denoiseRow(noisy, denoised, denoiseGuide, { BENCH_DENOISE_SIZE, BENCH_DENOISE_SIZE }, y, 1 << pass, denoiseSigmaColour(pass));
+			sum += floatBits(denoised[y * BENCH_DENOISE_SIZE + int(i % BENCH_DENOISE_SIZE)].x);
+		}
+		return sum;
+	});
+
+	// Columns wide enough for the longest name and a median of up to a second
+	size_t nameWidth = std::string("benchmark").size();
+	for (const auto& bench : benches)
+		nameWidth = std::max(nameWidth, bench.first.size());
+	nameWidth += 2;
+	const int numberWidth = 16;
+
+	std::vector<BenchResult> results;
+	std::cout << std::left << std::setw(nameWidth) << "benchmark" << std::right << std::setw(numberWidth) << "median ns" << std::setw(numberWidth) << "min ns"
+		<< std::setw(10) << "stddev" << std::endl;
+	for (const auto& bench : benches)
+	{
+		if (filter && bench.first.find(filter) == std::string::npos)
+			continue;
+
+		results.push_back(measure(bench.first, bench.second));
+		const BenchResult& r = results.back();
+		std::cout << std::left << std::setw(nameWidth) << r.name << std::right << std::fixed << std::setprecision(3) << std::setw(numberWidth) << r.median
+			<< std::setw(numberWidth) << r.min << std::setw(9) << std::setprecision(1) << 100 * r.stddev / r.mean << "%" << std::endl;
+	}
+
+	if (!outPath)
+		return EXIT_SUCCESS;
+
+	std::ofstream file(outPath);
+	if (!file)
+	{
+		std::cout << "ERROR::BENCH::FILE_NOT_WRITTEN " << outPath << std::endl;
+		return EXIT_FAILURE;
+	}
+	writeJSON(file, results, pinned);
+	std::cout << "Wrote " << outPath << std::endl;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// Timed runs of each benchmark after warming up, and the least time a run must take.
+// Iteration counts double until a run is long enough for the clock to be negligible.
+#define BENCH_WARMUP_RUNS 3
+#define BENCH_RUNS 15
+#define BENCH_MIN_RUN_MS 20
+// Synthetic terrain the memory benchmarks run over, large enough to fall out of L2
+#define BENCH_WORLD_X 256
+#define BENCH_WORLD_Y 64
+#define BENCH_WORLD_Z 256
+// Inputs per benchmark, generated once from a fixed seed so every run sees the same data
+#define BENCH_INPUTS (1 << 16)
+
+// Microbenchmarks of the kernels the renderer is built from, run single-threaded on
+// one pinned core:
+//   dda_step                 one step of the traversal loop, without fetching voxels
+//   cast_ray, cast_rays_sse  whole closest-hit queries, scalar and four-wide
+//   cast_ray_fixed           the same scalar queries through the fixed-point DDA
+//   world_index              World::index(), against a power-of-two padded variant
+//   .../morton               the same over a WORLD_MORTON copy of the terrain
+//   voxel_fetch/<layout>/<pattern>
+//                            fetches in y-major, 8^3 brick, Morton cube and Z-order
+//                            chunk (WORLD_MORTON) layouts, swept in order, along ray
+//                            walks and at random
+//   rotation_matrix          rotationMatrix() as the camera builds it each frame
+//   material_switch          the old hard-coded colour switch, against materialOf()
+//   denoise_row              one SSE2 pass over a row of a 128x128 noisy image, per row
+// Each reports nanoseconds per operation as min, median, mean and standard deviation
+// over BENCH_RUNS runs. Results go to stdout and, if outPath is given, to a JSON file.
+// Only benchmarks whose name contains filter run, if one is given.
+int runBenchmarks(const char* outPath, const char* filter);
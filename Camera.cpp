@@ -0,0 +1,23 @@
+#include "Camera.h"
+
+#include <cmath>
+
+glm::fmat3 rotationMatrix(glm::fvec3 axis, float angle)
+{
+	axis = glm::normalize(axis);
+	float s = sin(angle);
+	float c = cos(angle);
+	float oc = 1.0 - c;
+
+	return glm::fmat3(oc * axis.x * axis.x + c, oc * axis.x * axis.y - axis.z * s, oc * axis.z * axis.x + axis.y * s,
+		oc * axis.x * axis.y + axis.z * s, oc * axis.y * axis.y + c, oc * axis.y * axis.z - axis.x * s,
+		oc * axis.z * axis.x - axis.y * s, oc * axis.y * axis.z + axis.x * s, oc * axis.z * axis.z + c);
+}
+
+glm::fvec3 cameraRay(const Camera& camera, glm::ivec2 size, glm::fvec2 fragCoord)
+{
+	float x = (2 * (fragCoord.x + 0.5f) / float(size.x) - 1) * std::tan(camera.fov / 2.f) * size.x / float(size.y);
+	float y = (2 * (fragCoord.y + 0.5f) / float(size.y) - 1) * std::tan(camera.fov / 2.f);
+
+	return rotationMatrix(glm::fvec3(0, 1, 0), camera.theta.x) * glm::normalize(glm::fvec3(x, y, -1));
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+struct Camera
+{
+	glm::fvec3 pos;
+	glm::fvec2 theta;
+	float fov;
+};
+
+glm::fmat3 rotationMatrix(glm::fvec3 axis, float angle);
+
+// World space direction through fragCoord, matching main() in shader.frag.
+// fragCoord follows gl_FragCoord: pixel centres at +0.5, bottom row first.
+glm::fvec3 cameraRay(const Camera& camera, glm::ivec2 size, glm::fvec2 fragCoord);
@@ -0,0 +1,63 @@
+#include "CameraPath.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+bool loadCameraPath(const char* path, std::vector<CameraKey>& keys)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cout << "ERROR::CAMERA_PATH::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+		return false;
+	}
+
+	keys.clear();
+	while (file >> std::ws && !file.eof())
+	{
+		if (file.peek() == '#')
+		{
+			file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+			continue;
+		}
+
+		CameraKey key;
+		file >> key.frame >> key.pos.x >> key.pos.y >> key.pos.z >> key.yaw;
+		if (!file || key.frame < 0 || (!keys.empty() && key.frame <= keys.back().frame))
+		{
+			std::cout << "ERROR::CAMERA_PATH::BAD_KEY " << keys.size() + 1 << " in " << path << std::endl;
+			return false;
+		}
+		keys.push_back(key);
+	}
+
+	if (keys.empty())
+	{
+		std::cout << "ERROR::CAMERA_PATH::NO_KEYS " << path << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+int cameraPathFrames(const std::vector<CameraKey>& keys)
+{
+	return keys.back().frame + 1;
+}
+
+Camera cameraPathAt(const std::vector<CameraKey>& keys, int frame, float fov)
+{
+	size_t next = 0;
+	while (next < keys.size() && keys[next].frame < frame)
+		next++;
+
+	const CameraKey& b = keys[std::min(next, keys.size() - 1)];
+	if (next == 0 || next == keys.size())
+		return { b.pos, glm::fvec2(b.yaw, 0), fov };
+
+	const CameraKey& a = keys[next - 1];
+	float t = float(frame - a.frame) / float(b.frame - a.frame);
+	return { glm::mix(a.pos, b.pos, t), glm::fvec2(glm::mix(a.yaw, b.yaw, t), 0), fov };
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Camera.h"
+
+#include <vector>
+
+struct CameraKey
+{
+	int frame;
+	glm::fvec3 pos;
+	float yaw; // Radians about +y, as Camera::theta.x
+};
+
+// Keyframed camera path, one key per line:
+//
+//   # comment to end of line
+//   <frame> <x> <y> <z> <yaw>
+//
+// Frames must increase from line to line. The path runs from frame 0 to the last
+// key's frame; frames between keys are interpolated linearly and frames before the
+// first key hold it. Errors are printed.
+bool loadCameraPath(const char* path, std::vector<CameraKey>& keys);
+
+int cameraPathFrames(const std::vector<CameraKey>& keys);
+Camera cameraPathAt(const std::vector<CameraKey>& keys, int frame, float fov);
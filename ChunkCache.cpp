@@ -0,0 +1,167 @@
+#include "ChunkCache.h"
+
+#include <algorithm>
+
+ChunkCache::ChunkCache(glm::ivec3 worldSize, size_t budgetBytes)
+{
+	m_dims = (worldSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	m_pageDims = pageDims(m_dims);
+	uint32_t chunks = uint32_t(m_dims.x * m_dims.y * m_dims.z);
+	uint32_t pages = uint32_t(m_pageDims.x * m_pageDims.y * m_pageDims.z);
+
+	// No point holding more slots than there are chunks, but always at least one
+	m_slotCount = uint32_t(std::max<size_t>(1, std::min<size_t>(chunks, budgetBytes / (CHUNK_SLOT_BYTES + PAGE_BYTES))));
+	for (uint32_t slot = m_slotCount; slot > 0; slot--)
+		m_freeSlots.push_back(slot - 1);
+
+	// Every resident chunk's page is allocated, so a page per slot always suffices
+	uint32_t poolPages = std::min(m_slotCount, pages);
+	m_directorySize = pages;
+	m_pageTable.assign(m_directorySize, PAGE_NOT_ALLOCATED);
+	m_pageTable.resize(m_directorySize + size_t(poolPages) * PAGE_CHUNKS, CHUNK_NOT_RESIDENT);
+	for (uint32_t page = poolPages; page > 0; page--)
+		m_freePages.push_back(page - 1);
+	m_pageResident.assign(poolPages, 0);
+}
+
+void ChunkCache::use(uint32_t chunk)
+{
+	ChunkState& state = m_chunks[chunk];
+	if (state.lastUsed == m_frame)
+		return;
+	state.lastUsed = m_frame;
+	m_lru.splice(m_lru.begin(), m_lru, state.lruPos);
+	m_inUse++;
+}
+
+void ChunkCache::request(uint32_t chunk, std::vector<uint32_t>& requests)
+{
+	// Every outstanding load needs a slot to land in: a free one or one not in use
+	uint32_t room = uint32_t(m_freeSlots.size() + m_lru.size()) - m_inUse;
+	auto found = m_chunks.find(chunk);
+	if ((found != m_chunks.end() && found->second.loading) || m_inFlight >= std::min<uint32_t>(room, CHUNK_LOADS_IN_FLIGHT))
+		return;
+
+	m_chunks[chunk].loading = true;
+	m_inFlight++;
+	requests.push_back(chunk);
+}
+
+void ChunkCache::update(const std::vector<uint32_t>& touched, const std::vector<uint32_t>& prefetch, std::vector<uint32_t>& requests)
+{
+	requests.clear();
+	m_frame++;
+	m_inUse = 0;
+
+	m_touched = touched;
+	std::sort(m_touched.begin(), m_touched.end());
+	m_touched.erase(std::unique(m_touched.begin(), m_touched.end()), m_touched.end());
+
+	// Mark everything in view before requesting anything, so no load can be handed a
+	// slot that is still needed
+	std::vector<uint32_t> misses;
+	for (uint32_t chunk : m_touched)
+	{
+		if (slotOfChunk(chunk) != CHUNK_NOT_RESIDENT)
+			use(chunk);
+		else
+			misses.push_back(chunk);
+	}
+	for (uint32_t chunk : misses)
+		request(chunk, requests);
+
+	// Predicted chunks get whatever the visible ones leave over, soonest first. Beyond
+	// that they would only push out chunks that are needed now.
+	uint32_t spare = m_slotCount - std::min<uint32_t>(m_slotCount, m_inUse + uint32_t(misses.size()));
+	for (uint32_t chunk : prefetch)
+	{
+		if (spare == 0)
+			break;
+		if (this->touched(chunk))
+			continue;
+		spare--;
+		if (slotOfChunk(chunk) != CHUNK_NOT_RESIDENT)
+			use(chunk);
+		else
+			request(chunk, requests);
+	}
+}
+
+// Points a chunk's page table entry at slot, allocating its page on the way in and
+// freeing it when its last resident chunk leaves
+void ChunkCache::setSlot(uint32_t chunk, uint32_t slot, std::vector<uint32_t>& changedPages)
+{
+	glm::ivec3 coord = chunkCoord(chunk), page = coord >> PAGE_SHIFT;
+	uint32_t directoryEntry = (page.y * m_pageDims.z + page.z) * m_pageDims.x + page.x;
+	if (m_pageTable[directoryEntry] == PAGE_NOT_ALLOCATED)
+	{
+		m_pageTable[directoryEntry] = m_freePages.back();
+		m_freePages.pop_back();
+		changedPages.push_back(directoryEntry);
+	}
+
+	uint32_t poolPage = m_pageTable[directoryEntry];
+	uint32_t entry = pageEntry(coord);
+	if (slot != CHUNK_NOT_RESIDENT)
+		m_pageResident[poolPage]++;
+	else
+		m_pageResident[poolPage]--;
+	m_pageTable[entry] = slot;
+	changedPages.push_back(entry);
+
+	if (m_pageResident[poolPage] == 0)
+	{
+		m_pageTable[directoryEntry] = PAGE_NOT_ALLOCATED;
+		m_freePages.push_back(poolPage);
+		changedPages.push_back(directoryEntry);
+	}
+}
+
+uint32_t ChunkCache::install(uint32_t chunk, std::vector<uint32_t>& changedPages)
+{
+	ChunkState& state = m_chunks[chunk];
+	state.loading = false;
+	m_inFlight--;
+	if (state.stale)
+	{
+		m_chunks.erase(chunk);
+		return CHUNK_NOT_RESIDENT;
+	}
+
+	// Used chunks sit at the front of the list, so if the back is in use they all are
+	uint32_t slot;
+	if (!m_freeSlots.empty())
+	{
+		slot = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else if (m_chunks[m_lru.back()].lastUsed != m_frame)
+	{
+		uint32_t victim = m_lru.back();
+		m_lru.pop_back();
+		slot = slotOfChunk(victim);
+		setSlot(victim, CHUNK_NOT_RESIDENT, changedPages);
+		m_chunks.erase(victim);
+	}
+	else
+	{
+		m_chunks.erase(chunk);
+		return CHUNK_NOT_RESIDENT;
+	}
+
+	// A chunk just streamed in counts as used so the next install can't take its slot
+	ChunkState& installed = m_chunks[chunk];
+	setSlot(chunk, slot, changedPages);
+	m_lru.push_front(chunk);
+	installed.lruPos = m_lru.begin();
+	installed.lastUsed = m_frame;
+	m_inUse++;
+	return slot;
+}
+
+void ChunkCache::invalidate(uint32_t chunk)
+{
+	auto found = m_chunks.find(chunk);
+	if (found != m_chunks.end() && found->second.loading)
+		found->second.stale = true;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "World.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// Page table entry for a chunk with no slot
+#define CHUNK_NOT_RESIDENT 0xFFFFFFFFu
+// A page of the page table holds the entries of PAGE_SIZE^3 chunks
+#define PAGE_SHIFT 2
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define PAGE_CHUNKS (PAGE_SIZE * PAGE_SIZE * PAGE_SIZE)
+#define PAGE_BYTES (PAGE_CHUNKS * sizeof(uint32_t))
+// Directory entry for a page none of whose chunks are resident
+#define PAGE_NOT_ALLOCATED 0xFFFFFFFFu
+// A pool slot holds a chunk's voxels followed by their face AO, CHUNK_VOXELS of each
+#define CHUNK_SLOT_VOXELS (2 * CHUNK_VOXELS)
+#define CHUNK_SLOT_BYTES (2 * CHUNK_BYTES)
+
+// Upper bound on chunks streamed in per frame, so a burst of misses can't stall a frame
+#define CHUNK_UPLOADS_PER_FRAME 64
+// Upper bound on chunk loads waiting on the loader at once
+#define CHUNK_LOADS_IN_FLIGHT 128
+
+// Decides which world chunks live in a fixed-size GPU pool. The shader looks every
+// voxel up through a two-level page table and lists each chunk it touches in a
+// feedback buffer (see ChunkFeedback.h). Touched chunks that are resident move to
+// the front of an LRU list; touched chunks that are missing are requested from the
+// loader, followed by the chunks the prefetcher expects to come into view. Loaded
+// chunks take free slots first and then the slots of the least recently used
+// chunks. Chunks in view are never evicted for another, predicted chunks only get
+// the slots the view leaves spare, and the pool never grows past the budget given
+// at construction. This class only does the bookkeeping; the caller owns the GL
+// buffers and the loader.
+//
+// The page table is one array: a directory with an entry per page of the world,
+// holding the page's place in the page pool or PAGE_NOT_ALLOCATED, followed by the
+// page pool, whose entries hold a slot or CHUNK_NOT_RESIDENT. A page is only
+// allocated while one of its chunks is resident, and the pool has a page per slot,
+// so the directory is all that grows with the world, at a word per PAGE_CHUNKS chunks.
+// Other per-chunk state is only kept for chunks that are resident or loading.
+class ChunkCache
+{
+public:
+	// Each slot costs CHUNK_SLOT_BYTES and PAGE_BYTES of the budget
+	ChunkCache(glm::ivec3 worldSize, size_t budgetBytes);
+
+	// Bytes of the page table directory for a world, which stays resident whatever the budget
+	static size_t directoryBytes(glm::ivec3 worldSize)
+	{
+		glm::ivec3 pages = pageDims((worldSize + CHUNK_SIZE - 1) / CHUNK_SIZE);
+		return size_t(pages.x) * pages.y * pages.z * sizeof(uint32_t);
+	}
+
+	static glm::ivec3 pageDims(glm::ivec3 chunkDims)
+	{
+		return (chunkDims + PAGE_SIZE - 1) / PAGE_SIZE;
+	}
+
+	glm::ivec3 dims() const { return m_dims; }
+	uint32_t slotCount() const { return m_slotCount; }
+	uint32_t residentCount() const { return uint32_t(m_lru.size()); }
+	// Directory then page pool, see above
+	const std::vector<uint32_t>& pageTable() const { return m_pageTable; }
+	uint32_t directorySize() const { return m_directorySize; }
+
+	uint32_t chunkIndex(glm::ivec3 chunk) const
+	{
+		return (chunk.y * m_dims.z + chunk.z) * m_dims.x + chunk.x;
+	}
+
+	glm::ivec3 chunkCoord(uint32_t index) const
+	{
+		return glm::ivec3(index % m_dims.x, index / (m_dims.x * m_dims.z), (index / m_dims.x) % m_dims.z);
+	}
+
+	// Slot holding a chunk, or CHUNK_NOT_RESIDENT
+	uint32_t slotOfChunk(uint32_t chunk) const
+	{
+		uint32_t entry = pageEntry(chunkCoord(chunk));
+		return entry == PAGE_NOT_ALLOCATED ? CHUNK_NOT_RESIDENT : m_pageTable[entry];
+	}
+
+	// Slot holding the chunk containing voxel map, or CHUNK_NOT_RESIDENT
+	uint32_t slotOf(glm::ivec3 map) const
+	{
+		return slotOfChunk(chunkIndex(map >> CHUNK_SHIFT));
+	}
+
+	// Whether the feedback of the last update() listed a chunk
+	bool touched(uint32_t chunk) const
+	{
+		return std::binary_search(m_touched.begin(), m_touched.end(), chunk);
+	}
+
+	// Chunks holding any voxel within reach of map along every axis, e.g. those whose
+	// AO an edit at map can change
+	void chunksNear(glm::ivec3 map, int reach, std::vector<uint32_t>& chunks) const
+	{
+		chunks.clear();
+		glm::ivec3 lo = glm::max(map - reach, glm::ivec3(0)) >> CHUNK_SHIFT;
+		glm::ivec3 hi = glm::min((map + reach) >> CHUNK_SHIFT, m_dims - 1);
+		for (int y = lo.y; y <= hi.y; y++)
+			for (int z = lo.z; z <= hi.z; z++)
+				for (int x = lo.x; x <= hi.x; x++)
+					chunks.push_back(chunkIndex({ x, y, z }));
+	}
+
+	// Offset of voxel map within its chunk's slot. Slots hold their voxels in the
+	// order the world's layout uses within a chunk, and the AO the same way after them.
+	static uint32_t voxelOffset(glm::ivec3 map, WorldLayout layout)
+	{
+		glm::ivec3 local = map & (CHUNK_SIZE - 1);
+		if (layout == WORLD_MORTON)
+			return mortonOffset(local);
+		return (local.y * CHUNK_SIZE + local.z) * CHUNK_SIZE + local.x;
+	}
+
+	// Start a frame from its shader feedback (the chunks rays touched, each once) and
+	// the prefetcher's ranking. Fills requests with the chunks to load: visible misses
+	// first, then predicted ones in rank order, never more than the pool has room for.
+	void update(const std::vector<uint32_t>& touched, const std::vector<uint32_t>& prefetch, std::vector<uint32_t>& requests);
+
+	// Place a chunk whose load has finished and return its slot, appending the indices
+	// of the page table entries to re-upload to changedPages. Returns CHUNK_NOT_RESIDENT
+	// if the load went stale or every slot holds a chunk that is in use this frame; the
+	// chunk will be requested again when it is next needed.
+	uint32_t install(uint32_t chunk, std::vector<uint32_t>& changedPages);
+
+	// The world changed under a chunk. If a load of it is in flight, its data will be
+	// discarded on arrival.
+	void invalidate(uint32_t chunk);
+
+private:
+	// A chunk that is resident or has a load outstanding
+	struct ChunkState
+	{
+		std::list<uint32_t>::iterator lruPos; // Valid while resident
+		uint32_t lastUsed = 0;                // Frame it was last used
+		bool loading = false;
+		bool stale = false; // The outstanding load is out of date
+	};
+
+	// Index of a chunk's entry in the page pool part of m_pageTable, or
+	// PAGE_NOT_ALLOCATED if its page isn't
+	uint32_t pageEntry(glm::ivec3 chunk) const
+	{
+		glm::ivec3 page = chunk >> PAGE_SHIFT, local = chunk & (PAGE_SIZE - 1);
+		uint32_t poolPage = m_pageTable[(page.y * m_pageDims.z + page.z) * m_pageDims.x + page.x];
+		if (poolPage == PAGE_NOT_ALLOCATED)
+			return PAGE_NOT_ALLOCATED;
+		return m_directorySize + poolPage * PAGE_CHUNKS + uint32_t((local.y * PAGE_SIZE + local.z) * PAGE_SIZE + local.x);
+	}
+
+	void use(uint32_t chunk);
+	void request(uint32_t chunk, std::vector<uint32_t>& requests);
+	void setSlot(uint32_t chunk, uint32_t slot, std::vector<uint32_t>& changedPages);
+
+	glm::ivec3 m_dims;
+	glm::ivec3 m_pageDims;
+	uint32_t m_slotCount;
+	uint32_t m_directorySize;
+	std::vector<uint32_t> m_pageTable;
+	std::vector<uint32_t> m_freeSlots;
+	std::vector<uint32_t> m_freePages;
+	std::vector<uint32_t> m_pageResident; // Resident chunks per pool page
+
+	// Resident chunks, most recently used first
+	std::list<uint32_t> m_lru;
+	std::unordered_map<uint32_t, ChunkState> m_chunks;
+	std::vector<uint32_t> m_touched; // Sorted
+
+	uint32_t m_frame = 0;
+	uint32_t m_inUse = 0; // Resident chunks used this frame
+	uint32_t m_inFlight = 0;
+};
@@ -0,0 +1,91 @@
+#include "ChunkFeedback.h"
+
+#include <algorithm>
+#include <cstring>
+
+size_t ChunkFeedback::bufferBytes(size_t capacity, size_t chunkCount)
+{
+	return (1 + capacity + (chunkCount + 31) / 32) * sizeof(uint32_t);
+}
+
+size_t ChunkFeedback::residentBytes(size_t capacity, size_t chunkCount)
+{
+	return bufferBytes(capacity, chunkCount) + FEEDBACK_RING * (1 + capacity) * sizeof(uint32_t);
+}
+
+ChunkFeedback::ChunkFeedback(GLuint feedback, size_t capacity)
+	: m_feedback(feedback), m_capacity(capacity), m_listBytes((1 + capacity) * sizeof(uint32_t))
+{
+	for (Slot& slot : m_slots)
+	{
+		glGenBuffers(1, &slot.buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, m_listBytes, nullptr, GL_STREAM_READ);
+		slot.fence = nullptr;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+ChunkFeedback::~ChunkFeedback()
+{
+	for (Slot& slot : m_slots)
+	{
+		if (slot.fence)
+			glDeleteSync(slot.fence);
+		glDeleteBuffers(1, &slot.buffer);
+	}
+}
+
+void ChunkFeedback::collect(int tag)
+{
+	Slot& slot = m_slots[m_next];
+	if (slot.fence)
+		return;
+
+	// The shader's writes have to land before the copy reads them
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_COPY_READ_BUFFER, m_feedback);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_listBytes);
+	glClearBufferData(GL_COPY_READ_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.tag = tag;
+	m_next = (m_next + 1) % FEEDBACK_RING;
+}
+
+bool ChunkFeedback::poll(std::vector<uint32_t>& chunks, bool& complete, int& tag)
+{
+	// Fences signal in the order they were issued, so stop at the first one still pending
+	bool fresh = false;
+	for (int i = 0; i < FEEDBACK_RING; i++)
+	{
+		Slot& slot = m_slots[(m_next + i) % FEEDBACK_RING];
+		if (!slot.fence)
+			continue;
+		GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+
+		// A failed map loses this frame's feedback; the chunks are flagged again next frame
+		glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+		const uint32_t* data = (const uint32_t*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, m_listBytes, GL_MAP_READ_BIT);
+		if (data)
+		{
+			// The count goes past the capacity when chunks were left off the list
+			size_t count = data[0];
+			chunks.resize(std::min(count, m_capacity));
+			std::memcpy(chunks.data(), data + 1, chunks.size() * sizeof(uint32_t));
+			glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+			complete = count <= m_capacity;
+			tag = slot.tag;
+			fresh = true;
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	return fresh;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Staging buffers in the readback ring. Frame N's feedback is copied out while N+1
+// and N+2 render.
+#define FEEDBACK_RING 3
+
+// Asynchronous readback of the shader's chunk feedback, the same way FrameCapture
+// reads back frames. The feedback buffer holds a count and a list of up to capacity
+// chunk indices, appended by the shader for each chunk rays touched, then a seen bit
+// per world chunk that keeps each to one entry. Only the count and list are read
+// back, so the readback is sized by the capacity rather than by the world. collect()
+// copies them into the next free staging buffer on the GPU, fences the copy and
+// clears the buffer for the next frame; poll() maps a staging buffer only once its
+// fence has signalled. The cache so sees feedback a frame or two late instead of the
+// pipeline stalling on it every frame. When every staging buffer is still in flight
+// the feedback is left in place and the next frame's rays add to it. Runs entirely
+// on the thread that owns the GL context, including construction and destruction.
+class ChunkFeedback
+{
+public:
+	// Bytes of the feedback buffer the shader writes, to create it with
+	static size_t bufferBytes(size_t capacity, size_t chunkCount);
+	// GPU memory the feedback takes in all, the buffer and the staging ring
+	static size_t residentBytes(size_t capacity, size_t chunkCount);
+
+	// feedback is the shader's buffer, of bufferBytes(capacity, chunkCount)
+	ChunkFeedback(GLuint feedback, size_t capacity);
+	~ChunkFeedback();
+
+	// Call once per frame after its draws. tag comes back with the feedback, to tell
+	// which frame it belongs to.
+	void collect(int tag);
+
+	// Fills chunks with the newest list that has finished since the last call, if
+	// any. complete is cleared if rays touched more chunks than the list could hold.
+	bool poll(std::vector<uint32_t>& chunks, bool& complete, int& tag);
+
+private:
+	struct Slot
+	{
+		GLuint buffer;
+		GLsync fence; // Null while the slot is free
+		int tag;
+	};
+
+	GLuint m_feedback;
+	size_t m_capacity;
+	size_t m_listBytes; // The count and the list, what is read back
+	Slot m_slots[FEEDBACK_RING];
+	int m_next = 0; // Slots are filled and finish copying in ring order
+};
@@ -0,0 +1,163 @@
+#include "ChunkLoader.h"
+#include "AmbientOcclusion.h"
+
+ChunkLoader::ChunkLoader(const World& world, glm::ivec3 chunkDims)
+	: m_world(world), m_layout(world.layout), m_size(world.size), m_chunkDims(chunkDims)
+{
+	m_worker = std::thread(&ChunkLoader::workerLoop, this);
+}
+
+ChunkLoader::ChunkLoader(const char* path, WorldLayout layout, glm::ivec3 chunkDims)
+	: m_layout(layout), m_chunkDims(chunkDims)
+{
+	// A file that won't open loads as empty chunks, its error already printed
+	m_streamed = m_file.open(path);
+	m_size = m_streamed ? m_file.size() : glm::ivec3(0);
+	m_world.size = glm::ivec3(0);
+	m_worker = std::thread(&ChunkLoader::workerLoop, this);
+}
+
+ChunkLoader::~ChunkLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_one();
+	m_worker.join();
+}
+
+void ChunkLoader::queue(const Job& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(job);
+	}
+	m_wake.notify_one();
+}
+
+void ChunkLoader::request(uint32_t chunk)
+{
+	queue({ JOB_LOAD, chunk });
+}
+
+void ChunkLoader::refresh(uint32_t chunk)
+{
+	queue({ JOB_REFRESH, chunk });
+}
+
+void ChunkLoader::editVoxel(glm::ivec3 map, uint32_t voxel)
+{
+	queue({ JOB_EDIT, 0, map, voxel });
+}
+
+void ChunkLoader::rankPrefetch(const PrefetchView& view, size_t limit)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_rankView = view;
+		m_rankLimit = limit;
+		m_rankPending = true;
+	}
+	m_wake.notify_one();
+}
+
+bool ChunkLoader::takeRanking(std::vector<uint32_t>& ranked)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_rankedReady)
+		return false;
+	ranked.swap(m_ranked);
+	m_rankedReady = false;
+	return true;
+}
+
+bool ChunkLoader::takeLoaded(LoadedChunk& loaded)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_loaded.empty())
+		return false;
+	loaded = std::move(m_loaded.front());
+	m_loaded.pop_front();
+	return true;
+}
+
+LoadedChunk ChunkLoader::load(uint32_t chunk)
+{
+	LoadedChunk loaded = { chunk, false, std::vector<uint32_t>(CHUNK_VOXELS, 0), std::vector<uint32_t>(CHUNK_VOXELS, 0) };
+	glm::ivec3 base = glm::ivec3(chunk % m_chunkDims.x, chunk / (m_chunkDims.x * m_chunkDims.z), (chunk / m_chunkDims.x) % m_chunkDims.z) * CHUNK_SIZE;
+
+	// Voxels and AO come from source, which holds the world from origin on. A streamed
+	// box stops at the world edge like the world does, so edge faces get the same AO.
+	const World* source = &m_world;
+	glm::ivec3 origin(0);
+	if (m_streamed)
+	{
+		origin = glm::max(base - AO_REACH, glm::ivec3(0));
+		if (!m_file.read(origin, glm::min(base + CHUNK_SIZE + AO_REACH, m_size) - origin, m_box))
+			return loaded;
+		source = &m_box;
+	}
+
+	for (int y = 0; y < CHUNK_SIZE; y++)
+		for (int z = 0; z < CHUNK_SIZE; z++)
+			for (int x = 0; x < CHUNK_SIZE; x++)
+			{
+				glm::ivec3 map = base + glm::ivec3(x, y, z);
+				uint32_t offset = ChunkCache::voxelOffset(map, m_layout);
+				loaded.voxels[offset] = source->at(map - origin);
+				if (loaded.voxels[offset] != 0)
+					loaded.ao[offset] = voxelAO(*source, map - origin);
+			}
+	return loaded;
+}
+
+void ChunkLoader::workerLoop()
+{
+	std::vector<uint32_t> ranked;
+	while (true)
+	{
+		std::deque<Job> jobs;
+		PrefetchView view;
+		size_t limit = 0;
+		bool rank;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this]() { return m_quit || !m_jobs.empty() || m_rankPending; });
+			if (m_quit)
+				return;
+			jobs.swap(m_jobs);
+			rank = m_rankPending;
+			view = m_rankView;
+			limit = m_rankLimit;
+			m_rankPending = false;
+		}
+
+		// The ranking decides the next requests, so it goes before the loads
+		if (rank)
+		{
+			::rankPrefetch(m_chunkDims, view, limit, ranked);
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_ranked.swap(ranked);
+			m_rankedReady = true;
+		}
+
+		// Publish each chunk as soon as it is ready so the nearest ones don't wait on the rest
+		for (const Job& job : jobs)
+		{
+			if (job.kind == JOB_EDIT)
+			{
+				if (m_streamed)
+					m_file.editVoxel(job.map, job.voxel);
+				else if (m_world.contains(job.map))
+					m_world.voxels[m_world.index(job.map)] = job.voxel;
+				continue;
+			}
+
+			LoadedChunk loaded = load(job.chunk);
+			loaded.refresh = job.kind == JOB_REFRESH;
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_loaded.push_back(std::move(loaded));
+		}
+	}
+}
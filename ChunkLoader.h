@@ -0,0 +1,100 @@
+#pragma once
+
+#include "ChunkCache.h"
+#include "ChunkPrefetch.h"
+#include "World.h"
+#include "WorldFile.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// A chunk's voxels and their face AO (see AmbientOcclusion.h), both laid out by
+// ChunkCache::voxelOffset() for the world's layout. Voxels past the world edge are
+// empty.
+struct LoadedChunk
+{
+	uint32_t chunk;
+	bool refresh; // Asked for with refresh(), not request()
+	std::vector<uint32_t> voxels;
+	std::vector<uint32_t> ao;
+};
+
+// Fills chunk load requests off the render thread. A worker keeps its own copy of
+// the world, or reads it from a world file, applies voxel edits and serves loads
+// in the order they were queued, so a load always reflects every edit queued
+// before it. Face AO is computed as each chunk loads, so it only exists for chunks
+// that do. Finished chunks are published through takeLoaded() for the render
+// thread to upload. The worker also ranks chunks for prefetch, see rankPrefetch(),
+// so the render thread never does.
+class ChunkLoader
+{
+public:
+	ChunkLoader(const World& world, glm::ivec3 chunkDims);
+	// Streams chunks from a world file (see WorldFile.h), laid out for layout, so the
+	// world never has to fit in memory. Each load reads the chunk and the voxels
+	// within AO_REACH of it.
+	ChunkLoader(const char* path, WorldLayout layout, glm::ivec3 chunkDims);
+	~ChunkLoader();
+
+	void request(uint32_t chunk);
+	void editVoxel(glm::ivec3 map, uint32_t voxel);
+
+	// Load a resident chunk again after an edit nearby changed its AO. The result
+	// belongs in the chunk's slot if it is still resident, and is not for install().
+	void refresh(uint32_t chunk);
+
+	// Pops the next finished chunk, if any
+	bool takeLoaded(LoadedChunk& loaded);
+
+	// Rank chunks for prefetch from view, keeping the first limit. Ranked ahead of any
+	// loads still queued. A ranking still waiting to start is replaced by the newer one.
+	void rankPrefetch(const PrefetchView& view, size_t limit);
+
+	// Swaps the newest finished ranking into ranked, if there is one since the last
+	// call. Otherwise ranked is left as it is.
+	bool takeRanking(std::vector<uint32_t>& ranked);
+
+private:
+	enum JobKind
+	{
+		JOB_LOAD,
+		JOB_REFRESH,
+		JOB_EDIT
+	};
+
+	struct Job
+	{
+		JobKind kind;
+		uint32_t chunk;
+		glm::ivec3 map;
+		uint32_t voxel;
+	};
+
+	LoadedChunk load(uint32_t chunk);
+	void queue(const Job& job);
+	void workerLoop();
+
+	// Owned by the worker after construction. Streamed worlds read each load into
+	// m_box rather than keeping m_world.
+	World m_world;
+	bool m_streamed = false;
+	StreamedWorld m_file;
+	World m_box;
+	WorldLayout m_layout;
+	glm::ivec3 m_size;
+	glm::ivec3 m_chunkDims;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::deque<Job> m_jobs;
+	std::deque<LoadedChunk> m_loaded;
+	PrefetchView m_rankView;
+	size_t m_rankLimit = 0;
+	bool m_rankPending = false;
+	std::vector<uint32_t> m_ranked;
+	bool m_rankedReady = false;
+	bool m_quit = false;
+	std::thread m_worker;
+};
@@ -0,0 +1,152 @@
+#include "ChunkPrefetch.h"
+#include "ChunkCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define HALF_PI 1.57079632679f
+
+struct Candidate
+{
+	float time;
+	float dist;
+	uint32_t chunk;
+};
+
+// The view cone from one predicted camera position
+struct ViewCone
+{
+	glm::fvec3 eye;
+	glm::fvec3 dir;
+	float halfAngle;
+	float cosAngle, sinAngle;
+	float range;
+
+	// Whether a sphere reaches into the cone within range, or close enough to the eye
+	// for shadow and bounce rays. Spheres nested in one that fails fail as well.
+	bool reaches(glm::fvec3 centre, float radius, float& dist) const
+	{
+		glm::fvec3 toCentre = centre - eye;
+		dist = glm::length(toCentre);
+		if (dist <= radius + 1.0f)
+			return true;
+		if (dist - radius > range)
+			return false;
+
+		// The angle to the centre must be at most halfAngle plus the angle the sphere
+		// subtends, asin(radius / dist). Compared as cosines, which fall over [0, pi],
+		// unless the sum passes pi and every direction qualifies.
+		float sinSphere = radius / dist, cosSphere = sqrtf(1.0f - sinSphere * sinSphere);
+		return (halfAngle >= HALF_PI && sinSphere >= sinAngle) ||
+			glm::dot(toCentre, dir) >= dist * (cosAngle * cosSphere - sinAngle * sinSphere);
+	}
+};
+
+void rankPrefetch(glm::ivec3 chunkDims, const PrefetchView& view, size_t limit, std::vector<uint32_t>& ranked)
+{
+	ranked.clear();
+
+	// The frustum is approximated by the cone through its corners
+	ViewCone cone;
+	cone.dir = view.dir;
+	cone.halfAngle = atanf(tanf(view.fov * 0.5f) * sqrtf(1.0f + view.aspect * view.aspect)) + PREFETCH_TURN_MARGIN;
+	cone.cosAngle = cosf(cone.halfAngle);
+	cone.sinAngle = sinf(cone.halfAngle);
+	cone.range = view.range;
+	float radius = CHUNK_SIZE * 0.8660254f; // Half the chunk diagonal
+	float blockRadius = radius * PREFETCH_BLOCK;
+
+	// A camera standing still sees the same chunks at every step
+	int steps = view.velocity == glm::fvec3(0) ? 0 : int(PREFETCH_HORIZON / PREFETCH_STEP);
+
+	// Only chunks within reach of some predicted position can qualify. Which of them
+	// have been placed is kept over that box, never the whole world.
+	glm::fvec3 end = view.pos + view.velocity * (steps * PREFETCH_STEP);
+	float reach = view.range + radius;
+	glm::ivec3 lo = glm::max(glm::ivec3(glm::floor((glm::min(view.pos, end) - reach) / float(CHUNK_SIZE))), glm::ivec3(0));
+	glm::ivec3 hi = glm::min(glm::ivec3(glm::floor((glm::max(view.pos, end) + reach) / float(CHUNK_SIZE))), chunkDims - 1);
+	if (glm::any(glm::lessThan(hi, lo)))
+		return;
+	glm::ivec3 box = hi - lo + 1;
+	std::vector<uint8_t> found(size_t(box.x) * box.y * box.z, 0);
+
+	std::vector<Candidate> candidates;
+	std::vector<float> distances;
+	for (int step = 0; step <= steps && candidates.size() < limit; step++)
+	{
+		float t = step * PREFETCH_STEP;
+		cone.eye = view.pos + view.velocity * t;
+		size_t stepFirst = candidates.size();
+
+		// Visit a chunk, placing it at this step if the cone reaches it
+		auto visit = [&](int x, int y, int z)
+		{
+			float dist;
+			uint8_t& placed = found[(size_t(y - lo.y) * box.z + (z - lo.z)) * box.x + (x - lo.x)];
+			if (placed || !cone.reaches((glm::fvec3(x, y, z) + 0.5f) * float(CHUNK_SIZE), radius, dist))
+				return;
+			placed = 1;
+			Candidate candidate = { t, dist, uint32_t((y * chunkDims.z + z) * chunkDims.x + x) };
+			candidates.push_back(candidate);
+		};
+
+		// Visit a block of chunks, unless the cone misses all of it
+		auto visitBlock = [&](glm::ivec3 block)
+		{
+			float dist;
+			glm::fvec3 centre = (glm::fvec3(block) + 0.5f) * float(PREFETCH_BLOCK * CHUNK_SIZE);
+			if (!cone.reaches(centre, blockRadius, dist))
+				return;
+			glm::ivec3 first = glm::max(block * PREFETCH_BLOCK, lo);
+			glm::ivec3 last = glm::min(block * PREFETCH_BLOCK + PREFETCH_BLOCK - 1, hi);
+			for (int y = first.y; y <= last.y; y++)
+				for (int z = first.z; z <= last.z; z++)
+					for (int x = first.x; x <= last.x; x++)
+						visit(x, y, z);
+		};
+
+		// March the cone outwards from the eye a shell of blocks at a time. Every chunk of
+		// later shells is at least a shell's width per shell away, so once enough chunks
+		// are nearer than that, the rest would never make the cut.
+		glm::ivec3 blockLo = lo / PREFETCH_BLOCK, blockHi = hi / PREFETCH_BLOCK;
+		glm::ivec3 eyeBlock = glm::ivec3(glm::floor(cone.eye / float(PREFETCH_BLOCK * CHUNK_SIZE)));
+		int shells = int(reach / (PREFETCH_BLOCK * CHUNK_SIZE)) + 2;
+		for (int shell = 0; shell <= shells; shell++)
+		{
+			glm::ivec3 shellLo = glm::max(eyeBlock - shell, blockLo), shellHi = glm::min(eyeBlock + shell, blockHi);
+			for (int by = shellLo.y; by <= shellHi.y; by++)
+				for (int bz = shellLo.z; bz <= shellHi.z; bz++)
+				{
+					// Rows inside the shell only touch it at their two ends
+					bool inside = abs(by - eyeBlock.y) < shell && abs(bz - eyeBlock.z) < shell;
+					for (int bx = shellLo.x; bx <= shellHi.x; bx = inside && bx < eyeBlock.x + shell ? eyeBlock.x + shell : bx + 1)
+					{
+						if (inside && bx != eyeBlock.x - shell && bx != eyeBlock.x + shell)
+							continue;
+						visitBlock({ bx, by, bz });
+					}
+				}
+
+			size_t need = limit - stepFirst;
+			if (candidates.size() - stepFirst < need)
+				continue;
+			distances.clear();
+			for (size_t i = stepFirst; i < candidates.size(); i++)
+				distances.push_back(candidates[i].dist);
+			std::nth_element(distances.begin(), distances.begin() + (need - 1), distances.end());
+			if (distances[need - 1] <= float(shell * PREFETCH_BLOCK * CHUNK_SIZE))
+				break;
+		}
+	}
+
+	// Only the first limit are wanted, so only they are put in order
+	auto kept = candidates.begin() + std::min(limit, candidates.size());
+	std::partial_sort(candidates.begin(), kept, candidates.end(), [](const Candidate& a, const Candidate& b)
+	{
+		return a.time != b.time ? a.time < b.time : a.dist < b.dist;
+	});
+
+	ranked.reserve(kept - candidates.begin());
+	for (auto candidate = candidates.begin(); candidate != kept; ++candidate)
+		ranked.push_back(candidate->chunk);
+}
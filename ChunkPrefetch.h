@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// How far ahead the camera path is predicted, and how finely, in seconds
+#define PREFETCH_HORIZON 1.0f
+#define PREFETCH_STEP 0.05f
+// Extra view cone half-angle in radians, so turning the camera doesn't outrun the prefetch
+#define PREFETCH_TURN_MARGIN 0.35f
+// Side of the blocks of chunks the view cone is tested against before their chunks are
+#define PREFETCH_BLOCK 4
+
+struct PrefetchView
+{
+	glm::fvec3 pos;
+	glm::fvec3 velocity; // Voxels per second
+	glm::fvec3 dir;      // Unit view direction
+	float fov;           // Vertical, in radians
+	float aspect;        // Width over height
+	float range;         // Farthest rays read full resolution voxels from
+};
+
+// Ranks chunks by predicted time-to-visibility. The camera is extrapolated along its
+// velocity over PREFETCH_HORIZON, and a chunk becomes visible at the first step where
+// its bounding sphere enters the view cone within range, or comes close
+// enough to the camera to be reached by shadow and bounce rays. Chunks that never do
+// are left out. Ties go to the nearer chunk, so the fill order also runs front to back.
+// Only chunks near the cone at some step are looked at, and only the first limit are
+// returned, as the cache has no room for more.
+void rankPrefetch(glm::ivec3 chunkDims, const PrefetchView& view, size_t limit, std::vector<uint32_t>& ranked);
@@ -0,0 +1,125 @@
+#include "Collision.h"
+
+#include <cfloat>
+#include <cmath>
+
+// Any solid voxel in the inclusive range [lo, hi]. Voxels outside the map read as empty.
+static bool solidIn(const World& world, glm::ivec3 lo, glm::ivec3 hi)
+{
+	for (int y = lo.y; y <= hi.y; y++)
+		for (int z = lo.z; z <= hi.z; z++)
+			for (int x = lo.x; x <= hi.x; x++)
+				if (world.at({ x, y, z }) != 0)
+					return true;
+	return false;
+}
+
+SweepHit sweepBox(const World& world, const AABB& box, glm::fvec3 motion)
+{
+	SweepHit result = { false, 1.0f, -1, 0.0f };
+
+	// Per axis: the voxel layer the leading face enters next, the fraction of the
+	// motion at which it does so, and the fraction between successive layers
+	glm::ivec3 layer, stepAmount;
+	glm::fvec3 tDelta, tNext;
+	for (int i = 0; i < 3; i++)
+	{
+		if (motion[i] > 0)
+		{
+			stepAmount[i] = 1;
+			layer[i] = static_cast<int>(std::ceil(box.max[i]));
+			tDelta[i] = 1.0f / motion[i];
+			tNext[i] = (layer[i] - box.max[i]) * tDelta[i];
+		}
+		else if (motion[i] < 0)
+		{
+			stepAmount[i] = -1;
+			layer[i] = static_cast<int>(std::floor(box.min[i])) - 1;
+			tDelta[i] = -1.0f / motion[i];
+			tNext[i] = (box.min[i] - (layer[i] + 1)) * tDelta[i];
+		}
+		else
+		{
+			stepAmount[i] = 0;
+			layer[i] = 0;
+			tDelta[i] = FLT_MAX;
+			tNext[i] = FLT_MAX;
+		}
+	}
+
+	while (true)
+	{
+		int axis;
+		if (tNext.x < tNext.y)
+			axis = tNext.x < tNext.z ? 0 : 2;
+		else
+			axis = tNext.y < tNext.z ? 1 : 2;
+
+		float t = tNext[axis];
+		if (t > 1.0f)
+			return result;
+
+		// Footprint of the box on the other two axes at the moment it reaches the layer
+		glm::fvec3 offset = motion * t;
+		glm::ivec3 lo, hi;
+		for (int i = 0; i < 3; i++)
+		{
+			lo[i] = static_cast<int>(std::floor(box.min[i] + offset[i]));
+			hi[i] = static_cast<int>(std::ceil(box.max[i] + offset[i])) - 1;
+		}
+		lo[axis] = hi[axis] = layer[axis];
+
+		if (solidIn(world, lo, hi))
+		{
+			result.hit = true;
+			result.t = t;
+			result.axis = axis;
+			result.boundary = static_cast<float>(stepAmount[axis] > 0 ? layer[axis] : layer[axis] + 1);
+			return result;
+		}
+
+		layer[axis] += stepAmount[axis];
+		tNext[axis] += tDelta[axis];
+
+		// Past the edge of the map there is nothing left to hit along this axis
+		if ((stepAmount[axis] > 0 && layer[axis] >= world.size[axis]) || (stepAmount[axis] < 0 && layer[axis] < 0))
+			tNext[axis] = FLT_MAX;
+	}
+}
+
+glm::fvec3 moveAndSlide(const World& world, glm::fvec3 position, glm::fvec3 halfExtents, glm::fvec3 motion, glm::bvec3* blocked)
+{
+	if (blocked)
+		*blocked = glm::bvec3(false);
+
+	for (int i = 0; i < COLLISION_MAX_SLIDES && motion != glm::fvec3(0); i++)
+	{
+		AABB box = { position - halfExtents, position + halfExtents };
+		SweepHit hit = sweepBox(world, box, motion);
+		position += motion * hit.t;
+		if (!hit.hit)
+			break;
+
+		// Rest just short of the face, then spend what is left of the motion sliding along it
+		int axis = hit.axis;
+		if (motion[axis] > 0)
+			position[axis] = hit.boundary - halfExtents[axis] - COLLISION_EPSILON;
+		else
+			position[axis] = hit.boundary + halfExtents[axis] + COLLISION_EPSILON;
+
+		motion *= 1.0f - hit.t;
+		motion[axis] = 0;
+		if (blocked)
+			(*blocked)[axis] = true;
+	}
+
+	return position;
+}
+
+bool overlapsVoxel(const AABB& box, glm::ivec3 map)
+{
+	glm::fvec3 lo(map), hi = lo + 1.0f;
+	return box.min.x < hi.x && box.max.x > lo.x &&
+		box.min.y < hi.y && box.max.y > lo.y &&
+		box.min.z < hi.z && box.max.z > lo.z;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "World.h"
+
+// Gap kept between a resting box and the voxel it touches, so the next sweep
+// starts strictly outside the solid layer
+#define COLLISION_EPSILON 1e-3f
+
+// Number of slide iterations per move. Each one removes an axis, so three is enough.
+#define COLLISION_MAX_SLIDES 3
+
+struct AABB
+{
+	glm::fvec3 min;
+	glm::fvec3 max;
+};
+
+struct SweepHit
+{
+	bool hit;
+	float t;        // Fraction of the motion travelled before contact, in [0, 1]
+	int axis;       // World axis of the blocking face (0 = x, 1 = y, 2 = z)
+	float boundary; // Coordinate of the blocking face on that axis
+};
+
+// Sweeps box along motion through the voxel grid and returns the first contact.
+// Walks the box's leading corner with the same DDA as castRay(), testing the slab
+// of voxels the leading face enters at each boundary crossing. Allocation free,
+// so it is cheap enough to call for every entity every tick.
+SweepHit sweepBox(const World& world, const AABB& box, glm::fvec3 motion);
+
+// Moves a box centred on position by motion, sliding along any faces it hits.
+// Returns the new centre. blocked, if given, receives the axes that were stopped.
+glm::fvec3 moveAndSlide(const World& world, glm::fvec3 position, glm::fvec3 halfExtents, glm::fvec3 motion, glm::bvec3* blocked = nullptr);
+
+// True if the box overlaps voxel map, used to stop voxels being placed inside the player
+bool overlapsVoxel(const AABB& box, glm::ivec3 map);
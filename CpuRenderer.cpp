@@ -0,0 +1,158 @@
+#include "CpuRenderer.h"
+#include "Parallel.h"
+#include "Traversal.h"
+
+#include <cmath>
+
+#define TWO_PI 6.28318530718f
+
+uint32_t pcgHash(uint32_t v)
+{
+	uint32_t state = v * 747796405u + 2891336453u;
+	uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+float random01(uint32_t& seed)
+{
+	seed = pcgHash(seed);
+	return float(seed >> 8) / 16777216.0f;
+}
+
+// Cosine-weighted direction around an axis-aligned normal
+static glm::fvec3 sampleCosine(glm::fvec3 n, uint32_t& seed)
+{
+	float u = random01(seed);
+	float v = random01(seed);
+	float r = std::sqrt(u);
+	float phi = TWO_PI * v;
+
+	glm::fvec3 t = std::abs(n.x) > 0.5f ? glm::fvec3(0, 1, 0) : glm::fvec3(1, 0, 0);
+	t = glm::normalize(glm::cross(n, t));
+	glm::fvec3 b = glm::cross(n, t);
+	return t * (r * std::cos(phi)) + b * (r * std::sin(phi)) + n * std::sqrt(1 - u);
+}
+
+static glm::fvec3 lightContribution(const Scene& scene, const Light& l, glm::fvec3 shadowOrigin, glm::fvec3 normal)
+{
+	glm::fvec3 toLight = l.position - shadowOrigin;
+	float lightDist = glm::length(toLight);
+	if (lightDist >= l.radius)
+		return glm::fvec3(0);
+
+	glm::fvec3 lightDir = toLight / lightDist;
+	float nDotL = glm::dot(normal, lightDir);
+	if (nDotL <= 0 || occluded(*scene.world, shadowOrigin, lightDir, lightDist))
+		return glm::fvec3(0);
+
+	float falloff = 1.0f - lightDist / l.radius;
+	return l.colour * (l.intensity * nDotL * falloff * falloff);
+}
+
+// Direct light from one light picked at random from the hit point's culling
+// cell, scaled by the number of candidates so the estimate stays unbiased
+static glm::fvec3 sampleLight(const Scene& scene, glm::fvec3 point, glm::fvec3 normal, uint32_t& seed)
+{
+	glm::fvec3 shadowOrigin = point + normal * SHADOW_BIAS;
+
+	uint32_t count;
+	const uint32_t* indices = cellLights(*scene.lightGrid, shadowOrigin, count);
+	if (count == 0)
+		return glm::fvec3(0);
+
+	uint32_t i = std::min(uint32_t(random01(seed) * count), count - 1);
+	return lightContribution(scene, (*scene.lights)[indices[i]], shadowOrigin, normal) * float(count);
+}
+
+glm::fvec3 pathTraceRay(const Scene& scene, glm::fvec3 origin, glm::fvec3 dir, uint32_t& seed, glm::fvec4& firstHit)
+{
+	firstHit = glm::fvec4(0);
+	glm::fvec3 radiance(0);
+	glm::fvec3 throughput(1);
+
+	for (int bounce = 0; bounce < PT_MAX_BOUNCES; bounce++)
+	{
+		RayHit hit = castRay(*scene.world, origin, dir);
+		if (!hit.hit)
+			break;
+
+		glm::fvec3 normal = glm::fvec3(hit.normal);
+		if (bounce == 0)
+			firstHit = glm::fvec4(float(hit.side * 2 + (normal.x + normal.y + normal.z > 0 ? 1 : 0)), hit.dist, float(hit.voxel), 1);
+
+		const Material& material = materialOf(*scene.materials, hit.voxel);
+		glm::fvec3 albedo = material.albedo;
+		glm::fvec3 point = origin + hit.dist * dir;
+
+		radiance += throughput * material.emissive + throughput * albedo * sampleLight(scene, point, normal, seed);
+
+		// Lambertian bounce: the cosine-weighted pdf cancels everything but albedo.
+		// Smoother materials pull the bounce towards the mirror direction.
+		throughput *= albedo;
+		origin = point + normal * SHADOW_BIAS;
+		glm::fvec3 diffuseDir = sampleCosine(normal, seed);
+		dir = material.roughness < 1.0f ? glm::normalize(glm::mix(glm::reflect(dir, normal), diffuseDir, material.roughness)) : diffuseDir;
+	}
+
+	return radiance;
+}
+
+// Path sample for pixel (x, y) of a full frame, seeded by its position so any
+// split of the frame into tiles gives the same result
+static glm::fvec3 pixelSample(const Scene& scene, const Camera& camera, glm::ivec2 size, int x, int y, uint32_t sampleIndex, glm::fvec4& firstHit)
+{
+	uint32_t pixel = y * size.x + x;
+	uint32_t seed = pcgHash(pixel ^ pcgHash(sampleIndex));
+	glm::fvec2 jitter = glm::fvec2(random01(seed), random01(seed)) - 0.5f;
+	glm::fvec3 dir = cameraRay(camera, size, glm::fvec2(x + 0.5f, y + 0.5f) + jitter);
+	return pathTraceRay(scene, camera.pos, dir, seed, firstHit);
+}
+
+void accumulatePathSamples(const Scene& scene, const Camera& camera, glm::ivec2 size, uint32_t sampleIndex,
+	std::vector<glm::fvec3>& accum, std::vector<glm::fvec4>* guide)
+{
+	accum.resize(size.x * size.y);
+	if (guide)
+		guide->resize(size.x * size.y);
+
+	parallelFor(0, size.y, [&](int y)
+	{
+		for (int x = 0; x < size.x; x++)
+		{
+			uint32_t pixel = y * size.x + x;
+			glm::fvec4 firstHit;
+			glm::fvec3 sample = pixelSample(scene, camera, size, x, y, sampleIndex, firstHit);
+			accum[pixel] = sampleIndex == 0 ? sample : accum[pixel] + sample;
+			if (guide)
+				(*guide)[pixel] = firstHit;
+		}
+	});
+}
+
+void accumulateTileSamples(const Scene& scene, const Camera& camera, glm::ivec2 size, glm::ivec4 tile, uint32_t sampleIndex,
+	std::vector<glm::fvec3>& accum)
+{
+	accum.resize(tile.z * tile.w);
+
+	parallelFor(0, tile.w, [&](int row)
+	{
+		for (int column = 0; column < tile.z; column++)
+		{
+			uint32_t pixel = row * tile.z + column;
+			glm::fvec4 firstHit;
+			glm::fvec3 sample = pixelSample(scene, camera, size, tile.x + column, tile.y + row, sampleIndex, firstHit);
+			accum[pixel] = sampleIndex == 0 ? sample : accum[pixel] + sample;
+		}
+	});
+}
+
+void sumPathRow(const Scene& scene, const Camera& camera, glm::ivec2 size, int y, uint32_t samples, glm::fvec3* sums)
+{
+	for (int x = 0; x < size.x; x++)
+	{
+		glm::fvec4 firstHit;
+		sums[x] = glm::fvec3(0);
+		for (uint32_t i = 0; i < samples; i++)
+			sums[x] += pixelSample(scene, camera, size, x, y, i, firstHit);
+	}
+}
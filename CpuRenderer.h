@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Camera.h"
+#include "Lights.h"
+#include "Materials.h"
+#include "World.h"
+
+// Must match shader.frag
+#define PT_MAX_BOUNCES 4
+#define SHADOW_BIAS 1e-3f
+
+// CPU mirror of the buffers shader.frag reads, for headless and offline rendering
+struct Scene
+{
+	const World* world;
+	const std::vector<Light>* lights;
+	const LightGrid* lightGrid;
+	const MaterialTable* materials;
+};
+
+// Random numbers drawn in the same order as shader.frag
+uint32_t pcgHash(uint32_t v);
+float random01(uint32_t& seed);
+
+// One stochastic multi-bounce path sample, as path_trace_ray() in shader.frag.
+// firstHit receives the denoiser guide (face, distance, voxel, 1), or 0 on a miss.
+glm::fvec3 pathTraceRay(const Scene& scene, glm::fvec3 origin, glm::fvec3 dir, uint32_t& seed, glm::fvec4& firstHit);
+
+// Adds one path sample per pixel into accum, which holds running sums with the
+// bottom row first like gl_FragCoord. sampleIndex 0 resets the sums. If guide is
+// given it receives this sample's primary hits for the denoiser.
+void accumulatePathSamples(const Scene& scene, const Camera& camera, glm::ivec2 size, uint32_t sampleIndex,
+	std::vector<glm::fvec3>& accum, std::vector<glm::fvec4>* guide = nullptr);
+
+// accumulatePathSamples() for one tile (x, y, width, height) of a size image, with
+// accum holding just the tile. Pixels match a full frame render exactly.
+void accumulateTileSamples(const Scene& scene, const Camera& camera, glm::ivec2 size, glm::ivec4 tile, uint32_t sampleIndex,
+	std::vector<glm::fvec3>& accum);
+
+// Sums path samples 0 .. samples - 1 for row y of a size image into sums (size.x
+// pixels) on the calling thread, matching what accumulatePathSamples() would have
+// summed. For callers that schedule rows of several images in one parallel pass.
+void sumPathRow(const Scene& scene, const Camera& camera, glm::ivec2 size, int y, uint32_t samples, glm::fvec3* sums);
@@ -0,0 +1,139 @@
+#include "Denoise.h"
+#include "Parallel.h"
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+static const float kernel[3] = { 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+// e^x for x <= 0, to within a couple of ulps: Cephes' expf polynomial, with the
+// power of two put straight into the exponent bits. Results below e^-87 are not
+// denormal but are small enough to count as no weight at all.
+static __m128 expNegative(__m128 x)
+{
+	x = _mm_max_ps(x, _mm_set1_ps(-87.0f));
+
+	// x = n ln 2 + r with |r| <= ln 2 / 2, ln 2 split in two so r stays exact
+	__m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f));
+	__m128 n = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+	n = _mm_sub_ps(n, _mm_and_ps(_mm_cmpgt_ps(n, fx), _mm_set1_ps(1.0f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(0.693359375f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(-2.12194440e-4f)));
+
+	__m128 y = _mm_set1_ps(1.9875691500e-4f);
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+	y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(x, x)), x), _mm_set1_ps(1.0f));
+
+	__m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23);
+	return _mm_mul_ps(y, _mm_castsi128_ps(exponent));
+}
+
+static __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Four pixels at a time, channels transposed so each register holds one channel of
+// all four and the weights, exp included, are computed side by side
+void denoiseRow(const std::vector<glm::fvec4>& in, std::vector<glm::fvec4>& out,
+	const std::vector<glm::fvec4>& guide, glm::ivec2 size, int y, int stepWidth, float sigmaColour)
+{
+	static_assert(sizeof(glm::fvec4) == sizeof(__m128), "fvec4 must pack into one SSE register");
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+
+	for (int x = 0; x < size.x; x += 4)
+	{
+		// Lanes past the end of the row repeat the last pixel and are never stored
+		int lanes = std::min(4, size.x - x);
+		__m128 c[4], g[4];
+		for (int i = 0; i < 4; i++)
+		{
+			int p = y * size.x + x + std::min(i, lanes - 1);
+			c[i] = _mm_loadu_ps(&in[p].x);
+			g[i] = _mm_loadu_ps(&guide[p].x);
+		}
+		_MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+		_MM_TRANSPOSE4_PS(g[0], g[1], g[2], g[3]);
+
+		__m128 hit = _mm_cmpneq_ps(g[3], zero);
+		__m128 depthScale = _mm_div_ps(_mm_set1_ps(-1.0f), _mm_mul_ps(_mm_set1_ps(DENOISE_SIGMA_DEPTH * stepWidth), g[1]));
+		__m128 colourScale = _mm_set1_ps(-1.0f / sigmaColour);
+
+		__m128 sum[4] = { zero, zero, zero, zero };
+		__m128 weights = zero;
+		for (int dy = -2; dy <= 2; dy++)
+		{
+			int qy = y + dy * stepWidth;
+			if (qy < 0 || qy >= size.y)
+				continue;
+
+			for (int dx = -2; dx <= 2; dx++)
+			{
+				// Taps off the row are clamped for the load and masked out of the sum
+				__m128 cq[4], gq[4];
+				int inside[4];
+				for (int i = 0; i < 4; i++)
+				{
+					int qx = x + i + dx * stepWidth;
+					inside[i] = qx >= 0 && qx < size.x ? -1 : 0;
+					int q = qy * size.x + std::min(std::max(qx, 0), size.x - 1);
+					cq[i] = _mm_loadu_ps(&in[q].x);
+					gq[i] = _mm_loadu_ps(&guide[q].x);
+				}
+				_MM_TRANSPOSE4_PS(cq[0], cq[1], cq[2], cq[3]);
+				_MM_TRANSPOSE4_PS(gq[0], gq[1], gq[2], gq[3]);
+
+				__m128 mask = _mm_and_ps(_mm_castsi128_ps(_mm_setr_epi32(inside[0], inside[1], inside[2], inside[3])), hit);
+				mask = _mm_and_ps(mask, _mm_cmpneq_ps(gq[3], zero));
+				mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpeq_ps(gq[0], g[0]), _mm_cmpeq_ps(gq[2], g[2])));
+				if (_mm_movemask_ps(mask) == 0)
+					continue;
+
+				__m128 dr = _mm_sub_ps(cq[0], c[0]);
+				__m128 dg = _mm_sub_ps(cq[1], c[1]);
+				__m128 db = _mm_sub_ps(cq[2], c[2]);
+				__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+				__m128 depth = _mm_andnot_ps(signBit, _mm_sub_ps(gq[1], g[1]));
+
+				// Both edge-stopping terms in one exp
+				__m128 w = expNegative(_mm_add_ps(_mm_mul_ps(depth, depthScale), _mm_mul_ps(dist, colourScale)));
+				w = _mm_and_ps(mask, _mm_mul_ps(w, _mm_set1_ps(kernel[std::abs(dx)] * kernel[std::abs(dy)])));
+
+				for (int k = 0; k < 4; k++)
+					sum[k] = _mm_add_ps(sum[k], _mm_mul_ps(cq[k], w));
+				weights = _mm_add_ps(weights, w);
+			}
+		}
+
+		// Pixels without a hit pass through; the rest are normalised with alpha 1
+		__m128 norm = _mm_div_ps(_mm_set1_ps(1.0f), weights);
+		__m128 result[4];
+		for (int k = 0; k < 3; k++)
+			result[k] = select(hit, _mm_mul_ps(sum[k], norm), c[k]);
+		result[3] = select(hit, _mm_set1_ps(1.0f), c[3]);
+		_MM_TRANSPOSE4_PS(result[0], result[1], result[2], result[3]);
+		for (int i = 0; i < lanes; i++)
+			_mm_storeu_ps(&out[y * size.x + x + i].x, result[i]);
+	}
+}
+
+void denoise(std::vector<glm::fvec4>& colour, const std::vector<glm::fvec4>& guide, glm::ivec2 size)
+{
+	std::vector<glm::fvec4> scratch(colour.size());
+	for (int pass = 0; pass < DENOISE_PASSES; pass++)
+	{
+		parallelFor(0, size.y, [&](int y)
+		{
+			denoiseRow(colour, scratch, guide, size, y, 1 << pass, denoiseSigmaColour(pass));
+		});
+		colour.swap(scratch);
+	}
+}
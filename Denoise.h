@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Must match denoise.frag
+#define DENOISE_PASSES 5
+#define DENOISE_SIGMA_COLOUR 0.5f
+#define DENOISE_SIGMA_DEPTH 0.05f
+
+// Edge-avoiding a-trous wavelet filter over an image, guided by the primary hit
+// (face, distance, voxel, hit) that the path tracer writes alongside each pixel.
+// Runs DENOISE_PASSES passes with step widths 1, 2, 4, ... and halves the colour
+// sigma each pass. Rows are filtered in parallel, four pixels at a time with SSE2,
+// weights included.
+void denoise(std::vector<glm::fvec4>& colour, const std::vector<glm::fvec4>& guide, glm::ivec2 size);
+
+// One pass over row y of in, written to the same row of out. denoise() runs it for
+// every row and pass; exposed so the kernel can be timed on one thread.
+void denoiseRow(const std::vector<glm::fvec4>& in, std::vector<glm::fvec4>& out,
+	const std::vector<glm::fvec4>& guide, glm::ivec2 size, int y, int stepWidth, float sigmaColour);
+
+// Colour sigma used by pass i, shared with the GL path
+inline float denoiseSigmaColour(int pass)
+{
+	return DENOISE_SIGMA_COLOUR / float(1 << pass);
+}
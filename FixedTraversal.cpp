@@ -0,0 +1,110 @@
+#include "FixedTraversal.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+// frac * tDelta in 16.16, saturating at FIXED_INFINITY
+static uint32_t scaleFixed(uint32_t frac, uint32_t tDelta)
+{
+	uint64_t t = (uint64_t(frac) * tDelta) >> FIXED_SHIFT;
+	return t > FIXED_INFINITY ? FIXED_INFINITY : uint32_t(t);
+}
+
+static uint32_t addFixed(uint32_t a, uint32_t b)
+{
+	return a > FIXED_INFINITY - b ? FIXED_INFINITY : a + b;
+}
+
+FixedHit castRayFixed(const World& world, glm::ivec3 origin, glm::ivec3 dir, uint32_t maxDist)
+{
+	FixedHit result = {};
+
+	glm::ivec3 map = origin >> FIXED_SHIFT;
+	glm::ivec3 stepAmount;
+	glm::uvec3 tDelta, tMax;
+	for (int i = 0; i < 3; i++)
+	{
+		// A ray outside the map that doesn't head towards it never gets there
+		if ((map[i] < 0 && dir[i] <= 0) || (map[i] >= world.size[i] && dir[i] >= 0))
+			return result;
+
+		// Axes the ray never crosses step forwards, but sit at FIXED_INFINITY so they never win
+		uint32_t speed = uint32_t(std::abs(dir[i]));
+		uint32_t frac = uint32_t(origin[i] & (FIXED_ONE - 1));
+		stepAmount[i] = dir[i] < 0 ? -1 : 1;
+		tDelta[i] = speed ? FIXED_INFINITY / speed : FIXED_INFINITY;
+		tMax[i] = speed ? scaleFixed(dir[i] < 0 ? frac : FIXED_ONE - frac, tDelta[i]) : FIXED_INFINITY;
+	}
+	bool entering = !world.contains(map);
+
+	while (true)
+	{
+		int axis;
+		if (tMax.x < tMax.y)
+			axis = tMax.x < tMax.z ? 0 : 2;
+		else
+			axis = tMax.y < tMax.z ? 1 : 2;
+
+		uint32_t t = tMax[axis];
+		if (t >= maxDist)
+			return result;
+
+		map[axis] += stepAmount[axis];
+		tMax[axis] = addFixed(t, tDelta[axis]);
+
+		// Outside the map on this axis either means leaving it, or still approaching
+		if (uint32_t(map[axis]) >= uint32_t(world.size[axis]))
+		{
+			if ((map[axis] < 0) == (stepAmount[axis] < 0))
+				return result;
+			continue;
+		}
+		if (entering)
+		{
+			if (!world.contains(map))
+				continue;
+			entering = false;
+		}
+
+		uint32_t voxel = world.voxels[world.index(map)];
+		if (voxel != 0)
+		{
+			result.hit = true;
+			result.map = map;
+			result.normal = glm::ivec3(0);
+			result.normal[axis] = -stepAmount[axis];
+			result.dist = t;
+			result.voxel = voxel;
+			return result;
+		}
+	}
+}
+
+glm::ivec3 toFixed(glm::fvec3 v)
+{
+	return glm::ivec3(glm::floor(v * float(FIXED_ONE)));
+}
+
+uint32_t toFixedDistance(float dist)
+{
+	float scaled = dist * float(FIXED_ONE);
+	return scaled >= 4294967296.0f ? FIXED_INFINITY : uint32_t(std::max(scaled, 0.0f));
+}
+
+RayHit castRayFixed(const World& world, glm::fvec3 origin, glm::fvec3 dir, float maxDist)
+{
+	FixedHit fixed = castRayFixed(world, toFixed(origin), toFixed(dir), toFixedDistance(maxDist));
+
+	RayHit result = {};
+	if (!fixed.hit)
+		return result;
+
+	result.hit = true;
+	result.map = fixed.map;
+	result.normal = fixed.normal;
+	result.side = fixed.normal.x != 0 ? 0 : (fixed.normal.z != 0 ? 1 : 2);
+	result.dist = float(fixed.dist) / FIXED_ONE;
+	result.position = origin + dir * result.dist;
+	result.voxel = fixed.voxel;
+	return result;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Traversal.h"
+
+// Fixed-point positions and directions: 16.16 signed voxels
+#define FIXED_SHIFT 16
+#define FIXED_ONE (1 << FIXED_SHIFT)
+// Distances along the ray are unsigned 16.16 multiples of dir. This one means never.
+#define FIXED_INFINITY 0xFFFFFFFFu
+
+// Closest hit of a fixed-point traversal. dist is the 16.16 distance along dir to the
+// hit face.
+struct FixedHit
+{
+	bool hit;
+	glm::ivec3 map;
+	glm::ivec3 normal;
+	uint32_t dist;
+	uint32_t voxel;
+};
+
+// Voxel traversal in integer arithmetic only, for lockstep simulation and replays
+// where every machine has to agree on what a ray hits. The float DDA rounds
+// differently across compilers, CPUs and GPUs (contracted multiply-adds, reciprocal
+// precision). This one gives bit-identical results anywhere, and trace_fixed() in
+// shader.frag is the same algorithm line for line.
+//
+// The steps are those of castRay(), with ties broken the same way, but the crossing
+// distances are 16.16 integers with tDelta = FIXED_INFINITY / |dir|. Hits can
+// therefore differ from castRay() where a ray passes within about 2^-16 of a voxel
+// edge. Components of dir must lie in [-FIXED_ONE, FIXED_ONE], which every unit
+// vector does. As with castRay(), the voxel containing origin is skipped. Rays from
+// outside the map walk through empty space until they enter it, so keep them close.
+FixedHit castRayFixed(const World& world, glm::ivec3 origin, glm::ivec3 dir, uint32_t maxDist = FIXED_INFINITY);
+
+// Rounds down to 16.16, clamping distances to FIXED_INFINITY. Scaling by a power of two
+// is exact, so these give the same result on every IEEE platform.
+glm::ivec3 toFixed(glm::fvec3 v);
+uint32_t toFixedDistance(float dist);
+
+// castRayFixed() from float inputs, quantized with toFixed(). Only the map, normal and
+// voxel of the result are exact; dist and position are converted back to float.
+RayHit castRayFixed(const World& world, glm::fvec3 origin, glm::fvec3 dir, float maxDist = FLT_MAX);
@@ -0,0 +1,151 @@
+#include "FrameCapture.h"
+
+FrameCapture::FrameCapture(glm::ivec2 size, CaptureConsumer consumer)
+	: m_size(size), m_consumer(consumer)
+{
+	for (Slot& slot : m_slots)
+	{
+		glGenBuffers(1, &slot.buffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size.x * size.y * 4, nullptr, GL_STREAM_READ);
+		slot.fence = nullptr;
+		slot.state = SLOT_FREE;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	for (std::thread& thread : m_consumers)
+		thread = std::thread(&FrameCapture::consumerLoop, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+	// Finish what is still on the GPU, then let the consumers drain the queue
+	for (int i = 0; i < CAPTURE_RING; i++)
+	{
+		int slot = (m_next + i) % CAPTURE_RING;
+		if (m_slots[slot].state == SLOT_READING)
+			deliver(slot, GL_TIMEOUT_IGNORED);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (std::thread& thread : m_consumers)
+		thread.join();
+
+	for (Slot& slot : m_slots)
+	{
+		if (slot.state == SLOT_CONSUMING)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glDeleteBuffers(1, &slot.buffer);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool FrameCapture::capture(int tag, GLenum format, uint32_t repeat)
+{
+	// Recycle anything the consumers have finished with before deciding to drop
+	poll();
+
+	Slot& slot = m_slots[m_next];
+	if (slot.state != SLOT_FREE)
+	{
+		m_dropped++;
+		return false;
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadBuffer(GL_BACK);
+	glReadPixels(0, 0, m_size.x, m_size.y, format, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.state = SLOT_READING;
+	slot.index = m_captured[tag]++;
+	slot.tag = tag;
+	slot.repeat = repeat;
+	slot.channels = format == GL_RGBA ? 4 : 3;
+	m_next = (m_next + 1) % CAPTURE_RING;
+	return true;
+}
+
+void FrameCapture::poll()
+{
+	std::vector<int> consumed;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		consumed.swap(m_consumed);
+	}
+	for (int slot : consumed)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, m_slots[slot].buffer);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		m_slots[slot].state = SLOT_FREE;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	// Fences signal in the order they were issued, so stop at the first one still pending
+	for (int i = 0; i < CAPTURE_RING; i++)
+	{
+		int slot = (m_next + i) % CAPTURE_RING;
+		if (m_slots[slot].state != SLOT_READING)
+			continue;
+		GLenum status = glClientWaitSync(m_slots[slot].fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		deliver(slot, 0);
+	}
+}
+
+void FrameCapture::deliver(int index, GLuint64 timeout)
+{
+	Slot& slot = m_slots[index];
+	glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+
+	// Only this buffer is off limits to GL while mapped, so the consumer can take its time
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, m_size.x * m_size.y * slot.channels, GL_MAP_READ_BIT);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot.state = pixels ? SLOT_CONSUMING : SLOT_FREE;
+
+	// A failed readback is still delivered, without pixels, so consumers that need an
+	// unbroken sequence of indices (VideoWriter) don't wait for it forever
+	if (!pixels)
+		m_dropped++;
+	Delivery delivery = { pixels ? index : -1, { slot.index, slot.tag, slot.repeat, m_size, slot.channels, (const uint8_t*)pixels } };
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_ready.push_back(delivery);
+	}
+	m_wake.notify_one();
+}
+
+void FrameCapture::consumerLoop()
+{
+	while (true)
+	{
+		Delivery delivery;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this]() { return m_quit || !m_ready.empty(); });
+			if (m_ready.empty())
+				return;
+			delivery = m_ready.front();
+			m_ready.pop_front();
+		}
+
+		m_consumer(delivery.frame);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (delivery.slot >= 0)
+			m_consumed.push_back(delivery.slot);
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pixel buffers in the readback ring. Frame N is copied out while N+1 and N+2 render.
+#define CAPTURE_RING 3
+// Threads running the consumer
+#define CAPTURE_CONSUMERS 2
+
+// A finished readback, still sitting in its mapped pixel buffer. Only valid for the
+// duration of the consumer call.
+struct CapturedFrame
+{
+	uint64_t index;        // Earlier captures with the same tag, so each tag counts 0, 1, 2...
+	int tag;               // Whatever the caller passed to capture()
+	uint32_t repeat;       // Likewise
+	glm::ivec2 size;
+	int channels;          // 3 for GL_RGB, 4 for GL_RGBA
+	const uint8_t* pixels; // Tightly packed 8-bit channels, bottom row first as GL stores it, or
+	                       // null if the readback failed. The frame still takes its index.
+};
+
+typedef std::function<void(const CapturedFrame&)> CaptureConsumer;
+
+// Asynchronous readback of the default framebuffer. capture() queues a
+// glReadPixels into the next free pixel buffer object and fences it, so the copy
+// runs on the GPU behind the frames that follow instead of stalling the pipeline.
+// poll() maps buffers whose fence has signalled and hands the mapped memory
+// straight to consumer threads; a buffer goes back into the ring once its consumer
+// returns. When all CAPTURE_RING buffers are busy the frame is dropped, not waited
+// for. Everything except the consumer runs on the thread that owns the GL context,
+// including construction and destruction; the destructor finishes every capture
+// already started.
+class FrameCapture
+{
+public:
+	FrameCapture(glm::ivec2 size, CaptureConsumer consumer);
+	~FrameCapture();
+
+	// Read back what has been drawn to the default framebuffer so far as GL_RGB or
+	// GL_RGBA. repeat is passed through to the consumer, e.g. to hold a recorded frame
+	// for several frames of video. Returns false if the frame had to be dropped.
+	bool capture(int tag, GLenum format, uint32_t repeat = 1);
+
+	// Call once per frame: pass finished readbacks on and recycle consumed buffers
+	void poll();
+
+	uint64_t dropped() const { return m_dropped; }
+
+private:
+	enum SlotState
+	{
+		SLOT_FREE,
+		SLOT_READING,  // glReadPixels issued, fence pending
+		SLOT_CONSUMING // Mapped and with a consumer
+	};
+
+	struct Slot
+	{
+		GLuint buffer;
+		GLsync fence;
+		SlotState state;
+		uint64_t index;
+		int tag;
+		uint32_t repeat;
+		int channels;
+	};
+
+	// A mapped slot waiting for a consumer thread
+	struct Delivery
+	{
+		int slot; // -1 if the readback failed and the slot is already free
+		CapturedFrame frame;
+	};
+
+	void deliver(int slot, GLuint64 timeout);
+	void consumerLoop();
+
+	glm::ivec2 m_size;
+	CaptureConsumer m_consumer;
+	Slot m_slots[CAPTURE_RING];
+	int m_next = 0; // Slots are filled and finish reading in ring order
+	std::map<int, uint64_t> m_captured; // Per tag
+	uint64_t m_dropped = 0;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::deque<Delivery> m_ready;
+	std::vector<int> m_consumed; // Slots to unmap and reuse
+	bool m_quit = false;
+	std::thread m_consumers[CAPTURE_CONSUMERS];
+};
@@ -0,0 +1,95 @@
+#include "GoldenImage.h"
+#include "Image.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+ImageDiff compareImages(glm::ivec2 size, const std::vector<uint8_t>& image, const std::vector<uint8_t>& reference, int threshold,
+	std::vector<uint8_t>* diff)
+{
+	ImageDiff result = { 0, 0, 0.0f, 0.0f };
+	if (diff)
+		diff->resize(reference.size());
+
+	uint64_t total = 0;
+	for (int i = 0; i < size.x * size.y; i++)
+	{
+		int worst = 0;
+		for (int c = 0; c < 3; c++)
+		{
+			int difference = abs(int(image[i * 3 + c]) - int(reference[i * 3 + c]));
+			worst = std::max(worst, difference);
+			total += difference;
+		}
+		result.maxDifference = std::max(result.maxDifference, worst);
+
+		bool bad = worst > threshold;
+		result.badPixels += bad;
+		if (diff)
+		{
+			uint8_t grey = uint8_t((reference[i * 3] + reference[i * 3 + 1] + reference[i * 3 + 2]) / 12);
+			(*diff)[i * 3] = bad ? 255 : grey;
+			(*diff)[i * 3 + 1] = bad ? 0 : grey;
+			(*diff)[i * 3 + 2] = bad ? 0 : grey;
+		}
+	}
+
+	result.meanDifference = float(double(total) / (double(size.x) * size.y * 3));
+
+	for (int by = 0; by < size.y; by += GOLDEN_BLOCK)
+		for (int bx = 0; bx < size.x; bx += GOLDEN_BLOCK)
+		{
+			int count = 0, sum = 0;
+			for (int y = by; y < std::min(by + GOLDEN_BLOCK, size.y); y++)
+				for (int x = bx; x < std::min(bx + GOLDEN_BLOCK, size.x); x++)
+					for (int c = 0; c < 3; c++, count++)
+						sum += int(image[(y * size.x + x) * 3 + c]) - int(reference[(y * size.x + x) * 3 + c]);
+			result.maxBlockDifference = std::max(result.maxBlockDifference, float(abs(sum)) / count);
+		}
+	return result;
+}
+
+std::string goldenPath(const char* dir, int pose, const char* kind)
+{
+	std::ostringstream path;
+	path << dir << "/pose_" << std::setw(3) << std::setfill('0') << pose << "_" << kind << ".png";
+	return path.str();
+}
+
+bool checkGolden(const std::string& path, const char* label, glm::ivec2 size, const std::vector<uint8_t>& rgb, float maxBad)
+{
+	glm::ivec2 goldenSize;
+	int channels;
+	stbi_set_flip_vertically_on_load(false); // Set for the textures, which are bottom row first
+	unsigned char* pixels = stbi_load(path.c_str(), &goldenSize.x, &goldenSize.y, &channels, 3);
+	if (!pixels || goldenSize != size)
+	{
+		std::cout << "FAIL " << path << " (" << label << "): missing or wrong size, run with --update to create it" << std::endl;
+		stbi_image_free(pixels);
+		return false;
+	}
+	std::vector<uint8_t> golden(pixels, pixels + size.x * size.y * 3);
+	stbi_image_free(pixels);
+
+	std::vector<uint8_t> diff;
+	ImageDiff result = compareImages(size, rgb, golden, GOLDEN_THRESHOLD, &diff);
+	float badFraction = float(result.badPixels) / (size.x * size.y);
+	bool passed = badFraction <= maxBad && result.maxBlockDifference <= GOLDEN_MAX_BLOCK_DIFFERENCE;
+
+	std::cout << (passed ? "PASS " : "FAIL ") << path << " (" << label << "): " << result.badPixels << " pixels off ("
+		<< badFraction * 100.0f << "%), max difference " << result.maxDifference << ", mean " << result.meanDifference
+		<< ", worst block " << result.maxBlockDifference << std::endl;
+
+	if (!passed)
+	{
+		std::string prefix = path + "." + label;
+		if (!writePNG((prefix + ".png").c_str(), size, rgb) || !writePNG((prefix + ".diff.png").c_str(), size, diff))
+			std::cout << "ERROR::IMAGE::FAILED_TO_WRITE " << prefix << std::endl;
+	}
+	return passed;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Channel difference above which a pixel counts as wrong
+#define GOLDEN_THRESHOLD 24
+// Fraction of wrong pixels a check tolerates. Raster images are deterministic. Path
+// traced ones from different backends agree on almost every pixel, but rounding at
+// silhouettes and deep in a path can send a sample a different way, which shows at
+// low sample counts and more so at the small GOLDEN_WIDTH x GOLDEN_HEIGHT size, where
+// silhouettes cover more of the image.
+#define GOLDEN_MAX_BAD 0.001f
+#define GOLDEN_MAX_BAD_NOISY 0.05f
+// Side of the squares averaged to see past that noise, and the largest mean
+// difference a square may have. A systematic change such as a biased hit distance
+// shifts block means, while scattered per-pixel outliers average away.
+#define GOLDEN_BLOCK 16
+#define GOLDEN_MAX_BLOCK_DIFFERENCE 4.0f
+// Path samples per pixel in the path traced goldens
+#define GOLDEN_SAMPLES 8
+// Size the window opens at for --golden runs, small to keep the checked in images small
+#define GOLDEN_WIDTH 320
+#define GOLDEN_HEIGHT 180
+
+struct ImageDiff
+{
+	int badPixels;     // Pixels with any channel off by more than the threshold
+	int maxDifference; // Largest channel difference anywhere
+	float meanDifference;
+	float maxBlockDifference; // Largest mean channel difference over a GOLDEN_BLOCK square
+};
+
+// Compares two images of the same size pixel by pixel. If diff is given it receives
+// a picture of the result: the reference in dim grey with wrong pixels in red.
+ImageDiff compareImages(glm::ivec2 size, const std::vector<uint8_t>& image, const std::vector<uint8_t>& reference, int threshold,
+	std::vector<uint8_t>* diff);
+
+// dir/pose_<pose>_<kind>.png
+std::string goldenPath(const char* dir, int pose, const char* kind);
+
+// Checks rgb against the golden image at path and prints PASS or FAIL with the
+// numbers. Passes when at most maxBad of the pixels are off by more than
+// GOLDEN_THRESHOLD and no block is off by more than GOLDEN_MAX_BLOCK_DIFFERENCE. On
+// failure the image and its diff are saved next to the golden as <path>.<label>.png
+// and <path>.<label>.diff.png for inspection. A missing or differently sized golden
+// fails.
+bool checkGolden(const std::string& path, const char* label, glm::ivec2 size, const std::vector<uint8_t>& rgb, float maxBad);
@@ -0,0 +1,343 @@
+#include "Image.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+void resolveImage(const std::vector<glm::fvec3>& colour, glm::ivec2 size, float scale, std::vector<uint8_t>& rgb)
+{
+	rgb.resize(size.x * size.y * 3);
+	for (int y = 0; y < size.y; y++)
+		for (int x = 0; x < size.x; x++)
+		{
+			glm::fvec3 c = glm::clamp(colour[y * size.x + x] * scale, 0.0f, 1.0f);
+			uint8_t* out = &rgb[((size.y - 1 - y) * size.x + x) * 3];
+			for (int i = 0; i < 3; i++)
+				out[i] = uint8_t(c[i] * 255.0f + 0.5f);
+		}
+}
+
+bool writePPM(const char* path, glm::ivec2 size, const std::vector<uint8_t>& rgb)
+{
+	return writePPM(path, size, rgb.data(), size.x * 3);
+}
+
+bool readPPM(const char* path, glm::ivec2& size, std::vector<uint8_t>& rgb)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::string magic;
+	int maxValue = 0;
+	if (!(file >> magic >> size.x >> size.y >> maxValue) || magic != "P6" || maxValue != 255 || size.x <= 0 || size.y <= 0)
+		return false;
+
+	// Exactly one whitespace byte separates the header from the pixels
+	file.get();
+	rgb.resize(size_t(size.x) * size.y * 3);
+	return (bool)file.read((char*)rgb.data(), rgb.size());
+}
+
+bool writePPM(const char* path, glm::ivec2 size, const uint8_t* rgb, int stride)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	file << "P6\n" << size.x << " " << size.y << "\n255\n";
+	for (int y = 0; y < size.y; y++)
+		file.write((const char*)rgb + ptrdiff_t(y) * stride, size.x * 3);
+	return (bool)file;
+}
+
+// Longest back-reference chain followed per position, trading ratio for speed
+#define DEFLATE_MAX_CHAIN 32
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_HASH_BITS 15
+
+static const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+struct BitWriter
+{
+	std::vector<uint8_t>& out;
+	uint32_t bits;
+	int count;
+
+	// Values go in least significant bit first, as deflate expects for everything but Huffman codes
+	void put(uint32_t value, int length)
+	{
+		bits |= value << count;
+		count += length;
+		while (count >= 8)
+		{
+			out.push_back(uint8_t(bits));
+			bits >>= 8;
+			count -= 8;
+		}
+	}
+
+	// Huffman codes go in most significant bit first
+	void putCode(uint32_t code, int length)
+	{
+		uint32_t reversed = 0;
+		for (int i = 0; i < length; i++)
+			reversed |= ((code >> i) & 1) << (length - 1 - i);
+		put(reversed, length);
+	}
+
+	void flush()
+	{
+		if (count > 0)
+			out.push_back(uint8_t(bits));
+		bits = 0;
+		count = 0;
+	}
+};
+
+// Fixed Huffman code for a literal or length symbol (RFC 1951, 3.2.6)
+static void putSymbol(BitWriter& writer, int symbol)
+{
+	if (symbol < 144)
+		writer.putCode(0x30 + symbol, 8);
+	else if (symbol < 256)
+		writer.putCode(0x190 + symbol - 144, 9);
+	else if (symbol < 280)
+		writer.putCode(symbol - 256, 7);
+	else
+		writer.putCode(0xC0 + symbol - 280, 8);
+}
+
+static void putMatch(BitWriter& writer, int length, int distance)
+{
+	int l = 28;
+	while (lengthBase[l] > length)
+		l--;
+	putSymbol(writer, 257 + l);
+	writer.put(length - lengthBase[l], lengthExtra[l]);
+
+	int d = 29;
+	while (distBase[d] > distance)
+		d--;
+	writer.putCode(d, 5);
+	writer.put(distance - distBase[d], distExtra[d]);
+}
+
+// Deflate data as stored (uncompressed) blocks of up to 64 KiB
+static void storeBlocks(const std::vector<uint8_t>& data, std::vector<uint8_t>& out)
+{
+	size_t offset = 0;
+	do
+	{
+		uint16_t length = uint16_t(std::min<size_t>(0xFFFF, data.size() - offset));
+		bool final = offset + length == data.size();
+		const uint8_t header[5] = { uint8_t(final), uint8_t(length), uint8_t(length >> 8), uint8_t(~length), uint8_t(~length >> 8) };
+		out.insert(out.end(), header, header + 5);
+		out.insert(out.end(), data.begin() + offset, data.begin() + offset + length);
+		offset += length;
+	} while (offset < data.size());
+}
+
+// zlib stream holding one fixed Huffman deflate block, or stored blocks when
+// the data doesn't compress (e.g. noisy path traced frames)
+static void deflate(const std::vector<uint8_t>& data, std::vector<uint8_t>& out)
+{
+	out.push_back(0x78);
+	out.push_back(0x01);
+
+	std::vector<uint8_t> block;
+	BitWriter writer = { block, 0, 0 };
+	writer.put(1, 1); // Final block
+	writer.put(1, 2); // Fixed Huffman codes
+
+	std::vector<int> head(1 << DEFLATE_HASH_BITS, -1), prev(data.size(), -1);
+	auto hash = [&](size_t i)
+	{
+		return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1 << DEFLATE_HASH_BITS) - 1);
+	};
+	auto insert = [&](size_t i)
+	{
+		if (i + DEFLATE_MIN_MATCH > data.size())
+			return;
+		int h = hash(i);
+		prev[i] = head[h];
+		head[h] = int(i);
+	};
+
+	size_t i = 0;
+	while (i < data.size())
+	{
+		int bestLength = 0, bestDistance = 0;
+		if (i + DEFLATE_MIN_MATCH <= data.size())
+		{
+			int limit = int(std::min<size_t>(DEFLATE_MAX_MATCH, data.size() - i));
+			int candidate = head[hash(i)];
+			for (int chain = 0; candidate >= 0 && chain < DEFLATE_MAX_CHAIN && int(i) - candidate <= DEFLATE_WINDOW; chain++)
+			{
+				int length = 0;
+				while (length < limit && data[candidate + length] == data[i + length])
+					length++;
+				if (length > bestLength)
+				{
+					bestLength = length;
+					bestDistance = int(i) - candidate;
+					if (length == limit)
+						break;
+				}
+				candidate = prev[candidate];
+			}
+		}
+
+		if (bestLength >= DEFLATE_MIN_MATCH)
+		{
+			putMatch(writer, bestLength, bestDistance);
+			for (int j = 0; j < bestLength; j++)
+				insert(i + j);
+			i += bestLength;
+		}
+		else
+		{
+			putSymbol(writer, data[i]);
+			insert(i);
+			i++;
+		}
+	}
+	putSymbol(writer, 256);
+	writer.flush();
+
+	if (block.size() < data.size() + (data.size() / 0xFFFF + 1) * 5)
+		out.insert(out.end(), block.begin(), block.end());
+	else
+		storeBlocks(data, out);
+
+	uint32_t a = 1, b = 0;
+	for (uint8_t byte : data)
+	{
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	uint32_t adler = (b << 16) | a;
+	for (int shift = 24; shift >= 0; shift -= 8)
+		out.push_back(uint8_t(adler >> shift));
+}
+
+static uint32_t crc32(const uint8_t* data, size_t size)
+{
+	static uint32_t table[256];
+	if (!table[1])
+		for (uint32_t n = 0; n < 256; n++)
+		{
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+
+	uint32_t crc = 0xFFFFFFFFu;
+	for (size_t i = 0; i < size; i++)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return crc ^ 0xFFFFFFFFu;
+}
+
+static void putBigEndian(std::vector<uint8_t>& out, uint32_t value)
+{
+	for (int shift = 24; shift >= 0; shift -= 8)
+		out.push_back(uint8_t(value >> shift));
+}
+
+static void putChunk(std::vector<uint8_t>& png, const char* type, const std::vector<uint8_t>& data)
+{
+	putBigEndian(png, uint32_t(data.size()));
+	size_t start = png.size();
+	png.insert(png.end(), type, type + 4);
+	png.insert(png.end(), data.begin(), data.end());
+	putBigEndian(png, crc32(&png[start], png.size() - start));
+}
+
+static uint8_t paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	return uint8_t(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+void encodePNG(glm::ivec2 size, const std::vector<uint8_t>& rgb, std::vector<uint8_t>& png)
+{
+	encodePNG(size, rgb.data(), size.x * 3, png);
+}
+
+void encodePNG(glm::ivec2 size, const uint8_t* rgb, int stride, std::vector<uint8_t>& png)
+{
+	// Filter each row with whichever of the five filters leaves the smallest residuals
+	int rowBytes = size.x * 3;
+	std::vector<uint8_t> filtered, candidate(rowBytes);
+	filtered.reserve((rowBytes + 1) * size.y);
+	std::vector<uint8_t> zero(rowBytes, 0);
+	for (int y = 0; y < size.y; y++)
+	{
+		const uint8_t* row = rgb + ptrdiff_t(y) * stride;
+		const uint8_t* up = y > 0 ? row - stride : zero.data();
+
+		int bestFilter = 0;
+		uint32_t bestCost = UINT32_MAX;
+		std::vector<uint8_t> best;
+		for (int filter = 0; filter < 5; filter++)
+		{
+			uint32_t cost = 0;
+			for (int x = 0; x < rowBytes; x++)
+			{
+				int a = x >= 3 ? row[x - 3] : 0, b = up[x], c = x >= 3 ? up[x - 3] : 0;
+				int predicted = filter == 0 ? 0 : filter == 1 ? a : filter == 2 ? b : filter == 3 ? (a + b) / 2 : paeth(a, b, c);
+				candidate[x] = uint8_t(row[x] - predicted);
+				cost += abs(int8_t(candidate[x]));
+			}
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestFilter = filter;
+				best = candidate;
+			}
+		}
+
+		filtered.push_back(uint8_t(bestFilter));
+		filtered.insert(filtered.end(), best.begin(), best.end());
+	}
+
+	png.clear();
+	const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	png.insert(png.end(), signature, signature + 8);
+
+	std::vector<uint8_t> header;
+	putBigEndian(header, size.x);
+	putBigEndian(header, size.y);
+	const uint8_t format[5] = { 8, 2, 0, 0, 0 }; // 8 bits per channel, RGB, deflate, adaptive filtering, no interlace
+	header.insert(header.end(), format, format + 5);
+	putChunk(png, "IHDR", header);
+
+	std::vector<uint8_t> compressed;
+	deflate(filtered, compressed);
+	putChunk(png, "IDAT", compressed);
+	putChunk(png, "IEND", {});
+}
+
+bool writePNG(const char* path, glm::ivec2 size, const std::vector<uint8_t>& rgb)
+{
+	return writePNG(path, size, rgb.data(), size.x * 3);
+}
+
+bool writePNG(const char* path, glm::ivec2 size, const uint8_t* rgb, int stride)
+{
+	std::vector<uint8_t> png;
+	encodePNG(size, rgb, stride, png);
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	file.write((const char*)png.data(), png.size());
+	return (bool)file;
+}
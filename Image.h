@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Converts linear colour (bottom row first, as rendered) to 8-bit RGB, top row
+// first. Values are scaled, clamped to [0, 1] and rounded like the GL framebuffer.
+void resolveImage(const std::vector<glm::fvec3>& colour, glm::ivec2 size, float scale, std::vector<uint8_t>& rgb);
+
+// Binary PPM (P6), rgb top row first
+bool writePPM(const char* path, glm::ivec2 size, const std::vector<uint8_t>& rgb);
+// Reads what writePPM() writes: P6 with a maxval of 255 and no comments
+bool readPPM(const char* path, glm::ivec2& size, std::vector<uint8_t>& rgb);
+
+// PNG (8-bit RGB), rgb top row first. Rows get the adaptive filter choice from the
+// PNG spec and are deflated with fixed Huffman codes and a greedy LZ77 match search,
+// which is small and fast rather than the tightest possible encoding.
+void encodePNG(glm::ivec2 size, const std::vector<uint8_t>& rgb, std::vector<uint8_t>& png);
+bool writePNG(const char* path, glm::ivec2 size, const std::vector<uint8_t>& rgb);
+
+// As above for pixels that live elsewhere, e.g. a mapped readback buffer. rgb points
+// at the top row and stride is the byte step to the next row down, negative for
+// images stored bottom row first.
+bool writePPM(const char* path, glm::ivec2 size, const uint8_t* rgb, int stride);
+void encodePNG(glm::ivec2 size, const uint8_t* rgb, int stride, std::vector<uint8_t>& png);
+bool writePNG(const char* path, glm::ivec2 size, const uint8_t* rgb, int stride);
@@ -0,0 +1,245 @@
+#include "LightVolume.h"
+#include "Parallel.h"
+#include "Traversal.h"
+
+#include <climits>
+#include <cstring>
+
+LightVolume::LightVolume(const World& world, const std::vector<Light>& lights)
+	: m_world(world), m_lights(lights)
+{
+	buildLightGrid(m_grid, m_lights, m_world.size);
+	m_dims = (m_world.size + LIGHT_VOLUME_CELL - 1) / LIGHT_VOLUME_CELL;
+	m_texels.assign(m_dims.x * m_dims.y * m_dims.z, glm::fvec3(0));
+
+	bake(glm::ivec3(0), m_dims - 1);
+	m_updates.push_back(extract(glm::ivec3(0), m_dims - 1));
+
+	m_worker = std::thread(&LightVolume::workerLoop, this);
+}
+
+LightVolume::~LightVolume()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_one();
+	m_worker.join();
+}
+
+void LightVolume::editVoxel(glm::ivec3 map, uint32_t voxel)
+{
+	Edit edit = { false, map, voxel };
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_edits.push_back(edit);
+	}
+	m_wake.notify_one();
+}
+
+void LightVolume::setLights(const std::vector<Light>& lights)
+{
+	Edit edit = { true, glm::ivec3(0), 0, lights };
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_edits.push_back(edit);
+	}
+	m_wake.notify_one();
+}
+
+bool LightVolume::takeUpdate(LightVolumeRegion& region)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_updates.empty())
+		return false;
+	region = std::move(m_updates.front());
+	m_updates.pop_front();
+	return true;
+}
+
+void LightVolume::workerLoop()
+{
+	while (true)
+	{
+		std::deque<Edit> edits;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this]() { return m_quit || !m_edits.empty(); });
+			if (m_quit)
+				return;
+			edits.swap(m_edits);
+		}
+
+		// Apply everything queued so far and merge the affected regions into one box
+		glm::ivec3 lo(INT_MAX), hi(INT_MIN);
+		for (Edit& edit : edits)
+		{
+			if (edit.lightsChanged)
+			{
+				// Lights that moved or changed affect both their old and new extents
+				for (size_t i = 0; i < std::max(m_lights.size(), edit.lights.size()); i++)
+				{
+					bool same = i < m_lights.size() && i < edit.lights.size() &&
+						memcmp(&m_lights[i], &edit.lights[i], sizeof(Light)) == 0;
+					if (same)
+						continue;
+					if (i < m_lights.size())
+						addLightBounds(m_lights[i], lo, hi);
+					if (i < edit.lights.size())
+						addLightBounds(edit.lights[i], lo, hi);
+				}
+				m_lights = std::move(edit.lights);
+				buildLightGrid(m_grid, m_lights, m_world.size);
+			}
+			else if (m_world.contains(edit.map))
+			{
+				// Only lights reaching the edited voxel can cast shadows through it
+				uint32_t count;
+				const uint32_t* indices = cellLights(m_grid, glm::fvec3(edit.map) + 0.5f, count);
+				for (uint32_t i = 0; i < count; i++)
+					addLightBounds(m_lights[indices[i]], lo, hi);
+
+				// The edited texel itself switches between lit and dilated
+				glm::ivec3 texel = edit.map / LIGHT_VOLUME_CELL;
+				lo = glm::min(lo, texel);
+				hi = glm::max(hi, texel);
+
+				m_world.voxels[m_world.index(edit.map)] = edit.voxel;
+			}
+		}
+
+		if (lo.x > hi.x)
+			continue;
+
+		bake(lo, hi);
+		LightVolumeRegion region = extract(lo, hi);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_updates.push_back(std::move(region));
+	}
+}
+
+void LightVolume::addLightBounds(const Light& light, glm::ivec3& lo, glm::ivec3& hi) const
+{
+	glm::ivec3 lightLo = glm::ivec3(glm::floor((light.position - light.radius) / float(LIGHT_VOLUME_CELL)));
+	glm::ivec3 lightHi = glm::ivec3(glm::floor((light.position + light.radius) / float(LIGHT_VOLUME_CELL)));
+	lo = glm::clamp(glm::min(lo, lightLo), glm::ivec3(0), m_dims - 1);
+	hi = glm::clamp(glm::max(hi, lightHi), glm::ivec3(0), m_dims - 1);
+}
+
+void LightVolume::bake(glm::ivec3 lo, glm::ivec3 hi)
+{
+	// Solid texels next to the region read from it when dilating, so they are redone too
+	glm::ivec3 dilateLo = glm::max(lo - 1, glm::ivec3(0));
+	glm::ivec3 dilateHi = glm::min(hi + 1, m_dims - 1);
+
+	auto texelIndex = [this](glm::ivec3 t) { return (t.z * m_dims.y + t.y) * m_dims.x + t.x; };
+	// Voxels of the world under a texel, as [first, last]
+	auto texelVoxels = [this](glm::ivec3 t, glm::ivec3& first, glm::ivec3& last)
+	{
+		first = t * LIGHT_VOLUME_CELL;
+		last = glm::min(first + LIGHT_VOLUME_CELL - 1, m_world.size - 1);
+	};
+	auto isSolid = [&](glm::ivec3 t)
+	{
+		glm::ivec3 first, last;
+		texelVoxels(t, first, last);
+		for (int z = first.z; z <= last.z; z++)
+			for (int y = first.y; y <= last.y; y++)
+				for (int x = first.x; x <= last.x; x++)
+					if (m_world.voxels[m_world.index({ x, y, z })] == 0)
+						return false;
+		return true;
+	};
+
+	// Runs fn on every texel of [boxLo, boxHi], one LIGHT_VOLUME_CHUNK cube per job
+	auto forEachChunk = [](glm::ivec3 boxLo, glm::ivec3 boxHi, auto fn)
+	{
+		glm::ivec3 chunks = (boxHi - boxLo + LIGHT_VOLUME_CHUNK) / LIGHT_VOLUME_CHUNK;
+		parallelFor(0, chunks.x * chunks.y * chunks.z, [&](int c)
+		{
+			glm::ivec3 chunk(c % chunks.x, (c / chunks.x) % chunks.y, c / (chunks.x * chunks.y));
+			glm::ivec3 start = boxLo + chunk * LIGHT_VOLUME_CHUNK;
+			glm::ivec3 end = glm::min(start + LIGHT_VOLUME_CHUNK - 1, boxHi);
+			for (int z = start.z; z <= end.z; z++)
+				for (int y = start.y; y <= end.y; y++)
+					for (int x = start.x; x <= end.x; x++)
+						fn(glm::ivec3(x, y, z));
+		});
+	};
+
+	// Gather shadowed light into every texel with empty voxels
+	forEachChunk(lo, hi, [&](glm::ivec3 t)
+	{
+		glm::ivec3 first, last;
+		texelVoxels(t, first, last);
+		glm::fvec3 irradiance(0);
+		int samples = 0;
+		for (int z = first.z; z <= last.z; z++)
+			for (int y = first.y; y <= last.y; y++)
+				for (int x = first.x; x <= last.x; x++)
+				{
+					if (m_world.voxels[m_world.index({ x, y, z })] != 0)
+						continue;
+					samples++;
+
+					glm::fvec3 p = glm::fvec3(x, y, z) + 0.5f;
+					uint32_t count;
+					const uint32_t* indices = cellLights(m_grid, p, count);
+					for (uint32_t i = 0; i < count; i++)
+					{
+						const Light& l = m_lights[indices[i]];
+						glm::fvec3 toLight = l.position - p;
+						float lightDist = glm::length(toLight);
+						if (lightDist >= l.radius || occluded(m_world, p, toLight / lightDist, lightDist))
+							continue;
+
+						float falloff = 1.0f - lightDist / l.radius;
+						irradiance += l.colour * (l.intensity * falloff * falloff);
+					}
+				}
+
+		if (samples > 0)
+			m_texels[texelIndex(t)] = irradiance / float(samples);
+	});
+
+	// Dilate into solid texels from their empty neighbours
+	forEachChunk(dilateLo, dilateHi, [&](glm::ivec3 t)
+	{
+		if (!isSolid(t))
+			return;
+
+		glm::fvec3 sum(0);
+		int count = 0;
+		for (int axis = 0; axis < 3; axis++)
+			for (int sign = -1; sign <= 1; sign += 2)
+			{
+				glm::ivec3 n = t;
+				n[axis] += sign;
+				if (n[axis] < 0 || n[axis] >= m_dims[axis] || isSolid(n))
+					continue;
+				sum += m_texels[texelIndex(n)];
+				count++;
+			}
+
+		m_texels[texelIndex(t)] = count > 0 ? sum / float(count) : glm::fvec3(0);
+	});
+}
+
+LightVolumeRegion LightVolume::extract(glm::ivec3 lo, glm::ivec3 hi) const
+{
+	// Include the dilated border so the upload covers everything bake() touched
+	lo = glm::max(lo - 1, glm::ivec3(0));
+	hi = glm::min(hi + 1, m_dims - 1);
+
+	LightVolumeRegion region;
+	region.offset = lo;
+	region.size = hi - lo + 1;
+	region.texels.reserve(region.size.x * region.size.y * region.size.z);
+	for (int z = lo.z; z <= hi.z; z++)
+		for (int y = lo.y; y <= hi.y; y++)
+			for (int x = lo.x; x <= hi.x; x++)
+				region.texels.push_back(m_texels[(z * m_dims.y + y) * m_dims.x + x]);
+	return region;
+}
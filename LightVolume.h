@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Lights.h"
+#include "World.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// Voxels per light volume texel along each axis
+#define LIGHT_VOLUME_CELL 2
+// Texels per bake job along each axis
+#define LIGHT_VOLUME_CHUNK 8
+
+// A box of baked irradiance ready for glTexSubImage3D, texels x-fastest then y then z
+struct LightVolumeRegion
+{
+	glm::ivec3 offset;
+	glm::ivec3 size;
+	std::vector<glm::fvec3> texels;
+};
+
+// Low resolution 3D texture of irradiance from static or slowly changing lights,
+// one texel per LIGHT_VOLUME_CELL cube of voxels. A texel averages the shadowed light
+// gathered at the centre of each empty voxel it covers, from the lights whose culling
+// cell that voxel lies in. Texels with no empty voxels take the average of their
+// empty neighbours so trilinear fetches next to walls don't darken.
+//
+// The full volume is baked in parallel by the constructor. After that, voxel and
+// light edits are queued to a worker thread which keeps its own copy of the world,
+// re-propagates only the region those lights can reach and publishes it through
+// takeUpdate() for the render thread to upload.
+class LightVolume
+{
+public:
+	LightVolume(const World& world, const std::vector<Light>& lights);
+	~LightVolume();
+
+	glm::ivec3 dims() const { return m_dims; }
+
+	void editVoxel(glm::ivec3 map, uint32_t voxel);
+	void setLights(const std::vector<Light>& lights);
+
+	// Pops the next finished region, if any. The first one is the full volume.
+	bool takeUpdate(LightVolumeRegion& region);
+
+private:
+	struct Edit
+	{
+		bool lightsChanged;
+		glm::ivec3 map;
+		uint32_t voxel;
+		std::vector<Light> lights;
+	};
+
+	void bake(glm::ivec3 lo, glm::ivec3 hi);
+	void addLightBounds(const Light& light, glm::ivec3& lo, glm::ivec3& hi) const;
+	LightVolumeRegion extract(glm::ivec3 lo, glm::ivec3 hi) const;
+	void workerLoop();
+
+	// Owned by the worker after construction
+	World m_world;
+	std::vector<Light> m_lights;
+	LightGrid m_grid;
+	glm::ivec3 m_dims;
+	std::vector<glm::fvec3> m_texels;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::deque<Edit> m_edits;
+	std::deque<LightVolumeRegion> m_updates;
+	bool m_quit = false;
+	std::thread m_worker;
+};
@@ -0,0 +1,49 @@
+#include "Lights.h"
+
+void buildLightGrid(LightGrid& grid, const std::vector<Light>& lights, glm::ivec3 mapSize)
+{
+	grid.dims = (mapSize + LIGHT_CELL_SIZE - 1) / LIGHT_CELL_SIZE;
+	int numCells = grid.dims.x * grid.dims.y * grid.dims.z;
+
+	std::vector<std::vector<uint32_t>> cellLights(numCells);
+
+	for (uint32_t i = 0; i < lights.size(); i++)
+	{
+		const Light& l = lights[i];
+
+		// Only visit the cells covered by the light's bounding box
+		glm::ivec3 lo = glm::clamp(glm::ivec3(glm::floor((l.position - l.radius) / float(LIGHT_CELL_SIZE))), glm::ivec3(0), grid.dims - 1);
+		glm::ivec3 hi = glm::clamp(glm::ivec3(glm::floor((l.position + l.radius) / float(LIGHT_CELL_SIZE))), glm::ivec3(0), grid.dims - 1);
+
+		for (int y = lo.y; y <= hi.y; y++)
+			for (int z = lo.z; z <= hi.z; z++)
+				for (int x = lo.x; x <= hi.x; x++)
+				{
+					// Sphere vs cell AABB
+					glm::fvec3 cellMin = glm::fvec3(x, y, z) * float(LIGHT_CELL_SIZE);
+					glm::fvec3 closest = glm::clamp(l.position, cellMin, cellMin + float(LIGHT_CELL_SIZE));
+					glm::fvec3 d = closest - l.position;
+					if (glm::dot(d, d) > l.radius * l.radius)
+						continue;
+
+					cellLights[(y * grid.dims.z + z) * grid.dims.x + x].push_back(i);
+				}
+	}
+
+	// Flatten into (offset, count) pairs followed by the index lists
+	grid.data.assign(numCells * 2, 0);
+	for (int c = 0; c < numCells; c++)
+	{
+		grid.data[c * 2] = (uint32_t)grid.data.size();
+		grid.data[c * 2 + 1] = (uint32_t)cellLights[c].size();
+		grid.data.insert(grid.data.end(), cellLights[c].begin(), cellLights[c].end());
+	}
+}
+
+const uint32_t* cellLights(const LightGrid& grid, glm::fvec3 point, uint32_t& count)
+{
+	glm::ivec3 cell = glm::clamp(glm::ivec3(glm::floor(point / float(LIGHT_CELL_SIZE))), glm::ivec3(0), grid.dims - 1);
+	int index = (cell.y * grid.dims.z + cell.z) * grid.dims.x + cell.x;
+	count = grid.data[index * 2 + 1];
+	return grid.data.data() + grid.data[index * 2];
+}
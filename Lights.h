@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Size (in voxels) of one light culling cell along each axis
+#define LIGHT_CELL_SIZE 4
+
+// Matches the std430 layout of Light in shader.frag
+struct Light
+{
+	glm::fvec3 position;
+	float intensity;
+	glm::fvec3 colour;
+	float radius;
+};
+
+static_assert(sizeof(Light) == 32, "Light must match the std430 layout used by the shader");
+
+// Coarse grid over the map. Each cell lists the lights whose radius reaches it,
+// so shading a hit point only loops over lights that can actually affect it.
+// Stored flat for upload: an (offset, count) pair per cell, followed by the
+// light indices. Offsets are absolute indices into the same array.
+struct LightGrid
+{
+	glm::ivec3 dims;
+	std::vector<uint32_t> data;
+};
+
+// mapSize is in voxels as (x, y, z), i.e. (MAP_WIDTH, MAP_DEPTH, MAP_HEIGHT)
+void buildLightGrid(LightGrid& grid, const std::vector<Light>& lights, glm::ivec3 mapSize);
+
+// Indices of the lights that can reach point, as a pointer into grid.data
+const uint32_t* cellLights(const LightGrid& grid, glm::fvec3 point, uint32_t& count);
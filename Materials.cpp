@@ -0,0 +1,77 @@
+#include "Materials.h"
+
+#include <fstream>
+#include <limits>
+#include <string>
+
+static Material diffuse(float r, float g, float b)
+{
+	return { glm::fvec3(r, g, b), 1.0f, glm::fvec3(0), 0.0f };
+}
+
+MaterialTable defaultMaterials()
+{
+	return {
+		diffuse(1, 1, 0.5f),
+		diffuse(1, 0.5f, 1),
+		diffuse(1, 1, 1),
+		diffuse(0.5f, 1, 1),
+		diffuse(0.25f, 0.75f, 0.5f),
+		diffuse(0.75f, 0.25f, 0.5f),
+		diffuse(0.5f, 0.75f, 0.25f),
+		diffuse(0.5f, 0.25f, 0.75f),
+		diffuse(0.8f, 0.1f, 0.6f),
+		diffuse(0.1f, 0.8f, 0.6f),
+	};
+}
+
+bool readMaterial(std::istream& in, MaterialTable& materials)
+{
+	uint32_t id;
+	Material material = {};
+	in >> id >> material.albedo.r >> material.albedo.g >> material.albedo.b
+		>> material.emissive.r >> material.emissive.g >> material.emissive.b
+		>> material.roughness;
+	if (!in || id > MATERIAL_MAX_ID)
+		return false;
+
+	if (id >= materials.size())
+		materials.resize(id + 1, materials[0]);
+	materials[id] = material;
+	return true;
+}
+
+void writeMaterials(std::ostream& out, const MaterialTable& materials)
+{
+	for (size_t id = 0; id < materials.size(); id++)
+	{
+		const Material& m = materials[id];
+		out << "material " << id << " " << m.albedo.r << " " << m.albedo.g << " " << m.albedo.b << " "
+			<< m.emissive.r << " " << m.emissive.g << " " << m.emissive.b << " "
+			<< m.roughness << "\n";
+	}
+}
+
+bool loadMaterials(const char* path, MaterialTable& materials)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cout << "ERROR::MATERIALS::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+		return false;
+	}
+
+	materials = defaultMaterials();
+	std::string token;
+	while (file >> token)
+	{
+		if (token[0] == '#')
+			file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+		else if (token != "material" || !readMaterial(file, materials))
+		{
+			std::cout << "ERROR::MATERIALS::BAD_MATERIAL " << path << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// Loaded at startup from the working directory, like the shaders
+#define MATERIAL_FILE "./materials.txt"
+// Highest voxel ID a material can be given. The LOD pyramid keeps 16 bits of material.
+#define MATERIAL_MAX_ID 0xFFFF
+
+// What a voxel ID looks like. Matches the std430 layout of Material in shader.frag.
+struct Material
+{
+	glm::fvec3 albedo;
+	float roughness;     // Path traced bounces go from a mirror reflection at 0 to diffuse at 1
+	glm::fvec3 emissive; // Radiance given off, added on top of reflected light
+	float padding;
+};
+
+static_assert(sizeof(Material) == 32, "Material must match the std430 layout used by the shader");
+
+// Materials indexed by voxel ID. Entry 0 is never drawn as itself, since voxel 0 is
+// empty, so it holds the material for IDs past the end of the table.
+typedef std::vector<Material> MaterialTable;
+
+inline const Material& materialOf(const MaterialTable& materials, uint32_t voxel)
+{
+	return materials[voxel < materials.size() ? voxel : 0];
+}
+
+// The colours voxels had before material files, for when none is loaded
+MaterialTable defaultMaterials();
+
+// Text list of materials, one per line, in the style of a scene file:
+//
+//   # comment to end of line
+//   material <id> <r> <g> <b> <emissive r> <g> <b> <roughness>
+//
+// Loading starts from defaultMaterials() and each line replaces or adds one entry.
+// IDs run up to MATERIAL_MAX_ID. Adding an ID past the end of the table fills the
+// gap with copies of entry 0 as it stands, so a line for ID 0 belongs first.
+// Errors are printed and leave materials in an unspecified state.
+bool loadMaterials(const char* path, MaterialTable& materials);
+
+// Reads the fields of one material line, after the keyword, into materials. For
+// scene files, which carry material lines of their own.
+bool readMaterial(std::istream& in, MaterialTable& materials);
+void writeMaterials(std::ostream& out, const MaterialTable& materials);
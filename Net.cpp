@@ -0,0 +1,234 @@
+#include "Net.h"
+
+#include <algorithm>
+#include <string>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int SockLen;
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef socklen_t SockLen;
+#define closesocket close
+#endif
+
+// Most bytes netRecvAvailable or netSendAvailable moves in one system call
+#define NET_CHUNK 65536
+
+bool netInit()
+{
+#ifdef _WIN32
+	WSADATA data;
+	return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+	return true;
+#endif
+}
+
+// Tiles are sent as single messages, so don't hold small headers back waiting for more
+static void configure(Socket socket)
+{
+	int on = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+
+#ifdef _WIN32
+	DWORD timeout = NET_RECV_TIMEOUT * 1000;
+#else
+	timeval timeout = { NET_RECV_TIMEOUT, 0 };
+#endif
+	setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+Socket netListen(uint16_t port)
+{
+	Socket listener = Socket(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+	if (listener == NET_INVALID_SOCKET)
+		return NET_INVALID_SOCKET;
+
+	int on = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(listener, (const sockaddr*)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+	{
+		closesocket(listener);
+		return NET_INVALID_SOCKET;
+	}
+	return listener;
+}
+
+Socket netAccept(Socket listener)
+{
+	Socket socket = Socket(accept(listener, nullptr, nullptr));
+	if (socket != NET_INVALID_SOCKET)
+		configure(socket);
+	return socket;
+}
+
+Socket netConnect(const char* host, uint16_t port)
+{
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* addresses = nullptr;
+	if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &addresses) != 0)
+		return NET_INVALID_SOCKET;
+
+	Socket result = NET_INVALID_SOCKET;
+	for (addrinfo* address = addresses; address && result == NET_INVALID_SOCKET; address = address->ai_next)
+	{
+		Socket candidate = Socket(socket(address->ai_family, address->ai_socktype, address->ai_protocol));
+		if (candidate == NET_INVALID_SOCKET)
+			continue;
+		if (connect(candidate, address->ai_addr, SockLen(address->ai_addrlen)) == 0)
+			result = candidate;
+		else
+			closesocket(candidate);
+	}
+	freeaddrinfo(addresses);
+
+	if (result != NET_INVALID_SOCKET)
+		configure(result);
+	return result;
+}
+
+void netClose(Socket socket)
+{
+	closesocket(socket);
+}
+
+bool netSetNonBlocking(Socket socket)
+{
+#ifdef _WIN32
+	u_long on = 1;
+	return ioctlsocket(socket, FIONBIO, &on) == 0;
+#else
+	int flags = fcntl(int(socket), F_GETFL, 0);
+	return flags != -1 && fcntl(int(socket), F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+// Whether the last failed call on a non-blocking socket only had to wait
+static bool wouldBlock()
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+bool netSend(Socket socket, const void* data, size_t size)
+{
+	const char* bytes = (const char*)data;
+	while (size > 0)
+	{
+#ifdef MSG_NOSIGNAL
+		int sent = int(send(socket, bytes, int(size), MSG_NOSIGNAL));
+#else
+		int sent = int(send(socket, bytes, int(size), 0));
+#endif
+		if (sent <= 0)
+			return false;
+		bytes += sent;
+		size -= sent;
+	}
+	return true;
+}
+
+bool netRecv(Socket socket, void* data, size_t size)
+{
+	char* bytes = (char*)data;
+	while (size > 0)
+	{
+		int received = int(recv(socket, bytes, int(size), 0));
+		if (received <= 0)
+			return false;
+		bytes += received;
+		size -= received;
+	}
+	return true;
+}
+
+bool netRecvAvailable(Socket socket, std::vector<uint8_t>& buffer)
+{
+	size_t used = buffer.size();
+	buffer.resize(used + NET_CHUNK);
+	int received = int(recv(socket, (char*)buffer.data() + used, NET_CHUNK, 0));
+	buffer.resize(used + std::max(received, 0));
+	return received > 0 || (received < 0 && wouldBlock());
+}
+
+bool netSendAvailable(Socket socket, std::vector<uint8_t>& buffer)
+{
+	size_t total = 0;
+	while (total < buffer.size())
+	{
+		int size = int(std::min<size_t>(buffer.size() - total, NET_CHUNK));
+#ifdef MSG_NOSIGNAL
+		int sent = int(send(socket, (const char*)buffer.data() + total, size, MSG_NOSIGNAL));
+#else
+		int sent = int(send(socket, (const char*)buffer.data() + total, size, 0));
+#endif
+		if (sent <= 0)
+		{
+			if (sent < 0 && wouldBlock())
+				break;
+			return false;
+		}
+		total += sent;
+	}
+	buffer.erase(buffer.begin(), buffer.begin() + total);
+	return true;
+}
+
+void netWait(const std::vector<Socket>& sockets, int timeoutMs, std::vector<Socket>& ready)
+{
+	std::vector<Socket> writable;
+	netWait(sockets, {}, timeoutMs, ready, writable);
+}
+
+void netWait(const std::vector<Socket>& readers, const std::vector<Socket>& writers, int timeoutMs,
+	std::vector<Socket>& readable, std::vector<Socket>& writable)
+{
+	readable.clear();
+	writable.clear();
+
+	fd_set readSet, writeSet;
+	FD_ZERO(&readSet);
+	FD_ZERO(&writeSet);
+	Socket highest = 0;
+	for (Socket socket : readers)
+	{
+		FD_SET(socket, &readSet);
+		highest = socket > highest ? socket : highest;
+	}
+	for (Socket socket : writers)
+	{
+		FD_SET(socket, &writeSet);
+		highest = socket > highest ? socket : highest;
+	}
+
+	timeval timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000 };
+	if (select(int(highest + 1), &readSet, &writeSet, nullptr, &timeout) <= 0)
+		return;
+
+	for (Socket socket : readers)
+		if (FD_ISSET(socket, &readSet))
+			readable.push_back(socket);
+	for (Socket socket : writers)
+		if (FD_ISSET(socket, &writeSet))
+			writable.push_back(socket);
+}
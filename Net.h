@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Thin TCP layer over Winsock and BSD sockets, just enough for the tile
+// coordinator, the render daemon and their clients. Sockets are stored as
+// intptr_t so the platform headers stay out of everything else.
+typedef intptr_t Socket;
+#define NET_INVALID_SOCKET Socket(-1)
+
+// Seconds a blocking receive may wait before the peer is treated as gone
+#define NET_RECV_TIMEOUT 120
+
+bool netInit();
+
+// Listens on every interface. Returns NET_INVALID_SOCKET on failure.
+Socket netListen(uint16_t port);
+Socket netAccept(Socket listener);
+Socket netConnect(const char* host, uint16_t port);
+void netClose(Socket socket);
+
+// Makes sends and receives on socket return at once instead of waiting. Only
+// netRecvAvailable and netSendAvailable work on such sockets.
+bool netSetNonBlocking(Socket socket);
+
+// Send or receive exactly size bytes. False if the peer went away or timed out.
+bool netSend(Socket socket, const void* data, size_t size);
+bool netRecv(Socket socket, void* data, size_t size);
+
+// Appends whatever has arrived to buffer without waiting for the rest, for servers
+// that serve many peers from one thread and must never stall on a slow one. On a
+// blocking socket, only call it when netWait has just reported the socket readable.
+// False if the peer went away.
+bool netRecvAvailable(Socket socket, std::vector<uint8_t>& buffer);
+
+// Sends as much of buffer as a non-blocking socket takes right now and removes it
+// from the front. False if the peer went away.
+bool netSendAvailable(Socket socket, std::vector<uint8_t>& buffer);
+
+// Waits up to timeoutMs for any of sockets to be readable and fills ready with them
+void netWait(const std::vector<Socket>& sockets, int timeoutMs, std::vector<Socket>& ready);
+// The same, also waking for any of writers having room to send
+void netWait(const std::vector<Socket>& readers, const std::vector<Socket>& writers, int timeoutMs,
+	std::vector<Socket>& readable, std::vector<Socket>& writable);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Runs fn(i) for every i in [begin, end) across all hardware threads.
+// Work is handed out in blocks of grain indices so uneven rows balance out.
+template <typename F>
+void parallelFor(int begin, int end, F fn, int grain = 1)
+{
+	int numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	numThreads = std::min(numThreads, (end - begin + grain - 1) / grain);
+
+	std::atomic<int> next(begin);
+	auto worker = [&]()
+	{
+		for (int start = next.fetch_add(grain); start < end; start = next.fetch_add(grain))
+			for (int i = start; i < std::min(start + grain, end); i++)
+				fn(i);
+	};
+
+	if (numThreads <= 1)
+	{
+		worker();
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	for (int t = 1; t < numThreads; t++)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread& t : threads)
+		t.join();
+}
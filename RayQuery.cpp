@@ -0,0 +1,245 @@
+#include "RayQuery.h"
+#include "Parallel.h"
+
+#include <emmintrin.h>
+
+#include <algorithm>
+
+#define PACKET_SIZE 4
+
+static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// 32-bit lane-wise multiply, which SSE2 lacks (_mm_mullo_epi32 is SSE4.1)
+static inline __m128i mullo(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// Three low bits of each lane moved two apart, as mortonOffset() does per axis
+static inline __m128i spreadBits(__m128i v)
+{
+	const __m128i one = _mm_set1_epi32(1);
+	return _mm_or_si128(_mm_and_si128(v, one), _mm_or_si128(
+		_mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(2)), 2),
+		_mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(4)), 4)));
+}
+
+// SIMD traversal state, one ray per lane, kept in memory so lanes can be refilled
+struct Packet
+{
+	alignas(16) int map[3][PACKET_SIZE];
+	alignas(16) float tDelta[3][PACKET_SIZE];
+	alignas(16) float tMax[3][PACKET_SIZE];
+	alignas(16) float maxDist[PACKET_SIZE];
+	uint32_t ray[PACKET_SIZE];
+};
+
+template <int Octant>
+static void loadLane(Packet& packet, int lane, const Ray* rays, RayHit* hits, uint32_t index)
+{
+	const Ray& ray = rays[index];
+	glm::ivec3 m;
+	glm::fvec3 d, t;
+	initOctant<Octant>(ray.origin, ray.dir, m, d, t);
+	for (int i = 0; i < 3; i++)
+	{
+		packet.map[i][lane] = m[i];
+		packet.tDelta[i][lane] = d[i];
+		packet.tMax[i][lane] = t[i];
+	}
+	// Capped as castRay() does, so axes the ray never crosses are never stepped along
+	packet.maxDist[lane] = std::min(ray.maxDist, FLT_MAX);
+	packet.ray[lane] = index;
+	hits[index] = RayHit();
+}
+
+// Traces a list of rays from one octant four at a time. Each lane runs exactly the
+// scalar DDA from castRay(), including its tie-breaking between axes, so results match
+// it bit for bit. When a lane's ray finishes, the next ray in the list takes its place
+// so the lanes stay busy even when ray lengths differ. The octant fixes every lane's
+// step, so stepping is an add of a constant and leaving the map is one compare per axis.
+template <int Octant>
+static void traceRays(const World& world, const Ray* rays, RayHit* hits, const uint32_t* indices, uint32_t count)
+{
+	Packet packet;
+	uint32_t next = 0;
+	int active = 0;
+	for (int lane = 0; lane < PACKET_SIZE && next < count; lane++)
+	{
+		loadLane<Octant>(packet, lane, rays, hits, indices[next++]);
+		active |= 1 << lane;
+	}
+
+	const glm::ivec3 stepAmount = octantStep<Octant>();
+	const __m128i stepX = _mm_set1_epi32(stepAmount.x), stepY = _mm_set1_epi32(stepAmount.y), stepZ = _mm_set1_epi32(stepAmount.z);
+	const __m128i laneBits = _mm_set_epi32(8, 4, 2, 1);
+	const __m128i lastX = _mm_set1_epi32(world.size.x - 1);
+	const __m128i lastY = _mm_set1_epi32(world.size.y - 1);
+	const __m128i lastZ = _mm_set1_epi32(world.size.z - 1);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 ones = _mm_castsi128_ps(_mm_cmpeq_epi32(zero, zero));
+	const bool morton = world.layout == WORLD_MORTON;
+	const __m128i width = _mm_set1_epi32(morton ? world.chunks.x : world.size.x);
+	const __m128i depth = _mm_set1_epi32(morton ? world.chunks.z : world.size.z);
+	const __m128i localMask = _mm_set1_epi32(CHUNK_SIZE - 1);
+
+	while (active)
+	{
+		__m128 tMaxX = _mm_load_ps(packet.tMax[0]), tMaxY = _mm_load_ps(packet.tMax[1]), tMaxZ = _mm_load_ps(packet.tMax[2]);
+
+		// Pick the axis whose boundary each lane crosses first
+		__m128 xy = _mm_cmplt_ps(tMaxX, tMaxY);
+		__m128 selX = _mm_and_ps(xy, _mm_cmplt_ps(tMaxX, tMaxZ));
+		__m128 selY = _mm_andnot_ps(xy, _mm_cmplt_ps(tMaxY, tMaxZ));
+		__m128 selZ = _mm_andnot_ps(_mm_or_ps(selX, selY), ones);
+		__m128 t = select(selX, tMaxX, select(selY, tMaxY, tMaxZ));
+
+		// Lanes that ran out of distance finish without a hit
+		int finished = active & ~_mm_movemask_ps(_mm_cmplt_ps(t, _mm_load_ps(packet.maxDist)));
+		int live = active & ~finished;
+
+		__m128 liveMask = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_and_si128(_mm_set1_epi32(live), laneBits), zero));
+		__m128 moveX = _mm_and_ps(selX, liveMask), moveY = _mm_and_ps(selY, liveMask), moveZ = _mm_and_ps(selZ, liveMask);
+
+		__m128i mapX = _mm_add_epi32(_mm_load_si128((const __m128i*)packet.map[0]), _mm_and_si128(stepX, _mm_castps_si128(moveX)));
+		__m128i mapY = _mm_add_epi32(_mm_load_si128((const __m128i*)packet.map[1]), _mm_and_si128(stepY, _mm_castps_si128(moveY)));
+		__m128i mapZ = _mm_add_epi32(_mm_load_si128((const __m128i*)packet.map[2]), _mm_and_si128(stepZ, _mm_castps_si128(moveZ)));
+		_mm_store_si128((__m128i*)packet.map[0], mapX);
+		_mm_store_si128((__m128i*)packet.map[1], mapY);
+		_mm_store_si128((__m128i*)packet.map[2], mapZ);
+		_mm_store_ps(packet.tMax[0], _mm_add_ps(tMaxX, _mm_and_ps(_mm_load_ps(packet.tDelta[0]), moveX)));
+		_mm_store_ps(packet.tMax[1], _mm_add_ps(tMaxY, _mm_and_ps(_mm_load_ps(packet.tDelta[1]), moveY)));
+		_mm_store_ps(packet.tMax[2], _mm_add_ps(tMaxZ, _mm_and_ps(_mm_load_ps(packet.tDelta[2]), moveZ)));
+
+		// Lanes that left the map finish without a hit. They can only leave on the side
+		// they step towards.
+		__m128i outside = _mm_or_si128(
+			Octant & 1 ? _mm_cmplt_epi32(mapX, zero) : _mm_cmpgt_epi32(mapX, lastX),
+			_mm_or_si128(
+				Octant & 2 ? _mm_cmplt_epi32(mapY, zero) : _mm_cmpgt_epi32(mapY, lastY),
+				Octant & 4 ? _mm_cmplt_epi32(mapZ, zero) : _mm_cmpgt_epi32(mapZ, lastZ)));
+		finished |= live & _mm_movemask_ps(_mm_castsi128_ps(outside));
+		live &= ~finished;
+
+		// Voxel index per lane as World::index() computes it, with finished lanes pointed
+		// at voxel 0 so every load is valid
+		__m128i index;
+		if (morton)
+		{
+			__m128i chunk = mullo(_mm_add_epi32(mullo(_mm_srai_epi32(mapY, CHUNK_SHIFT), depth), _mm_srai_epi32(mapZ, CHUNK_SHIFT)), width);
+			chunk = _mm_add_epi32(chunk, _mm_srai_epi32(mapX, CHUNK_SHIFT));
+			__m128i local = _mm_or_si128(spreadBits(_mm_and_si128(mapX, localMask)), _mm_or_si128(
+				_mm_slli_epi32(spreadBits(_mm_and_si128(mapY, localMask)), 1),
+				_mm_slli_epi32(spreadBits(_mm_and_si128(mapZ, localMask)), 2)));
+			index = _mm_or_si128(_mm_slli_epi32(chunk, 3 * CHUNK_SHIFT), local);
+		}
+		else
+			index = _mm_add_epi32(mullo(_mm_add_epi32(mullo(mapY, depth), mapZ), width), mapX);
+		alignas(16) int voxelIndex[PACKET_SIZE];
+		_mm_store_si128((__m128i*)voxelIndex, _mm_and_si128(index, _mm_cmpgt_epi32(_mm_and_si128(_mm_set1_epi32(live), laneBits), zero)));
+
+		// SSE2 has no gather, but four unconditional loads avoid a branch per lane
+		const uint32_t* voxels = world.voxels.data();
+		__m128i voxel = _mm_set_epi32(voxels[voxelIndex[3]], voxels[voxelIndex[2]], voxels[voxelIndex[1]], voxels[voxelIndex[0]]);
+		int hitLanes = live & ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(voxel, zero)));
+
+		if (hitLanes)
+		{
+			alignas(16) float dist[PACKET_SIZE];
+			_mm_store_ps(dist, t);
+			int onX = _mm_movemask_ps(selX), onY = _mm_movemask_ps(selY);
+
+			for (int lane = 0; lane < PACKET_SIZE; lane++)
+			{
+				if (!(hitLanes & (1 << lane)))
+					continue;
+
+				int axis = onX & (1 << lane) ? 0 : (onY & (1 << lane) ? 1 : 2);
+				const Ray& ray = rays[packet.ray[lane]];
+				RayHit& hit = hits[packet.ray[lane]];
+				hit.hit = true;
+				hit.map = glm::ivec3(packet.map[0][lane], packet.map[1][lane], packet.map[2][lane]);
+				hit.normal = glm::ivec3(0);
+				hit.normal[axis] = -stepAmount[axis];
+				hit.side = axis == 0 ? 0 : (axis == 2 ? 1 : 2);
+				hit.dist = dist[lane];
+				hit.position = ray.origin + ray.dir * dist[lane];
+				hit.voxel = voxels[voxelIndex[lane]];
+			}
+			finished |= hitLanes;
+		}
+
+		// Refill finished lanes from the list, or leave them idle once it runs out
+		active &= ~finished;
+		for (int lane = 0; finished && lane < PACKET_SIZE; lane++)
+		{
+			if (!(finished & (1 << lane)) || next == count)
+				continue;
+			loadLane<Octant>(packet, lane, rays, hits, indices[next++]);
+			active |= 1 << lane;
+		}
+	}
+}
+
+// Sorts one block of rays by direction octant and traces each octant in turn. Sorting per
+// block rather than across the whole batch keeps the rays and hits it touches in cache.
+static void traceBlock(const World& world, const Ray* rays, RayHit* hits, uint32_t begin, uint32_t end)
+{
+	// Rays from outside the map need clipping to it first, which the packets don't do.
+	// They are rare enough to hand to castRay() and leave out of the sort.
+	uint8_t inside[RAY_QUERY_BLOCK];
+	for (uint32_t i = begin; i < end; i++)
+	{
+		inside[i - begin] = world.contains(glm::ivec3(glm::floor(rays[i].origin)));
+		if (!inside[i - begin])
+			hits[i] = castRay(world, rays[i].origin, rays[i].dir, rays[i].maxDist);
+	}
+
+	// Counting sort of ray indices by octant
+	uint32_t offsets[9] = {};
+	for (uint32_t i = begin; i < end; i++)
+		if (inside[i - begin])
+			offsets[rayOctant(rays[i].dir) + 1]++;
+	for (int o = 0; o < 8; o++)
+		offsets[o + 1] += offsets[o];
+
+	uint32_t order[RAY_QUERY_BLOCK];
+	uint32_t fill[8];
+	std::copy(offsets, offsets + 8, fill);
+	for (uint32_t i = begin; i < end; i++)
+		if (inside[i - begin])
+			order[fill[rayOctant(rays[i].dir)]++] = i;
+
+	typedef void (*TraceKernel)(const World&, const Ray*, RayHit*, const uint32_t*, uint32_t);
+	static const TraceKernel kernels[8] = {
+		traceRays<0>, traceRays<1>, traceRays<2>, traceRays<3>, traceRays<4>, traceRays<5>, traceRays<6>, traceRays<7>
+	};
+	for (int o = 0; o < 8; o++)
+		kernels[o](world, rays, hits, &order[offsets[o]], offsets[o + 1] - offsets[o]);
+}
+
+void castRays(const World& world, const Ray* rays, RayHit* hits, size_t count)
+{
+	int blocks = int((count + RAY_QUERY_BLOCK - 1) / RAY_QUERY_BLOCK);
+	auto trace = [&](int block)
+	{
+		uint32_t begin = uint32_t(block) * RAY_QUERY_BLOCK;
+		uint32_t end = uint32_t(std::min<size_t>(count, begin + RAY_QUERY_BLOCK));
+		traceBlock(world, rays, hits, begin, end);
+	};
+
+	if (count < RAY_QUERY_PARALLEL_MIN)
+	{
+		for (int block = 0; block < blocks; block++)
+			trace(block);
+	}
+	else
+	{
+		parallelFor(0, blocks, trace);
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Traversal.h"
+
+#include <cstddef>
+
+// Rays sorted and traced together by one worker
+#define RAY_QUERY_BLOCK 1024
+// Below this many rays a batch is traced on the calling thread
+#define RAY_QUERY_PARALLEL_MIN 4096
+
+struct Ray
+{
+	glm::fvec3 origin;
+	glm::fvec3 dir;
+	float maxDist;
+};
+
+// Batched closest-hit queries for gameplay code: line of sight, projectiles,
+// audio occlusion, picking. hits[i] receives the same result castRay() would
+// give for rays[i], so callers can mix the two freely.
+//
+// Each block of rays is bucketed by direction octant so that neighbouring lanes
+// walk the grid the same way, then traced four at a time with an SSE version of
+// the DDA. Blocks are spread across all cores. Rays from outside the map go through
+// castRay() one at a time.
+void castRays(const World& world, const Ray* rays, RayHit* hits, size_t count);
@@ -0,0 +1,308 @@
+#include "RenderService.h"
+#include "CpuRenderer.h"
+#include "Image.h"
+#include "Net.h"
+#include "Parallel.h"
+#include "SceneFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+struct ServedWorld
+{
+	World world;
+	std::vector<Light> lights;
+	MaterialTable materials;
+	LightGrid lightGrid;
+};
+
+struct ServeJob
+{
+	uint64_t client;
+	RenderRequest request;
+	const ServedWorld* world;
+	Clock::time_point queued;
+};
+
+struct ServeClient
+{
+	Socket socket;
+	std::vector<uint8_t> received; // Start of a request still arriving
+	std::vector<uint8_t> sending;  // Replies the client has not taken yet
+};
+
+struct ServeReply
+{
+	uint64_t client;
+	RenderResponse response;
+	std::vector<uint8_t> png;
+};
+
+static float millisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+}
+
+// "dir/castle.txt" -> "castle"
+static std::string worldId(const char* path)
+{
+	std::string name = path;
+	size_t slash = name.find_last_of("/\\");
+	if (slash != std::string::npos)
+		name = name.substr(slash + 1);
+	return name.substr(0, name.find_last_of('.'));
+}
+
+// Render thread: take everything waiting, trace all of it in one dispatch, encode and hand back
+static void renderPasses(std::mutex& mutex, std::condition_variable& wake, std::deque<ServeJob>& jobs, std::deque<ServeReply>& replies)
+{
+	std::vector<ServeJob> batch;
+	std::vector<std::vector<glm::fvec3>> sums;
+	std::vector<glm::ivec2> rows; // (job, y)
+	std::vector<uint8_t> rgb;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&]() { return !jobs.empty(); });
+			size_t count = std::min<size_t>(jobs.size(), SERVE_MAX_BATCH);
+			batch.assign(jobs.begin(), jobs.begin() + count);
+			jobs.erase(jobs.begin(), jobs.begin() + count);
+		}
+
+		Clock::time_point start = Clock::now();
+		sums.resize(batch.size());
+		rows.clear();
+		for (size_t j = 0; j < batch.size(); j++)
+		{
+			const RenderRequest& request = batch[j].request;
+			sums[j].resize(request.width * request.height);
+			for (int y = 0; y < request.height; y++)
+				rows.push_back({ int(j), y });
+		}
+
+		parallelFor(0, int(rows.size()), [&](int r)
+		{
+			const ServeJob& job = batch[rows[r].x];
+			const RenderRequest& request = job.request;
+			Scene scene = { &job.world->world, &job.world->lights, &job.world->lightGrid, &job.world->materials };
+			Camera camera = { { request.pos[0], request.pos[1], request.pos[2] }, { request.yaw, 0 }, request.fov };
+			sumPathRow(scene, camera, { request.width, request.height }, rows[r].y, request.samples, &sums[rows[r].x][rows[r].y * request.width]);
+		});
+		float renderMs = millisecondsSince(start);
+
+		for (size_t j = 0; j < batch.size(); j++)
+		{
+			const RenderRequest& request = batch[j].request;
+			Clock::time_point encodeStart = Clock::now();
+			ServeReply reply = { batch[j].client };
+			resolveImage(sums[j], { request.width, request.height }, 1.0f / request.samples, rgb);
+			encodePNG({ request.width, request.height }, rgb, reply.png);
+
+			RenderResponse& response = reply.response;
+			response = { SERVE_MAGIC, request.id, SERVE_OK, std::chrono::duration<float, std::milli>(start - batch[j].queued).count(),
+				renderMs, millisecondsSince(encodeStart), uint32_t(batch.size()), uint32_t(reply.png.size()) };
+
+			std::cout << "Request " << request.id << " " << request.world << " " << request.width << "x" << request.height << "@" << request.samples
+				<< ": queue " << response.queueMs << " ms, render " << response.renderMs << " ms, encode " << response.encodeMs
+				<< " ms, batch of " << response.batch << std::endl;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			replies.push_back(std::move(reply));
+		}
+	}
+}
+
+int serveRenders(uint16_t port, const std::vector<const char*>& scenePaths)
+{
+	std::map<std::string, ServedWorld> worlds;
+	for (const char* path : scenePaths)
+	{
+		ServedWorld& served = worlds[worldId(path)];
+		if (!loadScene(path, served.world, served.lights, served.materials))
+			return EXIT_FAILURE;
+		buildLightGrid(served.lightGrid, served.lights, served.world.size);
+		std::cout << "Loaded " << worldId(path) << std::endl;
+	}
+
+	Socket listener = netInit() ? netListen(port) : NET_INVALID_SOCKET;
+	if (listener == NET_INVALID_SOCKET)
+	{
+		std::cout << "ERROR::SERVE::FAILED_TO_LISTEN on port " << port << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "Serving on port " << port << std::endl;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<ServeJob> jobs;
+	std::deque<ServeReply> replies;
+	std::thread renderer(renderPasses, std::ref(mutex), std::ref(wake), std::ref(jobs), std::ref(replies));
+	renderer.detach();
+
+	// Clients are known by a serial number so a reply can never reach a later
+	// connection that happens to reuse the socket. Their sockets are non-blocking:
+	// requests are parsed out of received as they complete and replies wait in
+	// sending until the client takes them, so no client can hold up another.
+	std::map<uint64_t, ServeClient> clients;
+	uint64_t nextClient = 0;
+	std::vector<Socket> readers, writers, readable, writable;
+	std::vector<ServeReply> outgoing;
+
+	while (true)
+	{
+		readers.assign(1, listener);
+		writers.clear();
+		for (const auto& client : clients)
+		{
+			readers.push_back(client.second.socket);
+			if (!client.second.sending.empty())
+				writers.push_back(client.second.socket);
+		}
+		netWait(readers, writers, 5, readable, writable);
+
+		for (Socket socket : readable)
+		{
+			if (socket == listener)
+			{
+				ServeClient client = { netAccept(listener) };
+				if (client.socket == NET_INVALID_SOCKET)
+					continue;
+				if (netSetNonBlocking(client.socket))
+					clients[nextClient++] = client;
+				else
+					netClose(client.socket);
+				continue;
+			}
+
+			auto client = std::find_if(clients.begin(), clients.end(), [&](const std::pair<const uint64_t, ServeClient>& c) { return c.second.socket == socket; });
+			std::vector<uint8_t>& received = client->second.received;
+			bool valid = netRecvAvailable(socket, received);
+			size_t used = 0;
+			for (; valid && received.size() - used >= sizeof(RenderRequest); used += sizeof(RenderRequest))
+			{
+				RenderRequest request;
+				std::memcpy(&request, &received[used], sizeof(request));
+				valid = request.magic == SERVE_MAGIC;
+				if (!valid)
+					break;
+				request.world[SERVE_WORLD_ID - 1] = '\0';
+
+				ServeReply reply = { client->first, { SERVE_MAGIC, request.id, SERVE_OK } };
+				auto world = worlds.find(request.world);
+				bool acceptable = request.width > 0 && request.height > 0 && int64_t(request.width) * request.height <= SERVE_MAX_PIXELS &&
+					request.samples > 0 && request.samples <= SERVE_MAX_SAMPLES;
+				if (!acceptable)
+					reply.response.status = SERVE_BAD_REQUEST;
+				else if (world == worlds.end())
+					reply.response.status = SERVE_UNKNOWN_WORLD;
+				else
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (jobs.size() >= SERVE_MAX_QUEUE)
+					{
+						reply.response.status = SERVE_BUSY;
+					}
+					else
+					{
+						ServeJob job = { client->first, request, &world->second, Clock::now() };
+						jobs.push_back(job);
+						wake.notify_one();
+						continue;
+					}
+				}
+				outgoing.push_back(std::move(reply));
+			}
+
+			if (!valid)
+			{
+				netClose(socket);
+				clients.erase(client);
+			}
+			else
+				received.erase(received.begin(), received.begin() + used);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			while (!replies.empty())
+			{
+				outgoing.push_back(std::move(replies.front()));
+				replies.pop_front();
+			}
+		}
+
+		// Replies for clients that have since gone away are dropped
+		for (const ServeReply& reply : outgoing)
+		{
+			auto client = clients.find(reply.client);
+			if (client == clients.end())
+				continue;
+			std::vector<uint8_t>& sending = client->second.sending;
+			const uint8_t* response = (const uint8_t*)&reply.response;
+			sending.insert(sending.end(), response, response + sizeof(reply.response));
+			sending.insert(sending.end(), reply.png.begin(), reply.png.end());
+		}
+		outgoing.clear();
+
+		// Hand over whatever each client has room for; the rest waits for it to become writable
+		for (auto client = clients.begin(); client != clients.end();)
+		{
+			if (client->second.sending.empty() || netSendAvailable(client->second.socket, client->second.sending))
+			{
+				++client;
+				continue;
+			}
+			netClose(client->second.socket);
+			client = clients.erase(client);
+		}
+	}
+}
+
+int requestRender(const char* host, uint16_t port, const RenderRequest& request, const char* outPath)
+{
+	Socket socket = netInit() ? netConnect(host, port) : NET_INVALID_SOCKET;
+	RenderResponse response;
+	if (socket == NET_INVALID_SOCKET || !netSend(socket, &request, sizeof(request)) ||
+		!netRecv(socket, &response, sizeof(response)) || response.magic != SERVE_MAGIC)
+	{
+		std::cout << "ERROR::SERVE::FAILED_TO_CONNECT " << host << ":" << port << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (response.status != SERVE_OK)
+	{
+		const char* reasons[] = { "ok", "unknown world", "server busy", "bad request" };
+		std::cout << "ERROR::SERVE::REQUEST_FAILED " << (response.status <= SERVE_BAD_REQUEST ? reasons[response.status] : "unknown status") << std::endl;
+		netClose(socket);
+		return EXIT_FAILURE;
+	}
+
+	std::vector<uint8_t> png(response.bytes);
+	bool received = netRecv(socket, png.data(), png.size());
+	netClose(socket);
+
+	std::ofstream file(outPath, std::ios::binary);
+	if (!received || !file.write((const char*)png.data(), png.size()))
+	{
+		std::cout << "ERROR::IMAGE::FAILED_TO_WRITE " << outPath << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "Queue " << response.queueMs << " ms, render " << response.renderMs << " ms, encode " << response.encodeMs
+		<< " ms, batch of " << response.batch << std::endl;
+	return EXIT_SUCCESS;
+}
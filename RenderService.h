@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Requests waiting for a pass beyond this are turned away with SERVE_BUSY
+#define SERVE_MAX_QUEUE 64
+// Requests rendered together in one pass
+#define SERVE_MAX_BATCH 16
+// Largest image and sample count a single request may ask for
+#define SERVE_MAX_PIXELS (1920 * 1080)
+#define SERVE_MAX_SAMPLES 1024
+#define SERVE_WORLD_ID 64
+
+// First field of every message, "RNDR"
+#define SERVE_MAGIC 0x52444E52u
+
+enum ServeStatus
+{
+	SERVE_OK,
+	SERVE_UNKNOWN_WORLD,
+	SERVE_BUSY,
+	SERVE_BAD_REQUEST
+};
+
+// Wire messages, in host byte order. id is chosen by the client and echoed back,
+// so a connection may have several requests outstanding.
+struct RenderRequest
+{
+	uint32_t magic;
+	uint32_t id;
+	char world[SERVE_WORLD_ID]; // Scene file name without directory or extension
+	int32_t width;
+	int32_t height;
+	int32_t samples;
+	float pos[3];
+	float yaw;
+	float fov;
+};
+
+// Followed by bytes of PNG when status is SERVE_OK
+struct RenderResponse
+{
+	uint32_t magic;
+	uint32_t id;
+	uint32_t status;
+	float queueMs;  // Waiting for a pass
+	float renderMs; // The pass this request was part of
+	float encodeMs;
+	uint32_t batch; // Requests in that pass
+	uint32_t bytes;
+};
+
+// Long-lived render daemon. Loads every scene once, then accepts RenderRequests
+// over TCP and answers each with a PNG. One render thread works through the queue
+// in passes: every request waiting when a pass starts (up to SERVE_MAX_BATCH) is
+// split into rows and all rows go through a single parallel dispatch, so small
+// thumbnails share the cores instead of queueing behind each other. Per-request
+// timings come back in the response and are logged. Connections are read and
+// written without blocking, so a client that stalls mid-request or stops reading
+// its replies only delays itself. Runs until killed.
+int serveRenders(uint16_t port, const std::vector<const char*>& scenePaths);
+
+// Client side: sends one request and writes the PNG to outPath. Returns an exit code.
+int requestRender(const char* host, uint16_t port, const RenderRequest& request, const char* outPath);
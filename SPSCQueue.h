@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Each side only writes its own index, so push and pop need no locks or CAS loops:
+// the producer publishes a slot with a release store of m_tail, and the consumer
+// hands it back with a release store of m_head. Capacity must be a power of two.
+template <typename T, size_t Capacity>
+class SPSCQueue
+{
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+
+public:
+	// Producer only. Returns false, leaving value untouched, if the queue is full.
+	bool push(T&& value)
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+			return false;
+		m_slots[tail & (Capacity - 1)] = std::move(value);
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only. Returns false if the queue is empty.
+	bool pop(T& value)
+	{
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire))
+			return false;
+		value = std::move(m_slots[head & (Capacity - 1)]);
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool full() const
+	{
+		return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire) == Capacity;
+	}
+
+private:
+	T m_slots[Capacity];
+
+	// Kept on separate cache lines so the two threads don't false-share
+	alignas(64) std::atomic<size_t> m_head{ 0 };
+	alignas(64) std::atomic<size_t> m_tail{ 0 };
+};
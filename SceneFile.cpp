@@ -0,0 +1,192 @@
+#include "SceneFile.h"
+#include "WorldFile.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+
+// path relative to the directory of scenePath, unless it is absolute
+static std::string relativeTo(const char* scenePath, std::string path)
+{
+	std::string scene = scenePath;
+	size_t slash = scene.find_last_of("/\\");
+	if (slash != std::string::npos && path[0] != '/' && path[0] != '\\' && path.find(':') == std::string::npos)
+		path = scene.substr(0, slash + 1) + path;
+	return path;
+}
+
+// Next whitespace separated token, skipping comments
+static bool nextToken(std::istream& in, std::string& token)
+{
+	while (in >> token)
+	{
+		if (token[0] != '#')
+			return true;
+		in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+	}
+	return false;
+}
+
+bool loadScene(const char* path, World& world, std::vector<Light>& lights, MaterialTable& materials)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cout << "ERROR::SCENE::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+		return false;
+	}
+
+	world.size = glm::ivec3(0);
+	world.voxels.clear();
+	world.layout = WORLD_LINEAR;
+	lights.clear();
+	materials = defaultMaterials();
+	WorldLayout layout = WORLD_LINEAR;
+
+	std::string token;
+	while (nextToken(file, token))
+	{
+		if (token == "size")
+		{
+			file >> world.size.x >> world.size.y >> world.size.z;
+			if (!file || world.size.x <= 0 || world.size.y <= 0 || world.size.z <= 0)
+			{
+				std::cout << "ERROR::SCENE::BAD_SIZE " << path << std::endl;
+				return false;
+			}
+		}
+		else if (token == "voxels")
+		{
+			world.voxels.resize(size_t(world.size.x) * world.size.y * world.size.z);
+			bool valid = !world.voxels.empty();
+			for (uint32_t& voxel : world.voxels)
+			{
+				char* end = nullptr;
+				valid = valid && nextToken(file, token);
+				if (valid)
+					voxel = uint32_t(strtoul(token.c_str(), &end, 10));
+				valid = valid && *end == '\0';
+			}
+			if (!valid)
+			{
+				std::cout << "ERROR::SCENE::BAD_VOXELS " << path << std::endl;
+				return false;
+			}
+		}
+		else if (token == "world")
+		{
+			std::string worldPath;
+			if (!nextToken(file, worldPath))
+			{
+				std::cout << "ERROR::SCENE::BAD_WORLD " << path << std::endl;
+				return false;
+			}
+			if (!loadWorldFile(relativeTo(path, worldPath).c_str(), world))
+				return false;
+		}
+		else if (token == "layout")
+		{
+			std::string name;
+			nextToken(file, name);
+			if (name != "linear" && name != "morton")
+			{
+				std::cout << "ERROR::SCENE::BAD_LAYOUT " << path << std::endl;
+				return false;
+			}
+			layout = name == "morton" ? WORLD_MORTON : WORLD_LINEAR;
+		}
+		else if (token == "light")
+		{
+			Light light;
+			file >> light.position.x >> light.position.y >> light.position.z >> light.intensity
+				>> light.colour.r >> light.colour.g >> light.colour.b >> light.radius;
+			if (!file)
+			{
+				std::cout << "ERROR::SCENE::BAD_LIGHT " << path << std::endl;
+				return false;
+			}
+			lights.push_back(light);
+		}
+		else if (token == "materials")
+		{
+			std::string materialPath;
+			if (!nextToken(file, materialPath))
+			{
+				std::cout << "ERROR::SCENE::BAD_MATERIALS " << path << std::endl;
+				return false;
+			}
+			if (!loadMaterials(relativeTo(path, materialPath).c_str(), materials))
+				return false;
+		}
+		else if (token == "material")
+		{
+			if (!readMaterial(file, materials))
+			{
+				std::cout << "ERROR::SCENE::BAD_MATERIAL " << path << std::endl;
+				return false;
+			}
+		}
+		else
+		{
+			std::cout << "ERROR::SCENE::UNKNOWN_KEYWORD " << token << " in " << path << std::endl;
+			return false;
+		}
+	}
+
+	if (world.voxels.empty())
+	{
+		std::cout << "ERROR::SCENE::NO_VOXELS " << path << std::endl;
+		return false;
+	}
+
+	setWorldLayout(world, layout);
+	return true;
+}
+
+bool saveScene(const char* path, const World& world, const std::vector<Light>& lights, const MaterialTable& materials)
+{
+	std::ofstream file(path);
+	if (!file)
+		return false;
+
+	file << "size " << world.size.x << " " << world.size.y << " " << world.size.z << "\n";
+	if (world.layout == WORLD_MORTON)
+		file << "layout morton\n";
+	file << "# One row of x per line, z then y outermost\nvoxels\n";
+	for (int y = 0; y < world.size.y; y++)
+		for (int z = 0; z < world.size.z; z++)
+		{
+			for (int x = 0; x < world.size.x; x++)
+				file << (x ? " " : "") << world.voxels[world.index({ x, y, z })];
+			file << "\n";
+		}
+
+	for (const Light& light : lights)
+		file << "light " << light.position.x << " " << light.position.y << " " << light.position.z << " " << light.intensity << " "
+			<< light.colour.r << " " << light.colour.g << " " << light.colour.b << " " << light.radius << "\n";
+	writeMaterials(file, materials);
+
+	return (bool)file;
+}
+
+static void hashBytes(uint64_t& hash, const void* data, size_t size)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+}
+
+uint64_t sceneHash(const World& world, const std::vector<Light>& lights, const MaterialTable& materials)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	hashBytes(hash, &world.size, sizeof(world.size));
+	hashBytes(hash, world.voxels.data(), world.voxels.size() * sizeof(uint32_t));
+	hashBytes(hash, lights.data(), lights.size() * sizeof(Light));
+	hashBytes(hash, materials.data(), materials.size() * sizeof(Material));
+	return hash;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Lights.h"
+#include "Materials.h"
+#include "World.h"
+
+// Plain text world description, for batch jobs and tools:
+//
+//   # comment to end of line
+//   size <x> <y> <z>
+//   voxels <x * y * z values, x fastest, then z, then y>
+//   world <path>
+//   layout <linear|morton>
+//   light <px> <py> <pz> <intensity> <r> <g> <b> <radius>
+//   materials <path>
+//   material <id> <r> <g> <b> <emissive r> <g> <b> <roughness>
+//
+// size must come before voxels. world instead takes the size and voxels from a
+// binary world file (see WorldFile.h), relative to the scene file. Any number of
+// light lines may follow. layout picks how the loaded world is stored in memory,
+// see WorldLayout; it is linear unless given. Materials start as defaultMaterials().
+// materials replaces them with a material file (see Materials.h), relative to the
+// scene file, and material lines change one entry each.
+// Errors are printed and leave world, lights and materials in an unspecified state.
+bool loadScene(const char* path, World& world, std::vector<Light>& lights, MaterialTable& materials);
+bool saveScene(const char* path, const World& world, const std::vector<Light>& lights, const MaterialTable& materials);
+
+// 64-bit FNV-1a over the world, lights and materials, so separate processes can
+// check they loaded the same scene
+uint64_t sceneHash(const World& world, const std::vector<Light>& lights, const MaterialTable& materials);
@@ -6,10 +6,46 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include "AmbientOcclusion.h"
+#include "BatchRender.h"
+#include "Benchmark.h"
+#include "Camera.h"
+#include "CameraPath.h"
+#include "ChunkCache.h"
+#include "ChunkFeedback.h"
+#include "ChunkLoader.h"
+#include "ChunkPrefetch.h"
+#include "Collision.h"
+#include "CpuRenderer.h"
+#include "Denoise.h"
+#include "FixedTraversal.h"
+#include "FrameCapture.h"
+#include "GoldenImage.h"
+#include "Image.h"
+#include "Lights.h"
+#include "LightVolume.h"
+#include "Materials.h"
+#include "RenderService.h"
+#include "SceneFile.h"
+#include "SPSCQueue.h"
+#include "TileRender.h"
+#include "TraversalFuzz.h"
+#include "VideoWriter.h"
+#include "Traversal.h"
+#include "VoxelPyramid.h"
+#include "World.h"
+#include "WorldGen.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
 #include <string>
 #include <iostream>
+#include <memory>
 #include <fstream>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 #define W_WIDTH 1280
@@ -23,8 +59,30 @@
 #define TEX_WIDTH 64
 #define TEX_HEIGHT 64
 
-#define MOVESPEED 0.02f
-#define ROTSPEED 0.1f
+#define MOVESPEED 1.2f // Voxels per second
+#define ROTSPEED 0.0017f // Radians per pixel of mouse motion
+
+// Simulation runs at a fixed rate independent of the render rate
+#define SIM_RATE 120
+#define SIM_DT (1.0f / SIM_RATE)
+#define SIM_MAX_STEPS 8
+#define PLAYER_EXTENT 0.2f
+
+#define TITLE_INTERVAL 1000
+
+#define LOD_PIXELS 1.0f // Switch to a coarser level once a cell covers fewer pixels than this
+
+#define CHUNK_BUDGET_KB 16384 // Default GPU memory for world data, see --chunk-budget
+
+#define RECORD_PATH "capture.y4m" // Default for --record
+#define RECORD_FPS 60
+
+#define EDIT_REACH 8.0f
+#define PLACE_VOXEL 2
+
+// A streamed world is kept in memory this many voxels across around the player, see --world
+#define WORLD_WINDOW 64
+#define STREAM_START_HEIGHT 8 // Voxels above the ground a streamed world starts the player
 
 // x -->, z down, y up
 Uint32 worldMap[] =
@@ -130,13 +188,25 @@ Uint32 worldMap[] =
   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9
 };
 
+// Position, intensity, colour, radius
+std::vector<Light> lights =
+{
+	{ { 6.5, 2.5, 3.5 }, 1.0, { 1.0, 0.9, 0.8 }, 10 },
+	{ { 5.5, 2.5, 9.5 }, 1.0, { 0.8, 0.8, 1.0 }, 10 },
+	{ { 20.5, 2.5, 2.5 }, 1.0, { 1.0, 0.7, 0.4 }, 10 },
+	{ { 12.5, 2.5, 15.5 }, 1.0, { 0.6, 1.0, 0.6 }, 10 },
+	{ { 4.5, 2.5, 18.5 }, 1.0, { 1.0, 1.0, 1.0 }, 10 }
+};
+
+// Indexed by voxel ID, loaded from MATERIAL_FILE
+MaterialTable materials;
+
 SDL_Window* window = nullptr;
 SDL_GLContext glContext;
 SDL_Event event;
 #define NUM_KEYS 128
 #define NUM_MOUSE 5
 bool m_keys[NUM_KEYS], m_mouse[NUM_MOUSE];
-float frameTime;
 double xlast;
 
 glm::fvec3 pos, dir;
@@ -150,14 +220,240 @@ struct Mouse
 	bool first = true;
 } mouse_move;
 
-unsigned int shaderID;
+World world;
+VoxelPyramid pyramid;
+
+// One voxel edit and the pyramid cells it changed, copied out so the render thread
+// never reads world state. The chunk loader redoes the AO around it.
+struct WorldEdit
+{
+	glm::ivec3 map;
+	uint32_t voxel;
+	uint32_t lod[LOD_LEVELS]; // Pyramid cell above the voxel at each level, from 1; unused for streamed worlds
+};
 
-glm::fmat3 rotationMatrix(glm::fvec3 axis, float angle);
-void CompileShaders(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr);
+// Everything the render thread needs to draw a frame, published by the main thread
+#define FRAME_QUEUE_SIZE 4
+struct FrameSnapshot
+{
+	glm::fvec3 pos;
+	glm::fvec3 velocity; // Of the last simulation step, for chunk prefetch
+	glm::fvec2 theta;
+	bool useLightVolume = false;
+	bool useLOD = true;
+	bool useFixedDDA = false;
+	bool pathTrace = false;
+	bool denoised = false;
+	bool resetAccumulation = false;
+	bool recording = false;  // Capture at RECORD_FPS
+	bool screenshot = false; // Capture this frame once
+	int goldenStep = -1;     // See --golden
+	std::vector<WorldEdit> edits;
+	std::vector<Light> lights;      // Every light and the culling grid, when they changed
+	std::vector<uint32_t> lightGrid;
+};
+
+// Tags for FrameCapture, deciding what the consumer does with a frame
+enum CaptureTag
+{
+	CAPTURE_SCREENSHOT,
+	CAPTURE_RECORDING,
+	CAPTURE_GOLDEN
+};
+
+unsigned int shaderID, denoiseID;
+
+unsigned int CompileShaders(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr);
 void checkCompileErrors(GLuint shader, std::string type);
+int renderHeadless(const Scene& scene, const Camera& camera, int samples, bool denoised, const char* outPath);
+bool parseBatchOptions(int argc, char* argv[], int first, BatchSettings& settings);
+int runGoldenChecks(const Scene& scene, const std::vector<CameraKey>& poses, const std::vector<std::vector<uint8_t>>& glImages,
+	const char* dir, bool update, float fov);
 
 int main(int argc, char* argv[])
 {
+	// ========== RAY CASTING SETUP ==========
+
+	pos = { 6, 2, 3 };
+	dir = { 0, 0, -1 };
+	rot = rotationMatrix(glm::vec3(0, 1, 0), 0);
+	theta = glm::fvec2(0);
+
+	float fov = M_PI / 3.f;
+
+	// ========== WORLD SETUP ==========
+
+	world.size = glm::ivec3(MAP_WIDTH, MAP_DEPTH, MAP_HEIGHT);
+	world.voxels.assign(worldMap, worldMap + _countof(worldMap));
+
+	// Pass --layout morton to store voxels in Z-order within each chunk, see WorldLayout.
+	// Scene files pick their own with the layout keyword.
+	WorldLayout layout = WORLD_LINEAR;
+	for (int i = 1; i + 1 < argc; i++)
+		if (std::string(argv[i]) == "--layout")
+			layout = std::string(argv[i + 1]) == "morton" ? WORLD_MORTON : WORLD_LINEAR;
+	setWorldLayout(world, layout);
+
+	if (!loadMaterials(MATERIAL_FILE, materials))
+	{
+		std::cout << "Using the default materials" << std::endl;
+		materials = defaultMaterials();
+	}
+
+	LightGrid lightGrid;
+	buildLightGrid(lightGrid, lights, world.size);
+
+	Scene scene = { &world, &lights, &lightGrid, &materials };
+
+	// ========== HEADLESS MODES ==========
+
+	// --pathtrace <samples> <out.ppm> [--denoise]: converge the start view on the CPU without a window
+	if (argc >= 4 && std::string(argv[1]) == "--pathtrace")
+		return renderHeadless(scene, { pos, theta, fov }, atoi(argv[2]), argc >= 5 && std::string(argv[4]) == "--denoise", argv[3]);
+
+	// --export-scene <scene.txt>: write the built-in world, lights and materials as a scene file for batch jobs
+	if (argc >= 3 && std::string(argv[1]) == "--export-scene")
+		return saveScene(argv[2], world, lights, materials) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	// --batch <scene.txt> <path.txt> <out dir> [--size WxH] [--samples N] [--denoise] [--shard i/N]:
+	// render a camera path to numbered images, see BatchRender.h
+	if (argc >= 5 && std::string(argv[1]) == "--batch")
+	{
+		BatchSettings settings = { argv[2], argv[3], argv[4] };
+		if (!parseBatchOptions(argc, argv, 5, settings))
+			return EXIT_FAILURE;
+		return renderBatch(settings, fov);
+	}
+
+	// --coordinate <scene.txt> <path.txt> <out dir> <port> [--size WxH] [--samples N] [--shard i/N]:
+	// as --batch, but hand tiles of each frame to --worker processes, see TileRender.h
+	if (argc >= 6 && std::string(argv[1]) == "--coordinate")
+	{
+		BatchSettings settings = { argv[2], argv[3], argv[4] };
+		if (!parseBatchOptions(argc, argv, 6, settings))
+			return EXIT_FAILURE;
+		if (settings.denoised)
+		{
+			std::cout << "ERROR::TILES::DENOISE_NOT_SUPPORTED" << std::endl;
+			return EXIT_FAILURE;
+		}
+		return coordinateTiles(settings, fov, uint16_t(atoi(argv[5])));
+	}
+
+	// --worker <scene.txt> <host> <port>: render tiles for a coordinator
+	if (argc >= 5 && std::string(argv[1]) == "--worker")
+		return runTileWorker(argv[2], argv[3], uint16_t(atoi(argv[4])));
+
+	// --serve <port> <scene.txt>...: render daemon answering requests for the given worlds, see RenderService.h
+	if (argc >= 4 && std::string(argv[1]) == "--serve")
+		return serveRenders(uint16_t(atoi(argv[2])), std::vector<const char*>(argv + 3, argv + argc));
+
+	// --request <host> <port> <world> <x> <y> <z> <yaw> <out.png> [--size WxH] [--samples N]:
+	// ask a --serve daemon for one image
+	if (argc >= 10 && std::string(argv[1]) == "--request")
+	{
+		BatchSettings settings = {};
+		if (!parseBatchOptions(argc, argv, 10, settings))
+			return EXIT_FAILURE;
+
+		RenderRequest request = { SERVE_MAGIC, 0, {}, settings.size.x, settings.size.y, settings.samples,
+			{ float(atof(argv[5])), float(atof(argv[6])), float(atof(argv[7])) }, float(atof(argv[8])), fov };
+		std::string(argv[4]).copy(request.world, SERVE_WORLD_ID - 1);
+		return requestRender(argv[2], uint16_t(atoi(argv[3])), request, argv[9]);
+	}
+
+	// --generate <out.vxw> <x> <y> <z> [seed]: write a procedural world for large scale tests, see WorldGen.h.
+	// Scene files pick it up with a "world <out.vxw>" line, and --world streams it into the interactive view.
+	if (argc >= 6 && std::string(argv[1]) == "--generate")
+	{
+		WorldGenSettings settings = { glm::ivec3(atoi(argv[3]), atoi(argv[4]), atoi(argv[5])), argc >= 7 ? uint32_t(atoi(argv[6])) : 1 };
+		return generateWorldFile(argv[2], settings);
+	}
+
+	// --bench [out.json] [--filter <text>]: time the kernels on one core, see Benchmark.h
+	if (argc >= 2 && std::string(argv[1]) == "--bench")
+	{
+		const char* outPath = nullptr;
+		const char* filter = nullptr;
+		for (int i = 2; i < argc; i++)
+		{
+			if (std::string(argv[i]) == "--filter" && i + 1 < argc)
+				filter = argv[++i];
+			else
+				outPath = argv[i];
+		}
+		return runBenchmarks(outPath, filter);
+	}
+
+	// --fuzz-dda [rays] [seed]: check the CPU traversal kernels against an exact reference, see TraversalFuzz.h
+	if (argc >= 2 && std::string(argv[1]) == "--fuzz-dda")
+		return fuzzTraversal(argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 1000000, argc >= 4 ? uint32_t(atoi(argv[3])) : 1);
+
+	// --golden <poses.txt> <golden dir> [--update]: render each key of a camera path file
+	// with the GL raster and path tracing modes, then with the CPU path tracer, and check
+	// the images against goldens, see GoldenImage.h. The window opens at GOLDEN_WIDTH x
+	// GOLDEN_HEIGHT for it. With --update the goldens are written first: raster ones
+	// from GL, as only GL rasterises, and path traced ones from the CPU reference. The
+	// checked in set is run with --golden golden/poses.txt golden.
+	std::vector<CameraKey> goldenPoses;
+	bool goldenUpdate = false;
+	if (argc >= 4 && std::string(argv[1]) == "--golden")
+	{
+		if (!loadCameraPath(argv[2], goldenPoses))
+			return EXIT_FAILURE;
+		goldenUpdate = argc >= 5 && std::string(argv[4]) == "--update";
+	}
+	glm::ivec2 windowSize = goldenPoses.empty() ? glm::ivec2(W_WIDTH, W_HEIGHT) : glm::ivec2(GOLDEN_WIDTH, GOLDEN_HEIGHT);
+
+	// ========== STREAMED WORLD ==========
+
+	// Pass --world <file.vxw> to explore a world file in place of the built-in map. The GPU
+	// streams its chunks straight from the file, so it can be far larger than a World can
+	// hold. world then only holds the WORLD_WINDOW voxels around the player, from
+	// worldOrigin on, for collision and picking, and is read again as the player moves
+	// away from its middle. Streamed worlds have no lights and no LOD pyramid, both of
+	// which cover the whole world.
+	const char* streamPath = nullptr;
+	for (int i = 1; i + 1 < argc; i++)
+		if (std::string(argv[i]) == "--world")
+			streamPath = argv[i + 1];
+
+	StreamedWorld streamedWorld;
+	glm::ivec3 worldSize = world.size, worldOrigin(0);
+	auto moveWindow = [&](glm::fvec3 centre, bool force)
+	{
+		glm::ivec3 extent = glm::min(glm::ivec3(WORLD_WINDOW), worldSize);
+		glm::ivec3 origin = glm::clamp(glm::ivec3(glm::floor(centre)) - extent / 2, glm::ivec3(0), worldSize - extent);
+		if (!force && glm::all(glm::lessThanEqual(glm::abs(origin - worldOrigin), glm::ivec3(WORLD_WINDOW / 4))))
+			return true;
+		if (!streamedWorld.read(origin, extent, world))
+			return false;
+		setWorldLayout(world, layout);
+		worldOrigin = origin;
+		return true;
+	};
+
+	if (streamPath)
+	{
+		if (!streamedWorld.open(streamPath))
+			return EXIT_FAILURE;
+		worldSize = streamedWorld.size();
+
+		// Start over the middle of the world, above its highest voxel there
+		World column;
+		glm::ivec3 middle = worldSize / 2;
+		if (!streamedWorld.read({ middle.x, 0, middle.z }, { 1, worldSize.y, 1 }, column))
+			return EXIT_FAILURE;
+		int ground = worldSize.y - 1;
+		while (ground > 0 && column.at({ 0, ground, 0 }) == 0)
+			ground--;
+		pos = glm::fvec3(middle.x + 0.5f, ground + STREAM_START_HEIGHT + 0.5f, middle.z + 0.5f);
+
+		if (!moveWindow(pos, true))
+			return EXIT_FAILURE;
+		lights.clear();
+		buildLightGrid(lightGrid, lights, world.size);
+	}
 
 	// ========== SDL2 BOILERPLATE ==========
 
@@ -175,7 +471,7 @@ int main(int argc, char* argv[])
 	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
 
 	// Create window
-	window = SDL_CreateWindow("Voxel Ray Tracer", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, W_WIDTH, W_HEIGHT, SDL_WINDOW_OPENGL);
+	window = SDL_CreateWindow("Voxel Ray Tracer", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, windowSize.x, windowSize.y, SDL_WINDOW_OPENGL);
 	glContext = SDL_GL_CreateContext(window);
 
 	// Capture mouse
@@ -187,23 +483,25 @@ int main(int argc, char* argv[])
 
 	atexit(SDL_Quit);
 
-	glViewport(0, 0, W_WIDTH, W_HEIGHT);
+	glViewport(0, 0, windowSize.x, windowSize.y);
 	glDisable(GL_DEPTH_TEST);
 	glDisable(GL_CULL_FACE);
 
-	// ========== RAY CASTING SETUP ==========
-
-	pos = { 6, 2, 3 };
-	dir = { 0, 0, -1 };
-	rot = rotationMatrix(glm::vec3(0, 1, 0), 0);
-	theta = glm::fvec2(0);
+	// ========== TIMING ==========
 
-	float fov = M_PI / 3.f;
+	// Pass --uncapped to disable vsync, e.g. for benchmark runs
+	bool uncapped = !goldenPoses.empty();
+	for (int i = 1; i < argc; i++)
+		if (std::string(argv[i]) == "--uncapped")
+			uncapped = true;
+	SDL_GL_SetSwapInterval(uncapped ? 0 : 1);
 
-	// ========== TIMING ==========
+	Uint64 frequency = SDL_GetPerformanceFrequency();
+	Uint64 lastCounter = SDL_GetPerformanceCounter();
+	double accumulator = 0; // Real time not yet consumed by simulation steps, in seconds
 
-	double time = 0; //time of current frame
-	double oldTime = 0; //time of previous frame
+	// Simulation state from the previous step, blended with the current one for rendering
+	glm::fvec3 prevPos = pos;
 
 	// ========== TEXTURE LOADING ==========
 
@@ -234,26 +532,97 @@ int main(int argc, char* argv[])
 		stbi_image_free(image);
 	}
 
-	// Pack texture and world map data to be send as SSBO
-	Uint32 data[sizeof(texture) + sizeof(worldMap)];
-	memcpy(data, texture, sizeof(texture));
-	memcpy(&data[_countof(texture)], worldMap, sizeof(worldMap));
+	// ========== LIGHTING SETUP ==========
+
+	// Coarse levels of the world for distant primary rays
+	if (!streamPath)
+		buildPyramid(pyramid, world);
+	bool useLOD = !streamPath;
+	bool useFixedDDA = false;
+
+	// Bake irradiance from the static lights, kept up to date by a worker thread. With no
+	// lights in a streamed world it only ever holds darkness, so the window will do.
+	LightVolume lightVolume(world, lights);
+	bool useLightVolume = false;
+
+	// Progressive path tracing state
+	bool pathTrace = false;
+	Uint32 titleTime = 0;
+	uint64_t titleSamples = 0;
+
+	// F12 saves a screenshot, C starts and stops recording at RECORD_FPS, see FrameCapture.h.
+	// Pass --record <path> to choose where video goes: .y4m, or raw NV12 for anything
+	// else, e.g. a named pipe into an encoder.
+	bool recording = false;
+	const char* recordPath = RECORD_PATH;
+	for (int i = 1; i + 1 < argc; i++)
+		if (std::string(argv[i]) == "--record")
+			recordPath = argv[i + 1];
+
+	// World voxels and their face AO are streamed into a fixed pool on demand, see
+	// ChunkCache.h. Pass --chunk-budget <KiB> to cap the GPU memory that grows with the
+	// world. The pyramid, the light volume (RGB16F), the page table directory and the
+	// feedback's seen bits cover the whole world and stay resident, so the pool gets
+	// what they leave of it. The feedback list is reserved for as many slots as the
+	// budget could buy.
+	size_t chunkBudget = size_t(CHUNK_BUDGET_KB) * 1024;
+	for (int i = 1; i + 1 < argc; i++)
+		if (std::string(argv[i]) == "--chunk-budget")
+			chunkBudget = size_t(atoi(argv[i + 1])) * 1024;
+	glm::ivec3 volumeDims = lightVolume.dims();
+	glm::ivec3 worldChunks = (worldSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	size_t chunkCount = size_t(worldChunks.x) * worldChunks.y * worldChunks.z;
+	size_t maxSlots = std::min(chunkCount, chunkBudget / (CHUNK_SLOT_BYTES + PAGE_BYTES));
+	size_t residentBytes = pyramid.cells.size() * sizeof(uint32_t) + size_t(volumeDims.x) * volumeDims.y * volumeDims.z * 3 * sizeof(uint16_t) +
+		ChunkCache::directoryBytes(worldSize) + ChunkFeedback::residentBytes(maxSlots + CHUNK_LOADS_IN_FLIGHT, chunkCount);
+	if (residentBytes >= chunkBudget)
+		std::cout << "ERROR::CHUNKS::BUDGET_TOO_SMALL " << residentBytes / 1024 << " KiB of world data stays resident, leaving the pool one chunk" << std::endl;
+	ChunkCache chunkCache(worldSize, chunkBudget - std::min(residentBytes, chunkBudget));
+	std::unique_ptr<ChunkLoader> chunkLoader(streamPath ? new ChunkLoader(streamPath, layout, chunkCache.dims()) : new ChunkLoader(world, chunkCache.dims()));
+	glm::ivec3 chunkDims = chunkCache.dims();
+	glm::ivec3 pageDims = ChunkCache::pageDims(chunkDims);
+	// Room to list every chunk the pool can hold and every load on its way in
+	size_t feedbackCapacity = chunkCache.slotCount() + CHUNK_LOADS_IN_FLIGHT;
 
 	// ========== SHADER COMPILATION ==========
 
 	// Compile
-	CompileShaders("./shader.vert", "./shader.frag");
+	shaderID = CompileShaders("./shader.vert", "./shader.frag");
+	denoiseID = CompileShaders("./shader.vert", "./denoise.frag");
 
 	// Uniforms
 	int uniform_w_size = glGetUniformLocation(shaderID, "w_size");
 	int uniform_fov = glGetUniformLocation(shaderID, "fov");
 	int uniform_pos = glGetUniformLocation(shaderID, "pos");
 	int uniform_theta = glGetUniformLocation(shaderID, "theta");
+	int uniform_light_grid_dims = glGetUniformLocation(shaderID, "light_grid_dims");
+	int uniform_light_volume = glGetUniformLocation(shaderID, "light_volume");
+	int uniform_light_volume_size = glGetUniformLocation(shaderID, "light_volume_size");
+	int uniform_use_light_volume = glGetUniformLocation(shaderID, "use_light_volume");
+	int uniform_path_trace = glGetUniformLocation(shaderID, "path_trace");
+	int uniform_sample_index = glGetUniformLocation(shaderID, "sample_index");
+	int uniform_use_lod = glGetUniformLocation(shaderID, "use_lod");
+	int uniform_fixed_dda = glGetUniformLocation(shaderID, "fixed_dda");
+	int uniform_step_width = glGetUniformLocation(denoiseID, "step_width");
+	int uniform_sigma_colour = glGetUniformLocation(denoiseID, "sigma_colour");
+
+	glUseProgram(denoiseID);
+	glUniform1i(glGetUniformLocation(denoiseID, "colour_tex"), 1);
+	glUniform1i(glGetUniformLocation(denoiseID, "guide_tex"), 2);
 
 	// Set static uniforms
 	glUseProgram(shaderID);
-	glUniform2i(uniform_w_size, W_WIDTH, W_HEIGHT);
+	glUniform2i(uniform_w_size, windowSize.x, windowSize.y);
 	glUniform1f(uniform_fov, fov);
+	glUniform1f(glGetUniformLocation(shaderID, "lod_pixels"), LOD_PIXELS);
+	glUniform3iv(glGetUniformLocation(shaderID, "lod_dims"), LOD_LEVELS, &pyramid.dims[0].x);
+	glUniform1iv(glGetUniformLocation(shaderID, "lod_offsets"), LOD_LEVELS, pyramid.offsets);
+	glUniform3i(glGetUniformLocation(shaderID, "world_size"), worldSize.x, worldSize.y, worldSize.z);
+	glUniform3i(glGetUniformLocation(shaderID, "chunk_dims"), chunkDims.x, chunkDims.y, chunkDims.z);
+	glUniform3i(glGetUniformLocation(shaderID, "page_dims"), pageDims.x, pageDims.y, pageDims.z);
+	glUniform1ui(glGetUniformLocation(shaderID, "page_pool_offset"), chunkCache.directorySize());
+	glUniform1ui(glGetUniformLocation(shaderID, "feedback_capacity"), GLuint(feedbackCapacity));
+	glUniform1i(glGetUniformLocation(shaderID, "morton_layout"), layout == WORLD_MORTON);
 
 	// ========== VERTEX SETUP ==========
 
@@ -269,11 +638,19 @@ int main(int argc, char* argv[])
 		1, 2, 3   // Second Triangle
 	};
 
-	unsigned int VBO, VAO, EBO, SSBO;
+	unsigned int VBO, VAO, EBO, SSBO, lightSSBO, lightGridSSBO, accumSSBO, lodSSBO, chunkPoolSSBO, pageTableSSBO, feedbackSSBO, materialSSBO;
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
 	glGenBuffers(1, &EBO);
 	glGenBuffers(1, &SSBO);
+	glGenBuffers(1, &lightSSBO);
+	glGenBuffers(1, &lightGridSSBO);
+	glGenBuffers(1, &accumSSBO);
+	glGenBuffers(1, &lodSSBO);
+	glGenBuffers(1, &chunkPoolSSBO);
+	glGenBuffers(1, &pageTableSSBO);
+	glGenBuffers(1, &feedbackSSBO);
+	glGenBuffers(1, &materialSSBO);
 
 	glBindVertexArray(VAO);
 
@@ -283,12 +660,66 @@ int main(int argc, char* argv[])
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
-	// Add map data to SSBO
+	// Add texture data to SSBO
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, SSBO);
 
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(data), data, GL_STATIC_READ);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(texture), texture, GL_STATIC_DRAW);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, SSBO);
 
+	// Add the material table to SSBO
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(Material), materials.data(), GL_STATIC_READ);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, materialSSBO);
+
+	// Chunk pool starts empty with every page missing; the first frames' feedback fills it
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, chunkPoolSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, chunkCache.slotCount() * CHUNK_SLOT_BYTES, nullptr, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, chunkPoolSSBO);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, pageTableSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, chunkCache.pageTable().size() * sizeof(uint32_t), chunkCache.pageTable().data(), GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, pageTableSSBO);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, feedbackSSBO);
+	size_t feedbackBytes = ChunkFeedback::bufferBytes(feedbackCapacity, chunkCount);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, feedbackBytes, std::vector<uint8_t>(feedbackBytes, 0).data(), GL_DYNAMIC_COPY);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, feedbackSSBO);
+
+	// Add the coarse pyramid levels to SSBO
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, lodSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, pyramid.cells.size() * sizeof(uint32_t), pyramid.cells.data(), GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, lodSSBO);
+
+	// Float accumulation buffer for progressive path tracing
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, accumSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, windowSize.x * windowSize.y * sizeof(glm::fvec4), nullptr, GL_DYNAMIC_COPY);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, accumSSBO);
+
+	// Add lights and their culling grid to SSBOs
+	glUniform3i(uniform_light_grid_dims, lightGrid.dims.x, lightGrid.dims.y, lightGrid.dims.z);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, lights.size() * sizeof(Light), lights.data(), GL_STATIC_READ);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, lightSSBO);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightGridSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, lightGrid.data.size() * sizeof(uint32_t), lightGrid.data.data(), GL_STATIC_READ);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, lightGridSSBO);
+
+	// Light volume texture, filled in as the baker finishes regions
+	unsigned int lightVolumeTex;
+	glGenTextures(1, &lightVolumeTex);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_3D, lightVolumeTex);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, volumeDims.x, volumeDims.y, volumeDims.z, 0, GL_RGB, GL_FLOAT, nullptr);
+	glUniform1i(uniform_light_volume, 0);
+	glUniform3f(uniform_light_volume_size, float(volumeDims.x * LIGHT_VOLUME_CELL), float(volumeDims.y * LIGHT_VOLUME_CELL), float(volumeDims.z * LIGHT_VOLUME_CELL));
+
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(0);
 
@@ -297,16 +728,348 @@ int main(int argc, char* argv[])
 
 	glBindVertexArray(0);
 
+	// ========== DENOISER SETUP ==========
+
+	// The path tracer renders colour and its guide into sceneFBO, then the a-trous
+	// passes ping-pong between two textures with the last pass going to the screen
+	unsigned int sceneFBO, sceneTex, guideTex, pingFBO[2], pingTex[2];
+	auto createTarget = [&windowSize](unsigned int& tex, GLenum format)
+	{
+		glGenTextures(1, &tex);
+		glBindTexture(GL_TEXTURE_2D, tex);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, format, windowSize.x, windowSize.y, 0, GL_RGBA, GL_FLOAT, nullptr);
+	};
+
+	createTarget(sceneTex, GL_RGBA16F);
+	createTarget(guideTex, GL_RGBA32F);
+	glGenFramebuffers(1, &sceneFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sceneTex, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, guideTex, 0);
+	GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+
+	glGenFramebuffers(2, pingFBO);
+	for (int i = 0; i < 2; i++)
+	{
+		createTarget(pingTex[i], GL_RGBA16F);
+		glBindFramebuffer(GL_FRAMEBUFFER, pingFBO[i]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingTex[i], 0);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	bool denoised = false;
+
+
+	// ========== RENDER THREAD ==========
+
+	// From here the render thread owns the GL context. The main thread polls input and
+	// runs the simulation, then hands each frame over as an immutable FrameSnapshot so
+	// a slow swap never stalls input and a slow simulation step never stalls drawing.
+	SPSCQueue<FrameSnapshot, FRAME_QUEUE_SIZE> frameQueue;
+	std::atomic<bool> rendering(true);
+	std::atomic<Uint32> renderedSpp(0);
+	std::atomic<uint64_t> renderedSamples(0);
+
+	// Golden runs take a raster then a path traced image of each pose, two steps per pose
+	std::atomic<int> goldenDone(0);
+	std::vector<std::vector<uint8_t>> goldenImages(goldenPoses.size() * 2);
+
+	auto renderLoop = [&]()
+	{
+		SDL_GL_MakeCurrent(window, glContext);
+
+		FrameSnapshot frame, next;
+		bool haveFrame = false;
+		bool screenshot = false;
+		Uint32 sampleIndex = 0;
+
+		// Screenshots are read back as RGB and saved as PNG. Recordings are read back as
+		// RGBA and converted to YUV on the capture threads; the file is opened when
+		// recording first starts.
+		std::unique_ptr<VideoWriter> video;
+		FrameCapture capture(windowSize, [&video, &goldenImages](const CapturedFrame& captured)
+		{
+			int stride = -captured.size.x * captured.channels;
+			const uint8_t* top = captured.pixels ? captured.pixels - ptrdiff_t(captured.size.y - 1) * stride : nullptr;
+			if (captured.tag == CAPTURE_RECORDING)
+			{
+				video->submit(captured.index, top, stride, captured.repeat);
+				return;
+			}
+			// A failed golden readback leaves its image empty, which fails the check
+			if (!captured.pixels)
+				return;
+			if (captured.tag == CAPTURE_GOLDEN)
+			{
+				std::vector<uint8_t>& image = goldenImages[captured.index];
+				image.resize(captured.size.x * captured.size.y * 3);
+				for (int y = 0; y < captured.size.y; y++)
+					memcpy(&image[y * captured.size.x * 3], top + ptrdiff_t(y) * stride, captured.size.x * 3);
+				return;
+			}
+
+			std::ostringstream path;
+			path << "screenshot_" << std::setw(5) << std::setfill('0') << captured.index << ".png";
+			if (!writePNG(path.str().c_str(), captured.size, top, stride))
+				std::cout << "ERROR::IMAGE::FAILED_TO_WRITE " << path.str() << std::endl;
+		});
+		uint64_t recordingDropped = 0;
+
+		// Video runs on a RECORD_FPS clock, which only advances while recording. A frame
+		// is captured when the clock says one is due, and held for as many video frames
+		// as came due since the last capture, so playback speed never depends on the
+		// frame rate.
+		double recordTime = 0;
+		uint64_t recordFrames = 0; // Video frames covered by captures so far
+		Uint64 recordLast = 0;
+
+		// Feedback is read back a frame or two late. The cache only moves on when a new
+		// copy arrives, and a golden image waits for one from its own pose.
+		ChunkFeedback feedback(feedbackSSBO, feedbackCapacity);
+		std::vector<uint32_t> touchedChunks;
+		int feedbackStep = -1;
+		bool feedbackComplete = false;
+
+		std::vector<uint32_t> prefetch, chunkRequests, changedPages, nearEdit;
+		LoadedChunk loaded;
+
+		// Rays read full resolution voxels until one covers less than LOD_PIXELS pixels
+		float worldDiagonal = glm::length(glm::fvec3(worldSize));
+		float lodRange = std::min(worldDiagonal, windowSize.y / (2.0f * tanf(fov / 2.0f) * LOD_PIXELS));
+
+		while (rendering.load(std::memory_order_acquire))
+		{
+			// Apply the edits of every snapshot published since the last frame, then draw the newest
+			while (frameQueue.pop(next))
+			{
+				for (const WorldEdit& edit : next.edits)
+				{
+					// Queued behind any load already requested, which is dropped when it arrives.
+					// The voxel shows at once; resident chunks whose AO it changed are loaded
+					// again behind it.
+					chunkLoader->editVoxel(edit.map, edit.voxel);
+					chunkCache.chunksNear(edit.map, AO_REACH, nearEdit);
+					for (uint32_t chunk : nearEdit)
+					{
+						chunkCache.invalidate(chunk);
+						if (chunkCache.slotOfChunk(chunk) != CHUNK_NOT_RESIDENT)
+							chunkLoader->refresh(chunk);
+					}
+					uint32_t slot = chunkCache.slotOf(edit.map);
+					if (slot != CHUNK_NOT_RESIDENT)
+					{
+						glBindBuffer(GL_SHADER_STORAGE_BUFFER, chunkPoolSSBO);
+						glBufferSubData(GL_SHADER_STORAGE_BUFFER, (slot * CHUNK_SLOT_VOXELS + ChunkCache::voxelOffset(edit.map, layout)) * sizeof(uint32_t), sizeof(uint32_t), &edit.voxel);
+					}
+					glBindBuffer(GL_SHADER_STORAGE_BUFFER, lodSSBO);
+					for (int level = 1; level < LOD_LEVELS && !streamPath; level++)
+					{
+						// Pyramid layout is fixed after setup, so reading it here is safe
+						int cell = pyramid.index(level, edit.map >> level);
+						glBufferSubData(GL_SHADER_STORAGE_BUFFER, cell * sizeof(uint32_t), sizeof(uint32_t), &edit.lod[level]);
+					}
+					glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+				}
+
+				if (!next.lights.empty())
+				{
+					glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightSSBO);
+					glBufferData(GL_SHADER_STORAGE_BUFFER, next.lights.size() * sizeof(Light), next.lights.data(), GL_STATIC_READ);
+					glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightGridSSBO);
+					glBufferData(GL_SHADER_STORAGE_BUFFER, next.lightGrid.size() * sizeof(uint32_t), next.lightGrid.data(), GL_STATIC_READ);
+					glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+				}
+
+				// Restart accumulation whenever the view or the world changes
+				if (!haveFrame || next.resetAccumulation || next.pos != frame.pos || next.theta != frame.theta)
+					sampleIndex = 0;
+
+				if (frame.recording != next.recording)
+				{
+					if (next.recording && !video)
+					{
+						video.reset(new VideoWriter(recordPath, windowSize, RECORD_FPS));
+						if (!video->isOpen())
+							std::cout << "ERROR::VIDEO::FAILED_TO_OPEN " << recordPath << std::endl;
+					}
+					if (next.recording)
+					{
+						recordingDropped = capture.dropped();
+						recordTime = double(recordFrames) / RECORD_FPS;
+						recordLast = SDL_GetPerformanceCounter();
+					}
+					else
+						std::cout << "Recording stopped, " << capture.dropped() - recordingDropped << " frames dropped" << std::endl;
+				}
+				screenshot |= next.screenshot;
+
+				frame = std::move(next);
+				haveFrame = true;
+			}
+
+			if (!haveFrame)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			// Clear previous buffer
+			glClearColor(0, 0, 0, 0);
+			glClear(GL_COLOR_BUFFER_BIT);
+
+			// Upload light volume regions finished by the baker
+			LightVolumeRegion region;
+			while (lightVolume.takeUpdate(region))
+			{
+				glBindTexture(GL_TEXTURE_3D, lightVolumeTex);
+				glTexSubImage3D(GL_TEXTURE_3D, 0, region.offset.x, region.offset.y, region.offset.z,
+					region.size.x, region.size.y, region.size.z, GL_RGB, GL_FLOAT, region.texels.data());
+			}
+
+			// Activate shader and render
+			glUseProgram(shaderID);
+
+			// Pass dynamic uniforms
+			glUniform3f(uniform_pos, frame.pos.x, frame.pos.y, frame.pos.z);
+			glUniform2f(uniform_theta, frame.theta.x, frame.theta.y);
+			glUniform1i(uniform_use_light_volume, frame.useLightVolume);
+			glUniform1i(uniform_use_lod, frame.useLOD);
+			glUniform1i(uniform_fixed_dda, frame.useFixedDDA);
+			glUniform1i(uniform_path_trace, frame.pathTrace);
+			glUniform1ui(uniform_sample_index, sampleIndex);
+
+			glBindVertexArray(VAO);
+			if (frame.pathTrace && frame.denoised)
+			{
+				glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+				glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+
+				glUseProgram(denoiseID);
+				glActiveTexture(GL_TEXTURE2);
+				glBindTexture(GL_TEXTURE_2D, guideTex);
+				glActiveTexture(GL_TEXTURE1);
+
+				unsigned int input = sceneTex;
+				for (int pass = 0; pass < DENOISE_PASSES; pass++)
+				{
+					bool last = pass == DENOISE_PASSES - 1;
+					glBindFramebuffer(GL_FRAMEBUFFER, last ? 0 : pingFBO[pass % 2]);
+					glBindTexture(GL_TEXTURE_2D, input);
+					glUniform1i(uniform_step_width, 1 << pass);
+					glUniform1f(uniform_sigma_colour, denoiseSigmaColour(pass));
+					glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+					input = pingTex[pass % 2];
+				}
+
+				glActiveTexture(GL_TEXTURE0);
+			}
+			else
+			{
+				glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+			}
+
+			// Queue readbacks right behind the draw; they complete while later frames render
+			if (frame.recording && video->isOpen())
+			{
+				Uint64 now = SDL_GetPerformanceCounter();
+				recordTime += double(now - recordLast) / SDL_GetPerformanceFrequency();
+				recordLast = now;
+				uint64_t due = uint64_t(recordTime * RECORD_FPS) + 1;
+				if (due > recordFrames && capture.capture(CAPTURE_RECORDING, GL_RGBA, uint32_t(due - recordFrames)))
+					recordFrames = due;
+			}
+			if (screenshot)
+				capture.capture(CAPTURE_SCREENSHOT, GL_RGB);
+			screenshot = false;
+			capture.poll();
+
+			if (frame.pathTrace)
+			{
+				// Make this frame's accumulation writes visible to the next draw
+				glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+				sampleIndex++;
+				renderedSpp.store(sampleIndex, std::memory_order_relaxed);
+				renderedSamples.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			// Request the chunks a recent frame's rays found missing, then the ones the camera is heading for
+			feedback.collect(frame.goldenStep);
+			if (feedback.poll(touchedChunks, feedbackComplete, feedbackStep))
+			{
+				glm::fvec3 viewDir = cameraRay({ frame.pos, frame.theta, fov }, windowSize, glm::fvec2(windowSize) * 0.5f);
+				// Streamed worlds have no pyramid, but chunks past lodRange cover under a pixel
+				// each, so prefetching them would only crowd the pool. The loader ranks them
+				// off this thread; the newest ranking it has finished is used meanwhile. The
+				// cache never takes more predicted chunks than it has slots.
+				float range = frame.useLOD || streamPath ? lodRange : worldDiagonal;
+				chunkLoader->rankPrefetch({ frame.pos, frame.velocity, viewDir, fov, float(windowSize.x) / windowSize.y, range }, chunkCache.slotCount());
+				chunkLoader->takeRanking(prefetch);
+
+				// Golden images only come from poses whose frames had every chunk their rays touched,
+				// which takes a list that held them all. Chunks in view stay resident until the next
+				// update, so this holds until then.
+				for (size_t i = 0; i < touchedChunks.size() && feedbackComplete; i++)
+					feedbackComplete = chunkCache.slotOfChunk(touchedChunks[i]) != CHUNK_NOT_RESIDENT;
+
+				chunkCache.update(touchedChunks, prefetch, chunkRequests);
+				for (uint32_t chunk : chunkRequests)
+					chunkLoader->request(chunk);
+			}
+
+			// Upload whatever the loader has finished, up to the per-frame cap
+			bool streamed = false;
+			changedPages.clear();
+			for (int i = 0; i < CHUNK_UPLOADS_PER_FRAME && chunkLoader->takeLoaded(loaded); i++)
+			{
+				// A refresh only lands if its chunk is still resident, so it can't hold stale data
+				uint32_t slot = loaded.refresh ? chunkCache.slotOfChunk(loaded.chunk) : chunkCache.install(loaded.chunk, changedPages);
+				if (slot == CHUNK_NOT_RESIDENT)
+					continue;
+				glBindBuffer(GL_SHADER_STORAGE_BUFFER, chunkPoolSSBO);
+				glBufferSubData(GL_SHADER_STORAGE_BUFFER, slot * CHUNK_SLOT_BYTES, CHUNK_BYTES, loaded.voxels.data());
+				glBufferSubData(GL_SHADER_STORAGE_BUFFER, slot * CHUNK_SLOT_BYTES + CHUNK_BYTES, CHUNK_BYTES, loaded.ao.data());
+				streamed |= chunkCache.touched(loaded.chunk);
+			}
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, pageTableSSBO);
+			for (uint32_t page : changedPages)
+				glBufferSubData(GL_SHADER_STORAGE_BUFFER, page * sizeof(uint32_t), sizeof(uint32_t), &chunkCache.pageTable()[page]);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+			// Samples traced against missing chunks are wrong, so start over once they arrive
+			if (streamed)
+				sampleIndex = 0;
+
+			// A path traced golden waits for GOLDEN_SAMPLES samples, all with the full scene
+			bool converged = !frame.pathTrace || sampleIndex == GOLDEN_SAMPLES;
+			if (frame.goldenStep >= 0 && frame.goldenStep == goldenDone.load() && feedbackStep == frame.goldenStep && feedbackComplete && converged && !streamed &&
+				capture.capture(CAPTURE_GOLDEN, GL_RGB))
+				goldenDone.fetch_add(1);
+
+			// Update
+			SDL_GL_SwapWindow(window);
+		}
+
+		SDL_GL_MakeCurrent(window, nullptr);
+	};
 
 	// ========== GAME LOOP ==========
 
+	SDL_GL_MakeCurrent(window, nullptr);
+	std::thread renderThread(renderLoop);
+
+	// Built up over one or more iterations until the render thread has room for it
+	FrameSnapshot pending;
+	int goldenStep = -1;
+
+	// Start the clock here so setup time is not simulated on the first frame
+	lastCounter = SDL_GetPerformanceCounter();
+
 	bool quit = false;
 	while (!quit)
 	{
-		// Clear previous buffer
-		glClearColor(0, 0, 0, 0);
-		glClear(GL_COLOR_BUFFER_BIT);
-
 		// Process inputs
 		while (SDL_PollEvent(&event) != 0)
 		{
@@ -315,6 +1078,46 @@ int main(int argc, char* argv[])
 			case SDL_KEYDOWN:
 				if (event.key.keysym.sym < 128)
 					m_keys[event.key.keysym.sym] = true;
+				// Toggle between per-pixel shadow rays and the baked light volume
+				if (event.key.keysym.sym == SDLK_l && !event.key.repeat)
+					useLightVolume = !useLightVolume;
+				// Toggle the coarse pyramid levels for distant rays
+				if (event.key.keysym.sym == SDLK_o && !event.key.repeat && !streamPath)
+					useLOD = !useLOD;
+				// Toggle the fixed-point traversal for primary rays, in place of LOD, see FixedTraversal.h
+				if (event.key.keysym.sym == SDLK_f && !event.key.repeat)
+					useFixedDDA = !useFixedDDA;
+				// Toggle the denoiser for path traced frames
+				if (event.key.keysym.sym == SDLK_n && !event.key.repeat)
+					denoised = !denoised;
+				// Toggle progressive path tracing
+				if (event.key.keysym.sym == SDLK_p && !event.key.repeat)
+				{
+					pathTrace = !pathTrace;
+					pending.resetAccumulation = true;
+					SDL_SetWindowTitle(window, "Voxel Ray Tracer");
+				}
+				// Save the next frame
+				if (event.key.keysym.sym == SDLK_F12 && !event.key.repeat)
+					pending.screenshot = true;
+				// Toggle recording
+				if (event.key.keysym.sym == SDLK_c && !event.key.repeat)
+					recording = !recording;
+				// Move the nearest light to the player, re-baking the light volume around both places
+				if (event.key.keysym.sym == SDLK_k && !event.key.repeat && !lights.empty())
+				{
+					size_t nearest = 0;
+					for (size_t i = 1; i < lights.size(); i++)
+						if (glm::length(lights[i].position - pos) < glm::length(lights[nearest].position - pos))
+							nearest = i;
+					lights[nearest].position = pos;
+
+					buildLightGrid(lightGrid, lights, world.size);
+					lightVolume.setLights(lights);
+					pending.lights = lights;
+					pending.lightGrid = lightGrid.data;
+					pending.resetAccumulation = true;
+				}
 				break;
 			case SDL_KEYUP:
 				if (event.key.keysym.sym < 128)
@@ -323,14 +1126,23 @@ int main(int argc, char* argv[])
 			case SDL_MOUSEMOTION:
 
 			{
-				float deltaX = (float) event.motion.xrel * frameTime * ROTSPEED;
-				float deltaY = (float)event.motion.yrel * frameTime * ROTSPEED;
+				// Mouse deltas are already a distance, so they are not scaled by time
+				float deltaX = (float)event.motion.xrel * ROTSPEED;
+				float deltaY = (float)event.motion.yrel * ROTSPEED;
 				theta.x += deltaX;
 				theta.y += deltaY;
 				rot = rotationMatrix(glm::vec3(0, 1, 0), deltaX);
 				dir = rot * dir;
 			}
 			break;
+			case SDL_MOUSEBUTTONDOWN:
+				if (event.button.button <= NUM_MOUSE)
+					m_mouse[event.button.button - 1] = true;
+				break;
+			case SDL_MOUSEBUTTONUP:
+				if (event.button.button <= NUM_MOUSE)
+					m_mouse[event.button.button - 1] = false;
+				break;
 			case SDL_QUIT:
 				quit = true;
 				break;
@@ -342,96 +1154,270 @@ int main(int argc, char* argv[])
 		if (m_keys[SDLK_ESCAPE])
 			quit = true;
 
-		// Normalize if simultaneous perpendicular inputs
-		float multiplier = MOVESPEED;
-		if (m_keys[SDLK_w] || m_keys[SDLK_s])
+		// ========== SIMULATION ==========
+
+		// Consume elapsed time in fixed steps, carrying the remainder to the next frame.
+		// Clamp the backlog so a long stall does not turn into a burst of catch-up steps.
+		Uint64 counter = SDL_GetPerformanceCounter();
+		accumulator += double(counter - lastCounter) / frequency;
+		lastCounter = counter;
+		if (accumulator > SIM_MAX_STEPS * SIM_DT)
+			accumulator = SIM_MAX_STEPS * SIM_DT;
+
+		while (accumulator >= SIM_DT)
 		{
-			if (m_keys[SDLK_a] || m_keys[SDLK_d])
+			prevPos = pos;
+
+			// Build this step's motion from WASD and resolve it against the grid in one sweep
+			glm::vec3 perp = glm::cross(dir, glm::vec3(0, 1, 0));
+			float forward = float(m_keys[SDLK_w]) - float(m_keys[SDLK_s]);
+			float strafe = float(m_keys[SDLK_d]) - float(m_keys[SDLK_a]);
+
+			float multiplier = MOVESPEED * SIM_DT;
+			if (forward != 0 && strafe != 0)
 			{
 				// Multiply by 1/sqrt(2) to normalize speeds when
 				// moving in x and y directions simultaneously
 				multiplier *= 0.70710678118;
 			}
-		}
 
-		if (m_keys[SDLK_w])
-		{
-			glm::vec3 projected = pos + dir * multiplier;
-			glm::ivec3 map_proj = static_cast<glm::ivec3>(projected);
-			if (worldMap[map_proj.y * MAP_WIDTH * MAP_HEIGHT + map_proj.z * MAP_WIDTH + map_proj.x] == 0)
-				pos = projected;
-		}
-		else if (m_keys[SDLK_s])
-		{
-			glm::vec3 projected = pos - dir * multiplier;
-			glm::ivec3 map_proj = static_cast<glm::ivec3>(projected);
-			if (worldMap[map_proj.y * MAP_WIDTH * MAP_HEIGHT + map_proj.z * MAP_WIDTH + map_proj.x] == 0)
-				pos = projected;
+			// world may only be a window of a streamed world, starting at worldOrigin
+			glm::vec3 motion = (dir * forward + perp * strafe) * multiplier;
+			glm::fvec3 offset(worldOrigin);
+			if (motion != glm::vec3(0))
+				pos = moveAndSlide(world, pos - offset, glm::vec3(PLAYER_EXTENT), motion) + offset;
+			if (streamPath)
+				moveWindow(pos, false);
+
+			// Left click removes the voxel under the crosshair, right click places one against it.
+			// Picked in the simulation step from the simulated position with the fixed-point
+			// traversal, so every machine replaying the same steps edits the same voxel.
+			if (m_mouse[SDL_BUTTON_LEFT - 1] || m_mouse[SDL_BUTTON_RIGHT - 1])
+			{
+				RayHit hit = castRayFixed(world, pos - glm::fvec3(worldOrigin), dir, EDIT_REACH);
+				glm::ivec3 target = hit.map + worldOrigin;
+				Uint32 voxel = 0;
+				if (m_mouse[SDL_BUTTON_RIGHT - 1])
+				{
+					target += hit.normal;
+					voxel = PLACE_VOXEL;
+				}
+
+				AABB player = { pos - PLAYER_EXTENT, pos + PLAYER_EXTENT };
+				if (hit.hit && world.contains(target - worldOrigin) && !overlapsVoxel(player, target))
+				{
+					world.voxels[world.index(target - worldOrigin)] = voxel;
+
+					// Hand the edited voxel and the pyramid cells that changed to the render thread.
+					// A streamed world keeps the edit so the window still has it when read again.
+					WorldEdit edit = { target, voxel };
+					if (streamPath)
+						streamedWorld.editVoxel(target, voxel);
+					else
+					{
+						updatePyramid(pyramid, world, target);
+						lightVolume.editVoxel(target, voxel);
+						for (int level = 1; level < LOD_LEVELS; level++)
+							edit.lod[level] = pyramid.cells[pyramid.index(level, target >> level)];
+					}
+					pending.edits.push_back(std::move(edit));
+					pending.resetAccumulation = true;
+				}
+
+				m_mouse[SDL_BUTTON_LEFT - 1] = m_mouse[SDL_BUTTON_RIGHT - 1] = false;
+			}
+
+			accumulator -= SIM_DT;
 		}
-		if (m_keys[SDLK_a])
+
+		// Render between the last two simulation states
+		float alpha = float(accumulator / SIM_DT);
+		glm::fvec3 renderPos = glm::mix(prevPos, pos, alpha);
+
+		// Samples per second readout, from counters kept by the render thread
+		if (pathTrace)
 		{
-			glm::vec3 perp = glm::cross(dir, glm::vec3(0, 1, 0));
-			glm::vec3 projected = pos - perp * multiplier;
-			glm::ivec3 map_proj = static_cast<glm::ivec3>(projected);
-			if (worldMap[map_proj.y * MAP_WIDTH * MAP_HEIGHT + map_proj.z * MAP_WIDTH + map_proj.x] == 0)
-				pos = projected;
+			Uint32 now = SDL_GetTicks();
+			if (now - titleTime >= TITLE_INTERVAL)
+			{
+				uint64_t samples = renderedSamples.load(std::memory_order_relaxed);
+				double rate = double(samples - titleSamples) * windowSize.x * windowSize.y / (now - titleTime) / 1000.0;
+				std::string title = "Voxel Ray Tracer - " + std::to_string(renderedSpp.load(std::memory_order_relaxed)) + " spp, " +
+					std::to_string(rate) + " Msamples/s";
+				SDL_SetWindowTitle(window, title.c_str());
+				titleTime = now;
+				titleSamples = samples;
+			}
 		}
-		else if (m_keys[SDLK_d])
+
+		// Golden runs ignore input and step through the poses as the render thread takes them
+		if (!goldenPoses.empty())
 		{
-			glm::vec3 perp = glm::cross(dir, glm::vec3(0, 1, 0));
-			glm::vec3 projected = pos + perp * multiplier;
-			glm::ivec3 map_proj = static_cast<glm::ivec3>(projected);
-			if (worldMap[map_proj.y * MAP_WIDTH * MAP_HEIGHT + map_proj.z * MAP_WIDTH + map_proj.x] == 0)
-				pos = projected;
+			int step = goldenDone.load();
+			if (step == int(goldenImages.size()))
+			{
+				quit = true;
+			}
+			else
+			{
+				const CameraKey& pose = goldenPoses[step / 2];
+				renderPos = pose.pos;
+				theta = { pose.yaw, 0 };
+				pathTrace = step % 2 == 1;
+				pending.resetAccumulation |= step != goldenStep;
+				pending.goldenStep = goldenStep = step;
+			}
 		}
 
-		// Activate shader and render
-		glUseProgram(shaderID);
-
-		// Pass dynamic uniforms
-		glUniform3f(uniform_pos, pos.x, pos.y, pos.z);
-		glUniform2f(uniform_theta, theta.x, theta.y);
-
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-		// Update
-		SDL_GL_SwapWindow(window);
-
-		// ========== TIMING ==========
-
-		oldTime = time;
-		time = SDL_GetTicks();
-		frameTime = (time - oldTime) / 1000.0;
-		//std::cout << frameTime << std::endl;
+		// ========== PUBLISH FRAME ==========
+
+		pending.pos = renderPos;
+		pending.velocity = (pos - prevPos) / SIM_DT;
+		pending.theta = theta;
+		pending.useLightVolume = useLightVolume;
+		pending.useLOD = useLOD;
+		pending.useFixedDDA = useFixedDDA;
+		pending.pathTrace = pathTrace;
+		pending.denoised = denoised;
+		pending.recording = recording;
+
+		// If the render thread is behind, keep the snapshot and fold the next iteration's
+		// camera and edits into it rather than blocking input on the renderer
+		if (frameQueue.push(std::move(pending)))
+			pending = FrameSnapshot();
+		else
+			SDL_Delay(1);
 	}
 
+	rendering.store(false, std::memory_order_release);
+	renderThread.join();
+	SDL_GL_MakeCurrent(window, glContext);
+
 	// ========== CLEAN UP ==========
 
 	glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
 	glDeleteBuffers(1, &EBO);
+	glDeleteBuffers(1, &SSBO);
+	glDeleteBuffers(1, &lightSSBO);
+	glDeleteBuffers(1, &lightGridSSBO);
+	glDeleteBuffers(1, &lodSSBO);
+	glDeleteBuffers(1, &chunkPoolSSBO);
+	glDeleteBuffers(1, &pageTableSSBO);
+	glDeleteBuffers(1, &feedbackSSBO);
+	glDeleteBuffers(1, &materialSSBO);
+	glDeleteBuffers(1, &accumSSBO);
+	glDeleteTextures(1, &lightVolumeTex);
+	glDeleteFramebuffers(1, &sceneFBO);
+	glDeleteFramebuffers(2, pingFBO);
+	glDeleteTextures(1, &sceneTex);
+	glDeleteTextures(1, &guideTex);
+	glDeleteTextures(2, pingTex);
 
 	SDL_GL_DeleteContext(glContext);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
 
+	if (!goldenPoses.empty())
+		return runGoldenChecks(scene, goldenPoses, goldenImages, argv[3], goldenUpdate, fov);
+
 	return EXIT_SUCCESS;
 }
 
-glm::fmat3 rotationMatrix(glm::fvec3 axis, float angle)
+int renderHeadless(const Scene& scene, const Camera& camera, int samples, bool denoised, const char* outPath)
 {
-	axis = glm::normalize(axis);
-	float s = sin(angle);
-	float c = cos(angle);
-	float oc = 1.0 - c;
-
-	return glm::fmat3(oc * axis.x * axis.x + c, oc * axis.x * axis.y - axis.z * s, oc * axis.z * axis.x + axis.y * s,
-		oc * axis.x * axis.y + axis.z * s, oc * axis.y * axis.y + c, oc * axis.y * axis.z - axis.x * s,
-		oc * axis.z * axis.x - axis.y * s, oc * axis.y * axis.z + axis.x * s, oc * axis.z * axis.z + c);
+	glm::ivec2 size(W_WIDTH, W_HEIGHT);
+	std::vector<glm::fvec3> accum;
+	std::vector<glm::fvec4> guide;
+	samples = std::max(samples, 1);
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < samples; i++)
+	{
+		accumulatePathSamples(scene, camera, size, i, accum, &guide);
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Sample " << i + 1 << "/" << samples << ", "
+			<< (i + 1) * double(size.x * size.y) / seconds / 1e6 << " Msamples/s" << std::endl;
+	}
+
+	std::vector<uint8_t> rgb;
+	if (denoised)
+	{
+		std::vector<glm::fvec4> colour(accum.size());
+		for (size_t i = 0; i < accum.size(); i++)
+			colour[i] = glm::fvec4(accum[i] / float(samples), 1.0f);
+		denoise(colour, guide, size);
+
+		for (size_t i = 0; i < accum.size(); i++)
+			accum[i] = glm::fvec3(colour[i]);
+		resolveImage(accum, size, 1.0f, rgb);
+	}
+	else
+	{
+		resolveImage(accum, size, 1.0f / samples, rgb);
+	}
+
+	if (!writePPM(outPath, size, rgb))
+	{
+		std::cout << "ERROR::IMAGE::FAILED_TO_WRITE " << outPath << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Output options shared by the batch modes, from argv[first] on. Defaults to the
+// window size, 64 samples, no denoising and a single shard.
+bool parseBatchOptions(int argc, char* argv[], int first, BatchSettings& settings)
+{
+	settings.size = { W_WIDTH, W_HEIGHT };
+	settings.samples = 64;
+	settings.denoised = false;
+	settings.shard = 0;
+	settings.shardCount = 1;
+
+	for (int i = first; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		std::string value = i + 1 < argc ? argv[i + 1] : "";
+		if (arg == "--denoise")
+		{
+			settings.denoised = true;
+			continue;
+		}
+
+		size_t split = value.find_first_of("x/");
+		if (arg == "--size" && split != std::string::npos)
+		{
+			settings.size = { atoi(value.c_str()), atoi(value.c_str() + split + 1) };
+		}
+		else if (arg == "--samples")
+		{
+			settings.samples = atoi(value.c_str());
+		}
+		else if (arg == "--shard" && split != std::string::npos)
+		{
+			settings.shard = atoi(value.c_str());
+			settings.shardCount = atoi(value.c_str() + split + 1);
+		}
+		else
+		{
+			std::cout << "ERROR::BATCH::BAD_ARGUMENT " << arg << std::endl;
+			return false;
+		}
+		i++;
+	}
+
+	if (settings.size.x <= 0 || settings.size.y <= 0 || settings.shardCount <= 0 || settings.shard < 0 || settings.shard >= settings.shardCount)
+	{
+		std::cout << "ERROR::BATCH::BAD_SETTINGS" << std::endl;
+		return false;
+	}
+	return true;
 }
 
-void CompileShaders(const char* vertexPath, const char* fragmentPath, const char* geometryPath)
+unsigned int CompileShaders(const char* vertexPath, const char* fragmentPath, const char* geometryPath)
 {
 	// 1. retrieve the vertex/fragment source code from filePath
 	std::string vertexCode;
@@ -498,18 +1484,19 @@ void CompileShaders(const char* vertexPath, const char* fragmentPath, const char
 		checkCompileErrors(geometry, "GEOMETRY");
 	}
 	// shader Program
-	shaderID = glCreateProgram();
-	glAttachShader(shaderID, vertex);
-	glAttachShader(shaderID, fragment);
+	unsigned int program = glCreateProgram();
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
 	if (geometryPath != nullptr)
-		glAttachShader(shaderID, geometry);
-	glLinkProgram(shaderID);
-	checkCompileErrors(shaderID, "PROGRAM");
+		glAttachShader(program, geometry);
+	glLinkProgram(program);
+	checkCompileErrors(program, "PROGRAM");
 	// delete the shaders as they're linked into our program now and no longer necessery
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
 	if (geometryPath != nullptr)
 		glDeleteShader(geometry);
+	return program;
 }
 
 void checkCompileErrors(GLuint shader, std::string type)
@@ -534,4 +1521,48 @@ void checkCompileErrors(GLuint shader, std::string type)
 			std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
 		}
 	}
-}
\ No newline at end of file
+}
+
+// Renders the CPU reference for every pose and checks the GL raster and path traced
+// images and the CPU path traced one against the goldens, writing them first when
+// updating. Raster goldens are GL only, as there is no CPU rasteriser to check against.
+// Returns an exit code.
+int runGoldenChecks(const Scene& scene, const std::vector<CameraKey>& poses, const std::vector<std::vector<uint8_t>>& glImages,
+	const char* dir, bool update, float fov)
+{
+	glm::ivec2 size(GOLDEN_WIDTH, GOLDEN_HEIGHT);
+	int checks = 0, passed = 0;
+	for (size_t pose = 0; pose < poses.size(); pose++)
+	{
+		const std::vector<uint8_t>& glRaster = glImages[pose * 2];
+		const std::vector<uint8_t>& glPathTrace = glImages[pose * 2 + 1];
+		if (glRaster.empty() || glPathTrace.empty())
+		{
+			std::cout << "ERROR::GOLDEN::RUN_INTERRUPTED at pose " << pose << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		Camera camera = { poses[pose].pos, { poses[pose].yaw, 0 }, fov };
+		std::vector<glm::fvec3> accum;
+		for (int i = 0; i < GOLDEN_SAMPLES; i++)
+			accumulatePathSamples(scene, camera, size, i, accum);
+		std::vector<uint8_t> cpuPathTrace;
+		resolveImage(accum, size, 1.0f / GOLDEN_SAMPLES, cpuPathTrace);
+
+		std::string rasterPath = goldenPath(dir, int(pose), "raster");
+		std::string pathTracePath = goldenPath(dir, int(pose), "pathtrace");
+		if (update && (!writePNG(rasterPath.c_str(), size, glRaster) || !writePNG(pathTracePath.c_str(), size, cpuPathTrace)))
+		{
+			std::cout << "ERROR::IMAGE::FAILED_TO_WRITE " << rasterPath << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		passed += checkGolden(rasterPath, "gl", size, glRaster, GOLDEN_MAX_BAD);
+		passed += checkGolden(pathTracePath, "gl", size, glPathTrace, GOLDEN_MAX_BAD_NOISY);
+		passed += checkGolden(pathTracePath, "cpu", size, cpuPathTrace, GOLDEN_MAX_BAD_NOISY);
+		checks += 3;
+	}
+
+	std::cout << passed << " of " << checks << " golden checks passed" << std::endl;
+	return passed == checks ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,359 @@
+#include "TileRender.h"
+#include "CameraPath.h"
+#include "CpuRenderer.h"
+#include "Image.h"
+#include "Net.h"
+#include "SceneFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#define TILE_MAGIC 0x454C4954u // "TILE"
+
+// Wire messages. Coordinator and workers are assumed to share byte order.
+struct TileHello
+{
+	uint32_t magic;
+	uint32_t reserved;
+	uint64_t sceneHash;
+};
+
+struct TileJob
+{
+	uint32_t magic;
+	uint32_t id;
+	int32_t size[2];
+	int32_t rect[4]; // x, y, width, height, bottom row first like gl_FragCoord
+	int32_t samples;
+	float pos[3];
+	float yaw;
+	float fov;
+};
+
+// Followed by width * height * 3 bytes of RGB, top row first
+struct TileResult
+{
+	uint32_t magic;
+	uint32_t id;
+	uint32_t bytes;
+};
+
+struct Tile
+{
+	int frame;
+	glm::ivec4 rect;
+	bool done;
+	bool requeued;
+	double sentAt;
+};
+
+// Bytes are read only as they arrive and kept until a whole message is in, so a
+// slow or silent peer never holds up the others
+struct Worker
+{
+	Socket socket;
+	std::vector<uint32_t> inFlight;
+	std::vector<uint8_t> received;
+};
+
+// Connected but still owes its TileHello
+struct Joining
+{
+	Socket socket;
+	double since;
+	std::vector<uint8_t> received;
+};
+
+struct PendingFrame
+{
+	std::vector<uint8_t> rgb;
+	int remaining;
+};
+
+static double secondsNow()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int coordinateTiles(const BatchSettings& settings, float fov, uint16_t port)
+{
+	World world;
+	std::vector<Light> lights;
+	MaterialTable materials;
+	std::vector<CameraKey> keys;
+	if (!loadScene(settings.scenePath, world, lights, materials) || !loadCameraPath(settings.pathPath, keys))
+		return EXIT_FAILURE;
+	uint64_t hash = sceneHash(world, lights, materials);
+
+	Socket listener = netInit() ? netListen(port) : NET_INVALID_SOCKET;
+	if (listener == NET_INVALID_SOCKET)
+	{
+		std::cout << "ERROR::TILES::FAILED_TO_LISTEN on port " << port << std::endl;
+		return EXIT_FAILURE;
+	}
+	std::cout << "Waiting for workers on port " << port << std::endl;
+
+	// Frames this shard still has to render
+	std::deque<int> frames;
+	int skipped = 0;
+	for (int frame = settings.shard; frame < cameraPathFrames(keys); frame += settings.shardCount)
+	{
+		if (std::ifstream(batchFramePath(settings.outDir, frame)))
+			skipped++;
+		else
+			frames.push_back(frame);
+	}
+
+	glm::ivec2 size = settings.size;
+	std::vector<Tile> tiles;
+	std::deque<uint32_t> queue;
+	std::map<int, PendingFrame> pending;
+	std::vector<Worker> workers;
+	std::vector<Joining> joining;
+	int rendered = 0, failed = 0;
+
+	auto dropWorker = [&](size_t index)
+	{
+		for (uint32_t id : workers[index].inFlight)
+			if (!tiles[id].done)
+				queue.push_front(id);
+		netClose(workers[index].socket);
+		workers.erase(workers.begin() + index);
+		std::cout << "Worker lost, " << workers.size() << " left" << std::endl;
+	};
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<Socket> sockets, ready;
+	while (!frames.empty() || !pending.empty())
+	{
+		// Open the next frame once the queue can't keep every worker busy
+		while (!frames.empty() && queue.size() < std::max<size_t>(1, workers.size() * TILES_PER_WORKER))
+		{
+			int frame = frames.front();
+			frames.pop_front();
+
+			PendingFrame& target = pending[frame];
+			target.rgb.assign(size.x * size.y * 3, 0);
+			target.remaining = 0;
+			for (int y = 0; y < size.y; y += TILE_SIZE)
+				for (int x = 0; x < size.x; x += TILE_SIZE)
+				{
+					Tile tile = { frame, { x, y, std::min(TILE_SIZE, size.x - x), std::min(TILE_SIZE, size.y - y) }, false, false, 0 };
+					queue.push_back(uint32_t(tiles.size()));
+					tiles.push_back(tile);
+					target.remaining++;
+				}
+		}
+
+		// Top every worker up
+		for (size_t w = 0; w < workers.size(); w++)
+		{
+			bool lost = false;
+			while (!lost && !queue.empty() && workers[w].inFlight.size() < TILES_PER_WORKER)
+			{
+				uint32_t id = queue.front();
+				queue.pop_front();
+				Tile& tile = tiles[id];
+				if (tile.done)
+					continue;
+
+				Camera camera = cameraPathAt(keys, tile.frame, fov);
+				TileJob job = { TILE_MAGIC, id, { size.x, size.y }, { tile.rect.x, tile.rect.y, tile.rect.z, tile.rect.w },
+					std::max(settings.samples, 1), { camera.pos.x, camera.pos.y, camera.pos.z }, camera.theta.x, camera.fov };
+				tile.requeued = false;
+				tile.sentAt = secondsNow();
+				workers[w].inFlight.push_back(id);
+				lost = !netSend(workers[w].socket, &job, sizeof(job));
+			}
+			if (lost)
+				dropWorker(w--);
+		}
+
+		// Give tiles that have gone quiet to someone else as well, and hang up on
+		// connections that never said hello
+		double now = secondsNow();
+		for (const Worker& worker : workers)
+			for (uint32_t id : worker.inFlight)
+				if (!tiles[id].done && !tiles[id].requeued && now - tiles[id].sentAt > TILE_TIMEOUT)
+				{
+					tiles[id].requeued = true;
+					queue.push_front(id);
+				}
+		for (size_t j = 0; j < joining.size(); j++)
+			if (now - joining[j].since > TILE_TIMEOUT)
+			{
+				netClose(joining[j].socket);
+				joining.erase(joining.begin() + j--);
+			}
+
+		sockets.assign(1, listener);
+		for (const Joining& join : joining)
+			sockets.push_back(join.socket);
+		for (const Worker& worker : workers)
+			sockets.push_back(worker.socket);
+		netWait(sockets, 100, ready);
+
+		for (Socket socket : ready)
+		{
+			if (socket == listener)
+			{
+				Joining join = { netAccept(listener), secondsNow() };
+				if (join.socket != NET_INVALID_SOCKET)
+					joining.push_back(join);
+				continue;
+			}
+
+			auto join = std::find_if(joining.begin(), joining.end(), [&](const Joining& j) { return j.socket == socket; });
+			if (join != joining.end())
+			{
+				bool open = netRecvAvailable(socket, join->received);
+				if (open && join->received.size() < sizeof(TileHello))
+					continue;
+
+				// Answer with our own hash either way so a refused worker can say why
+				TileHello hello = {}, reply = { TILE_MAGIC, 0, hash };
+				if (open)
+					std::memcpy(&hello, join->received.data(), sizeof(hello));
+				if (!open || !netSend(socket, &reply, sizeof(reply)) || hello.magic != TILE_MAGIC || hello.sceneHash != hash)
+				{
+					std::cout << "ERROR::TILES::WORKER_REFUSED scene or protocol mismatch" << std::endl;
+					netClose(socket);
+					joining.erase(join);
+					continue;
+				}
+
+				Worker worker = { socket };
+				worker.received.assign(join->received.begin() + sizeof(hello), join->received.end());
+				joining.erase(join);
+				workers.push_back(worker);
+				std::cout << "Worker joined, " << workers.size() << " connected" << std::endl;
+				continue;
+			}
+
+			size_t w = 0;
+			while (workers[w].socket != socket)
+				w++;
+
+			std::vector<uint8_t>& received = workers[w].received;
+			bool valid = netRecvAvailable(socket, received);
+			size_t used = 0;
+			while (valid && received.size() - used >= sizeof(TileResult))
+			{
+				TileResult result;
+				std::memcpy(&result, &received[used], sizeof(result));
+				valid = result.magic == TILE_MAGIC && result.id < tiles.size() &&
+					result.bytes == uint32_t(tiles[result.id].rect.z * tiles[result.id].rect.w * 3);
+				if (!valid || received.size() - used < sizeof(result) + result.bytes)
+					break;
+				const uint8_t* rgb = &received[used + sizeof(result)];
+				used += sizeof(result) + result.bytes;
+
+				std::vector<uint32_t>& inFlight = workers[w].inFlight;
+				inFlight.erase(std::find(inFlight.begin(), inFlight.end(), result.id));
+
+				Tile& tile = tiles[result.id];
+				if (tile.done)
+					continue;
+				tile.done = true;
+
+				// Paste the tile in; both are top row first, the tile's top row being rect.y + height - 1
+				PendingFrame& target = pending[tile.frame];
+				int top = size.y - tile.rect.y - tile.rect.w;
+				for (int row = 0; row < tile.rect.w; row++)
+					std::copy(&rgb[row * tile.rect.z * 3], &rgb[(row + 1) * tile.rect.z * 3],
+						&target.rgb[((top + row) * size.x + tile.rect.x) * 3]);
+
+				if (--target.remaining > 0)
+					continue;
+
+				std::string path = batchFramePath(settings.outDir, tile.frame);
+				std::string temp = path + ".tmp";
+				if (!writePPM(temp.c_str(), size, target.rgb) || std::rename(temp.c_str(), path.c_str()) != 0)
+				{
+					std::cout << "ERROR::IMAGE::FAILED_TO_WRITE " << path << std::endl;
+					std::remove(temp.c_str());
+					failed++;
+				}
+				else
+				{
+					rendered++;
+					double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+					std::cout << "Frame " << tile.frame + 1 << "/" << cameraPathFrames(keys) << ", " << seconds / rendered << " s/frame, "
+						<< workers.size() << " workers" << std::endl;
+				}
+				pending.erase(tile.frame);
+			}
+
+			if (!valid)
+				dropWorker(w);
+			else
+				received.erase(received.begin(), received.begin() + used);
+		}
+	}
+
+	for (const Worker& worker : workers)
+		netClose(worker.socket);
+	netClose(listener);
+
+	std::cout << "Rendered " << rendered << ", skipped " << skipped << " already done, " << failed << " failed" << std::endl;
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int runTileWorker(const char* scenePath, const char* host, uint16_t port)
+{
+	World world;
+	std::vector<Light> lights;
+	MaterialTable materials;
+	if (!loadScene(scenePath, world, lights, materials))
+		return EXIT_FAILURE;
+
+	LightGrid lightGrid;
+	buildLightGrid(lightGrid, lights, world.size);
+	Scene scene = { &world, &lights, &lightGrid, &materials };
+
+	Socket socket = netInit() ? netConnect(host, port) : NET_INVALID_SOCKET;
+	TileHello hello = { TILE_MAGIC, 0, sceneHash(world, lights, materials) };
+	TileHello reply;
+	if (socket == NET_INVALID_SOCKET || !netSend(socket, &hello, sizeof(hello)) || !netRecv(socket, &reply, sizeof(reply)))
+	{
+		std::cout << "ERROR::TILES::FAILED_TO_CONNECT " << host << ":" << port << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (reply.magic != TILE_MAGIC || reply.sceneHash != hello.sceneHash)
+	{
+		std::cout << "ERROR::TILES::SCENE_MISMATCH the coordinator loaded a different scene" << std::endl;
+		netClose(socket);
+		return EXIT_FAILURE;
+	}
+
+	// The coordinator closing the connection is the normal way for a job to end
+	TileJob job;
+	int tiles = 0;
+	std::vector<glm::fvec3> accum;
+	std::vector<uint8_t> rgb;
+	while (netRecv(socket, &job, sizeof(job)) && job.magic == TILE_MAGIC)
+	{
+		Camera camera = { { job.pos[0], job.pos[1], job.pos[2] }, { job.yaw, 0 }, job.fov };
+		glm::ivec2 size(job.size[0], job.size[1]);
+		glm::ivec4 rect(job.rect[0], job.rect[1], job.rect[2], job.rect[3]);
+		for (int i = 0; i < job.samples; i++)
+			accumulateTileSamples(scene, camera, size, rect, i, accum);
+		resolveImage(accum, { rect.z, rect.w }, 1.0f / job.samples, rgb);
+
+		TileResult result = { TILE_MAGIC, job.id, uint32_t(rgb.size()) };
+		if (!netSend(socket, &result, sizeof(result)) || !netSend(socket, rgb.data(), rgb.size()))
+			break;
+		tiles++;
+	}
+
+	netClose(socket);
+	std::cout << "Rendered " << tiles << " tiles" << std::endl;
+	return EXIT_SUCCESS;
+}
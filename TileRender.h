@@ -0,0 +1,26 @@
+#pragma once
+
+#include "BatchRender.h"
+
+#include <cstdint>
+
+// Pixels per tile along each axis
+#define TILE_SIZE 64
+// Tiles handed to each worker ahead of its results, so it never idles between tiles
+#define TILES_PER_WORKER 2
+// Seconds before an unanswered tile is also given to another worker
+#define TILE_TIMEOUT 30.0
+
+// Distributed version of renderBatch(). The coordinator listens on port, splits
+// every frame into tiles and deals them out to whichever workers connect, keeping
+// TILES_PER_WORKER in flight on each and starting on the next frame's tiles before
+// the current one is finished. Tiles from a worker that disconnects or stays
+// silent past TILE_TIMEOUT go back on the queue; whichever copy comes back first
+// is used. Frames are written, skipped and sharded exactly as renderBatch() does.
+// Denoising is not supported, as the filter needs its neighbours across tile edges.
+int coordinateTiles(const BatchSettings& settings, float fov, uint16_t port);
+
+// Connects to a coordinator and renders tiles until it hangs up. The worker loads
+// the scene itself and is refused unless its content hash matches the coordinator's.
+// Workers trace with every core of their own machine.
+int runTileWorker(const char* scenePath, const char* host, uint16_t port);
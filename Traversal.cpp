@@ -0,0 +1,225 @@
+#include "Traversal.h"
+
+#include <algorithm>
+
+// Distance to the next boundary on each axis for a ray in voxel map
+static void boundaries(glm::fvec3 origin, glm::ivec3 map, glm::ivec3 stepAmount, glm::fvec3 tDelta, glm::fvec3& tMax)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		if (stepAmount[i] < 0)
+			tMax[i] = (origin[i] - map[i]) * tDelta[i];
+		else if (stepAmount[i] > 0)
+			tMax[i] = (map[i] + 1.0f - origin[i]) * tDelta[i];
+		else
+			tMax[i] = FLT_MAX;
+	}
+}
+
+void initDDA(glm::fvec3 origin, glm::fvec3 dir, glm::ivec3& map, glm::ivec3& stepAmount, glm::fvec3& tDelta, glm::fvec3& tMax)
+{
+	map = glm::ivec3(glm::floor(origin));
+	for (int i = 0; i < 3; i++)
+	{
+		if (dir[i] < 0)
+		{
+			stepAmount[i] = -1;
+			tDelta[i] = -1.0f / dir[i];
+		}
+		else if (dir[i] > 0)
+		{
+			stepAmount[i] = 1;
+			tDelta[i] = 1.0f / dir[i];
+		}
+		else
+		{
+			stepAmount[i] = 0;
+			tDelta[i] = FLT_MAX;
+		}
+	}
+	boundaries(origin, map, stepAmount, tDelta, tMax);
+}
+
+bool enterWorld(glm::ivec3 size, glm::fvec3 origin, glm::fvec3 dir, float& tEntry, int& axis)
+{
+	float tNear = -FLT_MAX, tFar = FLT_MAX;
+	axis = -1;
+	for (int i = 0; i < 3; i++)
+	{
+		// A ray along an axis stays in one row of voxels, the one floor(origin) picks
+		if (dir[i] == 0)
+		{
+			if (origin[i] < 0 || origin[i] >= size[i])
+				return false;
+			continue;
+		}
+
+		float t0 = (0 - origin[i]) / dir[i];
+		float t1 = (size[i] - origin[i]) / dir[i];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		if (t0 > tNear)
+		{
+			tNear = t0;
+			axis = i;
+		}
+		tFar = std::min(tFar, t1);
+	}
+
+	// A ray starting on the face it enters through gets there at 0
+	tEntry = std::max(tNear, 0.0f);
+	return axis >= 0 && tEntry < tFar;
+}
+
+// Moves the DDA of a ray that starts outside the map to the voxel where it enters it.
+// Returns false if it misses the map or gets there no sooner than maxDist.
+static bool enterDDA(const World& world, glm::fvec3 origin, glm::fvec3 dir, float maxDist, glm::ivec3& map, glm::ivec3 stepAmount,
+	glm::fvec3 tDelta, glm::fvec3& tMax, float& tEntry, int& axis)
+{
+	if (!enterWorld(world.size, origin, dir, tEntry, axis) || tEntry >= maxDist)
+		return false;
+
+	// Rounding can put the entry point a hair outside, so clamp to the map and pin the
+	// entry axis to the face the ray comes through
+	map = glm::clamp(glm::ivec3(glm::floor(origin + dir * tEntry)), glm::ivec3(0), world.size - 1);
+	map[axis] = stepAmount[axis] > 0 ? 0 : world.size[axis] - 1;
+	boundaries(origin, map, stepAmount, tDelta, tMax);
+
+	// It can also land on the wrong side of a boundary the ray crossed just before
+	// entering. Then step over it, unless that leaves the map: the ray only grazed it.
+	for (int i = 0; i < 3; i++)
+	{
+		if (i == axis || tMax[i] >= tEntry)
+			continue;
+		map[i] += stepAmount[i];
+		tMax[i] += tDelta[i];
+		if (map[i] < 0 || map[i] >= world.size[i])
+			return false;
+	}
+	return true;
+}
+
+static RayHit makeHit(glm::fvec3 origin, glm::fvec3 dir, glm::ivec3 map, glm::ivec3 stepAmount, int axis, float t, uint32_t voxel)
+{
+	RayHit result;
+	result.hit = true;
+	result.map = map;
+	result.normal = glm::ivec3(0);
+	result.normal[axis] = -stepAmount[axis];
+	result.side = axis == 0 ? 0 : (axis == 2 ? 1 : 2);
+	result.dist = t;
+	result.position = origin + dir * t;
+	result.voxel = voxel;
+	return result;
+}
+
+// Axis whose boundary is crossed first: x only when strictly first, then y before z.
+// Unlike the shader this stays a branch. The CPU predicts it well, and picking the axis
+// with arithmetic put it on the loop's dependency chain and halved castRay() throughput.
+static inline int nextAxis(glm::fvec3 tMax)
+{
+	if (tMax.x < tMax.y)
+		return tMax.x < tMax.z ? 0 : 2;
+	return tMax.y < tMax.z ? 1 : 2;
+}
+
+template <int Octant>
+static RayHit castRayOctant(const World& world, glm::fvec3 origin, glm::fvec3 dir, float maxDist)
+{
+	RayHit result = {};
+
+	const glm::ivec3 stepAmount = octantStep<Octant>();
+	glm::ivec3 map;
+	glm::fvec3 tDelta, tMax;
+	initOctant<Octant>(origin, dir, map, tDelta, tMax);
+
+	if (!world.contains(map))
+	{
+		// Entering needs a zero step on axes the ray never crosses
+		float tEntry;
+		int axis;
+		if (!enterDDA(world, origin, dir, maxDist, map, glm::ivec3(glm::sign(dir)), tDelta, tMax, tEntry, axis))
+			return result;
+
+		uint32_t voxel = world.voxels[world.index(map)];
+		if (voxel != 0)
+			return makeHit(origin, dir, map, stepAmount, axis, tEntry, voxel);
+	}
+
+	while (true)
+	{
+		int axis = nextAxis(tMax);
+		float t = tMax[axis];
+		if (t >= maxDist)
+			return result;
+
+		// One unsigned compare catches leaving through either side
+		map[axis] += stepAmount[axis];
+		if (uint32_t(map[axis]) >= uint32_t(world.size[axis]))
+			return result;
+		tMax[axis] += tDelta[axis];
+
+		uint32_t voxel = world.voxels[world.index(map)];
+		if (voxel != 0)
+			return makeHit(origin, dir, map, stepAmount, axis, t, voxel);
+	}
+}
+
+template <int Octant>
+static bool occludedOctant(const World& world, glm::fvec3 origin, glm::fvec3 dir, float maxDist)
+{
+	const glm::ivec3 stepAmount = octantStep<Octant>();
+	glm::ivec3 map;
+	glm::fvec3 tDelta, tMax;
+	initOctant<Octant>(origin, dir, map, tDelta, tMax);
+
+	if (!world.contains(map))
+	{
+		float tEntry;
+		int axis;
+		if (!enterDDA(world, origin, dir, maxDist, map, glm::ivec3(glm::sign(dir)), tDelta, tMax, tEntry, axis))
+			return false;
+		if (world.voxels[world.index(map)] != 0)
+			return true;
+	}
+
+	while (true)
+	{
+		int axis = nextAxis(tMax);
+		if (tMax[axis] >= maxDist)
+			return false;
+
+		map[axis] += stepAmount[axis];
+		if (uint32_t(map[axis]) >= uint32_t(world.size[axis]))
+			return false;
+		tMax[axis] += tDelta[axis];
+
+		if (world.voxels[world.index(map)] != 0)
+			return true;
+	}
+}
+
+typedef RayHit (*CastKernel)(const World&, glm::fvec3, glm::fvec3, float);
+typedef bool (*OccludedKernel)(const World&, glm::fvec3, glm::fvec3, float);
+
+static const CastKernel castKernels[8] = {
+	castRayOctant<0>, castRayOctant<1>, castRayOctant<2>, castRayOctant<3>,
+	castRayOctant<4>, castRayOctant<5>, castRayOctant<6>, castRayOctant<7>
+};
+
+static const OccludedKernel occludedKernels[8] = {
+	occludedOctant<0>, occludedOctant<1>, occludedOctant<2>, occludedOctant<3>,
+	occludedOctant<4>, occludedOctant<5>, occludedOctant<6>, occludedOctant<7>
+};
+
+// The kernels treat axes the ray never crosses as stepping forwards. Those axes sit at
+// tMax = FLT_MAX, so capping maxDist there stops them ever being stepped along.
+RayHit castRay(const World& world, glm::fvec3 origin, glm::fvec3 dir, float maxDist)
+{
+	return castKernels[rayOctant(dir)](world, origin, dir, std::min(maxDist, FLT_MAX));
+}
+
+bool occluded(const World& world, glm::fvec3 origin, glm::fvec3 dir, float maxDist)
+{
+	return occludedKernels[rayOctant(dir)](world, origin, dir, std::min(maxDist, FLT_MAX));
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "World.h"
+
+#include <cfloat>
+#include <cmath>
+
+// CPU versions of the voxel traversal in shader.frag (Amanatides and Woo 1987)
+
+struct RayHit
+{
+	bool hit;
+	glm::ivec3 map;      // Voxel that was hit
+	glm::ivec3 normal;   // Face normal of the hit, pointing back towards the ray
+	int side;            // 0 = x, 1 = z, 2 = y, as in shader.frag
+	float dist;          // Distance along dir to the hit face
+	glm::fvec3 position; // Point on the hit face, origin + dir * dist
+	uint32_t voxel;
+};
+
+// Direction octant of a ray: bit i is set when dir[i] is negative. Axes the ray never
+// crosses count as positive, which is safe because they never win the DDA comparison.
+inline int rayOctant(glm::fvec3 dir)
+{
+	return int(dir.x < 0) | int(dir.y < 0) << 1 | int(dir.z < 0) << 2;
+}
+
+// Shared DDA setup. Axes the ray never crosses get tMax = FLT_MAX so they never win.
+void initDDA(glm::fvec3 origin, glm::fvec3 dir, glm::ivec3& map, glm::ivec3& stepAmount, glm::fvec3& tDelta, glm::fvec3& tMax);
+
+// DDA setup for a ray in a known octant, giving the same values as initDDA() without
+// branching on the sign of each component. The step is fixed by the octant.
+template <int Octant>
+inline void initOctant(glm::fvec3 origin, glm::fvec3 dir, glm::ivec3& map, glm::fvec3& tDelta, glm::fvec3& tMax)
+{
+	map = glm::ivec3(glm::floor(origin));
+	for (int i = 0; i < 3; i++)
+	{
+		float toBoundary = (Octant >> i) & 1 ? origin[i] - map[i] : map[i] + 1.0f - origin[i];
+		tDelta[i] = dir[i] != 0 ? std::abs(1.0f / dir[i]) : FLT_MAX;
+		tMax[i] = dir[i] != 0 ? toBoundary * tDelta[i] : FLT_MAX;
+	}
+}
+
+// Step along each axis for rays in an octant
+template <int Octant>
+inline glm::ivec3 octantStep()
+{
+	return glm::ivec3(Octant & 1 ? -1 : 1, Octant & 2 ? -1 : 1, Octant & 4 ? -1 : 1);
+}
+
+// Slab test of a ray from outside the map against its bounds. Returns false if the
+// ray misses them, otherwise the distance at which it enters and the axis of the face
+// it enters through.
+bool enterWorld(glm::ivec3 size, glm::fvec3 origin, glm::fvec3 dir, float& tEntry, int& axis);
+
+// Closest hit along the ray. Like the shader, the voxel containing origin is skipped.
+// Rays from outside the map start at the voxel where they enter it, which is tested.
+// Both queries dispatch on rayOctant() to one of eight kernels with the step along
+// each axis fixed at compile time.
+RayHit castRay(const World& world, glm::fvec3 origin, glm::fvec3 dir, float maxDist = FLT_MAX);
+
+// Any-hit query used for shadow and occlusion rays
+bool occluded(const World& world, glm::fvec3 origin, glm::fvec3 dir, float maxDist);
@@ -0,0 +1,345 @@
+#include "TraversalFuzz.h"
+#include "FixedTraversal.h"
+#include "Parallel.h"
+#include "RayQuery.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+
+#define INFINITE_T std::numeric_limits<double>::infinity()
+
+struct FuzzWorld
+{
+	World world;
+	std::vector<glm::ivec3> solid;
+};
+
+// Where a ray touches one closed voxel, in double precision
+struct Contact
+{
+	double enter, exit;
+	double slab[3];  // Distance at which the ray enters the voxel's slab on each axis
+	bool proper;     // Passes through the inside rather than grazing an edge, face or corner
+};
+
+static double tolerance(double t, double slack = FUZZ_TOLERANCE)
+{
+	return slack * (1.0 + std::fabs(t));
+}
+
+// With nearMiss, a ray passing within the tolerance of the voxel counts as touching it
+static bool contact(glm::fvec3 origin, glm::fvec3 dir, glm::ivec3 voxel, Contact& c, double slack = FUZZ_TOLERANCE, bool nearMiss = false)
+{
+	glm::dvec3 o(origin), d(dir);
+	c.enter = 0;
+	c.exit = INFINITE_T;
+	for (int i = 0; i < 3; i++)
+	{
+		// A ray along an axis stays in the one row of voxels floor(origin) picks. This
+		// is exact, so it is checked exactly rather than counted as a tie.
+		if (d[i] == 0)
+		{
+			if (std::floor(o[i]) != voxel[i])
+				return false;
+			c.slab[i] = -INFINITE_T;
+			continue;
+		}
+
+		double t0 = (voxel[i] - o[i]) / d[i];
+		double t1 = (voxel[i] + 1 - o[i]) / d[i];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		c.slab[i] = t0;
+		c.enter = std::max(c.enter, t0);
+		c.exit = std::min(c.exit, t1);
+	}
+
+	if (c.exit < c.enter - (nearMiss ? tolerance(c.enter, slack) : 0))
+		return false;
+	c.proper = c.exit - c.enter > 2 * tolerance(c.enter, slack);
+	return true;
+}
+
+// The exact answer: the nearest voxel the ray passes properly through before maxDist
+struct Reference
+{
+	double dist;
+	glm::ivec3 map;
+};
+
+static Reference reference(const FuzzWorld& fuzz, const Ray& ray, double slack = FUZZ_TOLERANCE)
+{
+	Reference result = { INFINITE_T, glm::ivec3(-1) };
+	glm::ivec3 start = glm::ivec3(glm::floor(ray.origin));
+	for (glm::ivec3 voxel : fuzz.solid)
+	{
+		Contact c;
+		if (voxel == start || !contact(ray.origin, ray.dir, voxel, c, slack) || !c.proper)
+			continue;
+		if (c.enter < ray.maxDist && c.enter < result.dist)
+			result = { c.enter, voxel };
+	}
+	return result;
+}
+
+static void printRay(std::ostream& out, const Ray& ray)
+{
+	out << std::setprecision(9)
+		<< "  origin (" << ray.origin.x << ", " << ray.origin.y << ", " << ray.origin.z << ")" << std::endl
+		<< "  dir (" << ray.dir.x << ", " << ray.dir.y << ", " << ray.dir.z << ")" << std::endl
+		<< "  maxDist " << ray.maxDist << std::endl;
+}
+
+static void printHit(std::ostream& out, const char* name, const RayHit& hit)
+{
+	out << "  " << name << ": ";
+	if (!hit.hit)
+	{
+		out << "miss" << std::endl;
+		return;
+	}
+	out << std::setprecision(9) << "voxel (" << hit.map.x << ", " << hit.map.y << ", " << hit.map.z << ") dist " << hit.dist
+		<< " normal (" << hit.normal.x << ", " << hit.normal.y << ", " << hit.normal.z << ") side " << hit.side << std::endl;
+}
+
+static bool sameHit(const RayHit& a, const RayHit& b)
+{
+	if (a.hit != b.hit)
+		return false;
+	return !a.hit || (a.map == b.map && a.normal == b.normal && a.side == b.side && a.dist == b.dist && a.position == b.position
+		&& a.voxel == b.voxel);
+}
+
+// Why a kernel's answer disagrees with the reference, or nullptr if it is acceptable.
+// nearMiss also accepts hits on voxels the ray passes within the tolerance of.
+static const char* checkHit(const FuzzWorld& fuzz, const Ray& ray, const RayHit& hit, const Reference& exact,
+	double slack = FUZZ_TOLERANCE, bool nearMiss = false)
+{
+	if (!hit.hit)
+		return exact.dist < ray.maxDist - tolerance(exact.dist, slack) ? "MISSED" : nullptr;
+
+	if (hit.dist >= ray.maxDist)
+		return "HIT_BEYOND_MAX_DIST";
+	if (!fuzz.world.contains(hit.map) || hit.voxel == 0 || hit.voxel != fuzz.world.at(hit.map))
+		return "HIT_EMPTY_VOXEL";
+	if (hit.map == glm::ivec3(glm::floor(ray.origin)))
+		return "HIT_START_VOXEL";
+
+	Contact c;
+	if (!contact(ray.origin, ray.dir, hit.map, c, slack, nearMiss))
+		return "HIT_VOXEL_NOT_ON_RAY";
+	if (std::fabs(hit.dist - c.enter) > tolerance(c.enter, slack))
+		return "WRONG_DISTANCE";
+	if (exact.dist != INFINITE_T && c.enter > exact.dist + tolerance(exact.dist, slack))
+		return "HIT_BEHIND_NEAREST";
+
+	// The normal must be the face the ray came in through
+	int axis = hit.normal.x != 0 ? 0 : (hit.normal.y != 0 ? 1 : 2);
+	int side = axis == 0 ? 0 : (axis == 2 ? 1 : 2);
+	if (glm::abs(hit.normal.x) + glm::abs(hit.normal.y) + glm::abs(hit.normal.z) != 1 || hit.side != side || ray.dir[axis] == 0
+		|| hit.normal[axis] != (ray.dir[axis] > 0 ? -1 : 1) || std::fabs(c.slab[axis] - c.enter) > tolerance(c.enter, slack))
+		return "WRONG_NORMAL";
+	return nullptr;
+}
+
+// Checks one ray through every kernel. If report is given, the mismatch is described there.
+static bool checkRay(const FuzzWorld& fuzz, const Ray& ray, const RayHit& batched, std::ostream* report)
+{
+	RayHit hit = castRay(fuzz.world, ray.origin, ray.dir, ray.maxDist);
+	Reference exact = reference(fuzz, ray);
+
+	const char* error = checkHit(fuzz, ray, hit, exact);
+	if (!error && occluded(fuzz.world, ray.origin, ray.dir, ray.maxDist) != hit.hit)
+		error = "OCCLUDED_DISAGREES";
+	if (!error && !sameHit(hit, batched))
+		error = "CAST_RAYS_DISAGREES";
+
+	// The fixed-point kernel traces the ray rounded to 16.16, so it answers to the reference for that
+	// one. Its rounding can also step into a voxel the ray passes within about 2^-16 of.
+	Ray quantized = { glm::fvec3(toFixed(ray.origin)) / float(FIXED_ONE), glm::fvec3(toFixed(ray.dir)) / float(FIXED_ONE), ray.maxDist };
+	RayHit fixed = castRayFixed(fuzz.world, ray.origin, ray.dir, ray.maxDist);
+	bool fixedFailed = false;
+	if (!error)
+	{
+		exact = reference(fuzz, quantized, FUZZ_FIXED_TOLERANCE);
+		error = checkHit(fuzz, quantized, fixed, exact, FUZZ_FIXED_TOLERANCE, true);
+		fixedFailed = error != nullptr;
+	}
+	if (!error)
+		return true;
+
+	if (report)
+	{
+		*report << "ERROR::FUZZ::" << (fixedFailed ? "FIXED_" : "") << error << std::endl;
+		printRay(*report, ray);
+		printHit(*report, "castRay", hit);
+		printHit(*report, "castRays", batched);
+		printHit(*report, "castRayFixed", fixed);
+		*report << "  occluded: " << occluded(fuzz.world, ray.origin, ray.dir, ray.maxDist) << std::endl;
+		if (fixedFailed)
+			*report << "  reference for the ray rounded to 16.16:" << std::endl;
+		if (exact.dist == INFINITE_T)
+			*report << "  reference: no proper hit" << std::endl;
+		else
+			*report << std::setprecision(9) << "  reference: voxel (" << exact.map.x << ", " << exact.map.y << ", " << exact.map.z
+				<< ") dist " << exact.dist << std::endl;
+	}
+	return false;
+}
+
+static void generateWorld(std::mt19937& rng, FuzzWorld& fuzz)
+{
+	std::uniform_int_distribution<int> size(1, FUZZ_MAX_SIZE);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	for (int i = 0; i < 3; i++)
+		fuzz.world.size[i] = size(rng);
+	fuzz.world.layout = WORLD_LINEAR;
+	fuzz.world.voxels.assign(fuzz.world.size.x * fuzz.world.size.y * fuzz.world.size.z, 0);
+	fuzz.solid.clear();
+
+	// From nearly empty worlds, where rays cross the whole map, to nearly solid ones
+	float density = unit(rng) * unit(rng);
+	for (int y = 0; y < fuzz.world.size.y; y++)
+		for (int z = 0; z < fuzz.world.size.z; z++)
+			for (int x = 0; x < fuzz.world.size.x; x++)
+				if (unit(rng) < density)
+				{
+					fuzz.world.voxels[fuzz.world.index({ x, y, z })] = 1 + rng() % 255;
+					fuzz.solid.push_back({ x, y, z });
+				}
+
+	// Half the worlds in Z-order, so both index paths of castRays() are checked
+	setWorldLayout(fuzz.world, rng() & 1 ? WORLD_MORTON : WORLD_LINEAR);
+}
+
+static Ray generateRay(std::mt19937& rng, glm::ivec3 size)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::normal_distribution<float> normal;
+	auto coin = [&]() { return (rng() & 1) != 0; };
+	auto range = [&](int lo, int hi) { return lo + int(rng() % uint32_t(hi - lo + 1)); };
+	// One draw at a time, as argument evaluation order would make seeds differ between compilers
+	auto gaussian = [&]()
+	{
+		glm::fvec3 v;
+		for (int i = 0; i < 3; i++)
+			v[i] = normal(rng);
+		return v;
+	};
+
+	Ray ray;
+
+	// Origins anywhere in and around the map, and some pinned to voxel boundaries
+	int margin = 3;
+	for (int i = 0; i < 3; i++)
+		ray.origin[i] = -margin + unit(rng) * (size[i] + 2 * margin);
+	if (coin())
+		for (int i = 0; i < 3; i++)
+			if (coin())
+				ray.origin[i] = float(range(-1, size[i] + 1));
+
+	switch (rng() % 5)
+	{
+	case 0: // Any direction
+		ray.dir = gaussian();
+		break;
+	case 1: // Along an axis
+		ray.dir = glm::fvec3(0);
+		ray.dir[rng() % 3] = coin() ? 1.0f : -1.0f;
+		break;
+	case 2: // In an axis plane
+		ray.dir = gaussian();
+		ray.dir[rng() % 3] = 0;
+		break;
+	case 3: // Grazing: nearly parallel to a face
+		ray.dir = gaussian();
+		ray.dir[rng() % 3] *= std::pow(10.0f, -float(range(3, 9)));
+		break;
+	default: // Through edges and corners: equal steps on two or three axes
+		for (int i = 0; i < 3; i++)
+			ray.dir[i] = coin() ? 1.0f : -1.0f;
+		if (coin())
+			ray.dir[rng() % 3] = 0;
+		break;
+	}
+	if (ray.dir == glm::fvec3(0))
+		ray.dir.x = 1.0f;
+	ray.dir = glm::normalize(ray.dir);
+
+	// Unlimited, limited, or limited to a whole number of voxels
+	switch (rng() % 3)
+	{
+	case 0:
+		ray.maxDist = FLT_MAX;
+		break;
+	case 1:
+		ray.maxDist = unit(rng) * 2.0f * glm::length(glm::fvec3(size + 2 * margin));
+		break;
+	default:
+		ray.maxDist = float(range(0, size.x + size.y + size.z));
+		break;
+	}
+	return ray;
+}
+
+int fuzzTraversal(uint64_t rays, uint32_t seed)
+{
+	std::cout << "Fuzzing the voxel traversal with " << rays << " rays, seed " << seed << std::endl;
+	auto start = std::chrono::steady_clock::now();
+
+	std::mt19937 rng(seed);
+	FuzzWorld fuzz;
+	std::vector<Ray> batch;
+	std::vector<RayHit> hits;
+	uint64_t done = 0, reported = 0;
+	for (uint32_t worldNumber = 0; done < rays; worldNumber++)
+	{
+		generateWorld(rng, fuzz);
+		batch.resize(size_t(std::min<uint64_t>(FUZZ_BATCH, rays - done)));
+		for (Ray& ray : batch)
+			ray = generateRay(rng, fuzz.world.size);
+
+		hits.resize(batch.size());
+		castRays(fuzz.world, batch.data(), hits.data(), batch.size());
+
+		// Lowest failing ray, so the report doesn't depend on thread timing
+		std::atomic<uint32_t> firstBad(UINT32_MAX);
+		parallelFor(0, int(batch.size()), [&](int i)
+		{
+			if (checkRay(fuzz, batch[i], hits[i], nullptr))
+				return;
+			uint32_t bad = firstBad.load();
+			while (uint32_t(i) < bad && !firstBad.compare_exchange_weak(bad, uint32_t(i)))
+				;
+		}, 256);
+
+		if (firstBad != UINT32_MAX)
+		{
+			std::ostringstream report;
+			checkRay(fuzz, batch[firstBad], hits[firstBad], &report);
+			std::cout << report.str() << "  in world " << worldNumber << " (" << fuzz.world.size.x << "x" << fuzz.world.size.y << "x"
+				<< fuzz.world.size.z << ", " << fuzz.solid.size() << " solid, " << (fuzz.world.layout == WORLD_MORTON ? "morton" : "linear") << "), ray " << done + firstBad << " of seed " << seed << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		done += batch.size();
+		if (done - reported >= 1000000 || done == rays)
+		{
+			std::cout << done << " rays passed" << std::endl;
+			reported = done;
+		}
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << "All " << rays << " rays agree with the reference (" << std::fixed << std::setprecision(1) << elapsed.count() << " s)"
+		<< std::endl;
+	return EXIT_SUCCESS;
+}
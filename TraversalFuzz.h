@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+// Rays traced against each random world, in one castRays() batch
+#define FUZZ_BATCH 8192
+// Largest random world along each axis
+#define FUZZ_MAX_SIZE 12
+// Distances within this much of the reference agree, relative plus the same absolute.
+// The kernels step in float, so their distances drift from the exact ones by a few ulps per voxel.
+#define FUZZ_TOLERANCE 1e-4
+// The same for castRayFixed(), which rounds each crossing distance down to 2^-16 of dir,
+// so it drifts by up to about 1.5e-5 per voxel crossed
+#define FUZZ_FIXED_TOLERANCE 2e-4
+
+// Differential tester for the voxel traversal. Builds random worlds and fires rays at
+// them that favour the cases a DDA gets wrong: directions with exact zero components,
+// origins on voxel boundaries and outside the map, rays grazing faces and through
+// corners, and distance limits that land on boundaries. Every ray goes through
+// castRay(), occluded() and castRays(), and each result is checked against a slow exact
+// reference that intersects the ray with every solid voxel in double precision.
+// castRayFixed() is checked against the reference for the ray it actually traces, with
+// origin and dir rounded to 16.16, within FUZZ_FIXED_TOLERANCE.
+//
+// Where exact ties make the answer ambiguous (a ray through an edge or along a face)
+// any of the tied voxels is accepted, but a ray that passes properly through a solid
+// voxel must hit it, or something before it. castRays() must match castRay() bit for
+// bit and occluded() must agree with it. Stops at the first mismatch, printing the ray
+// and both answers. Returns EXIT_SUCCESS if all rays pass.
+int fuzzTraversal(uint64_t rays, uint32_t seed);
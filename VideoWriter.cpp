@@ -0,0 +1,239 @@
+#include "VideoWriter.h"
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+// BT.601 limited range in 8.8 fixed point, as in most software encoders
+static inline uint8_t lumaOf(int r, int g, int b)
+{
+	return uint8_t(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static inline uint8_t chromaUOf(int r, int g, int b)
+{
+	return uint8_t(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+static inline uint8_t chromaVOf(int r, int g, int b)
+{
+	return uint8_t(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+// Two pixels of two rows, repeating the last column or row at odd edges
+static void convertPairScalar(glm::ivec2 size, int x, const uint8_t* row0, const uint8_t* row1, uint8_t* luma0, uint8_t* luma1, uint8_t* u, uint8_t* v)
+{
+	int x1 = std::min(x + 1, size.x - 1);
+	const uint8_t* p[4] = { row0 + x * 4, row0 + x1 * 4, row1 + x * 4, row1 + x1 * 4 };
+
+	luma0[x] = lumaOf(p[0][0], p[0][1], p[0][2]);
+	luma0[x1] = lumaOf(p[1][0], p[1][1], p[1][2]);
+	luma1[x] = lumaOf(p[2][0], p[2][1], p[2][2]);
+	luma1[x1] = lumaOf(p[3][0], p[3][1], p[3][2]);
+
+	int r = (p[0][0] + p[1][0] + p[2][0] + p[3][0] + 2) >> 2;
+	int g = (p[0][1] + p[1][1] + p[2][1] + p[3][1] + 2) >> 2;
+	int b = (p[0][2] + p[1][2] + p[2][2] + p[3][2] + 2) >> 2;
+	*u = chromaUOf(r, g, b);
+	*v = chromaVOf(r, g, b);
+}
+
+// Eight RGBA pixels to one 16-bit lane per pixel for each channel
+static inline void splitChannels(__m128i lo, __m128i hi, __m128i& r, __m128i& g, __m128i& b)
+{
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	r = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+	g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask), _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+	b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask), _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+}
+
+// The luma sum reaches 56228, so it is kept unsigned and shifted logically
+static inline __m128i lumaOf(__m128i r, __m128i g, __m128i b)
+{
+	__m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129))),
+		_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)), _mm_set1_epi16(128)));
+	return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+}
+
+// Chroma sums stay within +-28688 and are signed
+static inline __m128i chromaOf(__m128i r, __m128i g, __m128i b, int16_t cr, int16_t cg, int16_t cb)
+{
+	__m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)), _mm_mullo_epi16(g, _mm_set1_epi16(cg))),
+		_mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(cb)), _mm_set1_epi16(128)));
+	return _mm_add_epi16(_mm_srai_epi16(sum, 8), _mm_set1_epi16(128));
+}
+
+// Rounded mean of each 2x2 block, given the two rows' channel already summed
+static inline __m128i blockMean(__m128i lo, __m128i hi)
+{
+	const __m128i ones = _mm_set1_epi16(1);
+	__m128i sums = _mm_packs_epi32(_mm_madd_epi16(lo, ones), _mm_madd_epi16(hi, ones));
+	return _mm_srli_epi16(_mm_add_epi16(sums, _mm_set1_epi16(2)), 2);
+}
+
+// Sixteen pixels of two rows: 32 luma and 8 chroma samples. Matches convertPairScalar exactly.
+static void convertBlockSSE2(const uint8_t* row0, const uint8_t* row1, uint8_t* luma0, uint8_t* luma1, uint8_t* u, uint8_t* v, int uvStep)
+{
+	__m128i r[2][2], g[2][2], b[2][2]; // [row][half]
+	const uint8_t* rows[2] = { row0, row1 };
+	uint8_t* lumas[2] = { luma0, luma1 };
+	for (int row = 0; row < 2; row++)
+	{
+		const __m128i* in = (const __m128i*)rows[row];
+		splitChannels(_mm_loadu_si128(in), _mm_loadu_si128(in + 1), r[row][0], g[row][0], b[row][0]);
+		splitChannels(_mm_loadu_si128(in + 2), _mm_loadu_si128(in + 3), r[row][1], g[row][1], b[row][1]);
+		__m128i luma = _mm_packus_epi16(lumaOf(r[row][0], g[row][0], b[row][0]), lumaOf(r[row][1], g[row][1], b[row][1]));
+		_mm_storeu_si128((__m128i*)lumas[row], luma);
+	}
+
+	__m128i rMean = blockMean(_mm_add_epi16(r[0][0], r[1][0]), _mm_add_epi16(r[0][1], r[1][1]));
+	__m128i gMean = blockMean(_mm_add_epi16(g[0][0], g[1][0]), _mm_add_epi16(g[0][1], g[1][1]));
+	__m128i bMean = blockMean(_mm_add_epi16(b[0][0], b[1][0]), _mm_add_epi16(b[0][1], b[1][1]));
+	__m128i u8 = _mm_packus_epi16(chromaOf(rMean, gMean, bMean, -38, -74, 112), _mm_setzero_si128());
+	__m128i v8 = _mm_packus_epi16(chromaOf(rMean, gMean, bMean, 112, -94, -18), _mm_setzero_si128());
+
+	if (uvStep == 2)
+	{
+		_mm_storeu_si128((__m128i*)u, _mm_unpacklo_epi8(u8, v8));
+	}
+	else
+	{
+		_mm_storel_epi64((__m128i*)u, u8);
+		_mm_storel_epi64((__m128i*)v, v8);
+	}
+}
+
+void rgbaToYUV420(glm::ivec2 size, const uint8_t* rgba, int stride, uint8_t* y, uint8_t* u, uint8_t* v, int uvStep)
+{
+	int chromaWidth = (size.x + 1) / 2;
+	for (int cy = 0; cy < (size.y + 1) / 2; cy++)
+	{
+		int y0 = cy * 2, y1 = std::min(y0 + 1, size.y - 1);
+		const uint8_t* row0 = rgba + ptrdiff_t(y0) * stride;
+		const uint8_t* row1 = rgba + ptrdiff_t(y1) * stride;
+		uint8_t* luma0 = y + ptrdiff_t(y0) * size.x;
+		uint8_t* luma1 = y + ptrdiff_t(y1) * size.x;
+		uint8_t* uRow = u + ptrdiff_t(cy) * chromaWidth * uvStep;
+		uint8_t* vRow = v + ptrdiff_t(cy) * chromaWidth * uvStep;
+
+		int x = 0;
+		for (; x + 16 <= size.x; x += 16)
+			convertBlockSSE2(row0 + x * 4, row1 + x * 4, luma0 + x, luma1 + x, uRow + x / 2 * uvStep, vRow + x / 2 * uvStep, uvStep);
+		for (; x < size.x; x += 2)
+			convertPairScalar(size, x, row0, row1, luma0, luma1, uRow + x / 2 * uvStep, vRow + x / 2 * uvStep);
+	}
+}
+
+VideoWriter::VideoWriter(const char* path, glm::ivec2 size, int fps)
+	: m_file(path, std::ios::binary), m_size(size)
+{
+	std::string name = path;
+	m_format = name.size() >= 4 && name.compare(name.size() - 4, 4, ".y4m") == 0 ? VIDEO_Y4M : VIDEO_NV12;
+	glm::ivec2 chroma = (size + 1) / 2;
+	m_frameBytes = size_t(size.x) * size.y + size_t(chroma.x) * chroma.y * 2;
+
+	if (m_format == VIDEO_Y4M)
+		m_file << "YUV4MPEG2 W" << size.x << " H" << size.y << " F" << fps << ":1 Ip A1:1 C420jpeg\n";
+	m_open = (bool)m_file;
+
+	m_writer = std::thread(&VideoWriter::writerLoop, this);
+}
+
+VideoWriter::~VideoWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_one();
+	m_writer.join();
+}
+
+void VideoWriter::submit(uint64_t sequence, const uint8_t* rgba, int stride, uint32_t copies)
+{
+	// An empty frame tells the writer to repeat the last one
+	std::vector<uint8_t> frame;
+	if (rgba)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_spare.empty())
+			{
+				frame.swap(m_spare.back());
+				m_spare.pop_back();
+			}
+		}
+		frame.resize(m_frameBytes);
+
+		uint8_t* luma = frame.data();
+		uint8_t* chroma = luma + size_t(m_size.x) * m_size.y;
+		if (m_format == VIDEO_NV12)
+			rgbaToYUV420(m_size, rgba, stride, luma, chroma, chroma + 1, 2);
+		else
+			rgbaToYUV420(m_size, rgba, stride, luma, chroma, chroma + (m_frameBytes - (chroma - luma)) / 2, 1);
+	}
+
+	// The frame the writer is waiting for always gets in, so a full queue can't deadlock
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_progress.wait(lock, [&]() { return m_pending.size() < VIDEO_MAX_QUEUED || sequence == m_nextWrite; });
+		m_pending[sequence] = { copies, std::move(frame) };
+	}
+	m_wake.notify_one();
+}
+
+void VideoWriter::writerLoop()
+{
+	bool failed = false;
+	std::vector<uint8_t> previous;
+	while (true)
+	{
+		std::vector<uint8_t> frame;
+		uint32_t copies;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this]() { return m_quit || m_pending.count(m_nextWrite) != 0; });
+			auto next = m_pending.find(m_nextWrite);
+			if (next == m_pending.end())
+				return;
+			copies = next->second.first;
+			frame.swap(next->second.second);
+			m_pending.erase(next);
+			m_nextWrite++;
+		}
+		m_progress.notify_all();
+
+		if (frame.empty())
+		{
+			// Black in limited range YUV until there is a frame to repeat
+			if (previous.empty())
+			{
+				size_t lumaBytes = size_t(m_size.x) * m_size.y;
+				previous.assign(m_frameBytes, 128);
+				std::fill(previous.begin(), previous.begin() + lumaBytes, 16);
+			}
+			frame = previous;
+		}
+
+		for (uint32_t i = 0; i < copies; i++)
+		{
+			if (m_format == VIDEO_Y4M)
+				m_file << "FRAME\n";
+			m_file.write((const char*)frame.data(), frame.size());
+		}
+		if (!m_file && !failed)
+		{
+			std::cout << "ERROR::VIDEO::FAILED_TO_WRITE" << std::endl;
+			failed = true;
+		}
+
+		// Keep the frame for repeats and recycle the one it replaces
+		previous.swap(frame);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!frame.empty())
+			m_spare.push_back(std::move(frame));
+	}
+}
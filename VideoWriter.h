@@ -0,0 +1,68 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Converted frames allowed to wait for the disk before submit() starts blocking
+#define VIDEO_MAX_QUEUED 8
+
+enum VideoFormat
+{
+	VIDEO_Y4M, // YUV4MPEG2 with planar 4:2:0, readable by most players and ffmpeg
+	VIDEO_NV12 // Headerless Y plane then interleaved UV, for piping into an encoder
+};
+
+// Converts 8-bit RGBA to BT.601 limited range YUV 4:2:0, chroma averaged over each
+// 2x2 block. rgba points at the top row and stride is the byte step to the next row
+// down, negative for images stored bottom row first. Chroma samples are written
+// uvStep bytes apart: 1 for separate U and V planes, 2 for NV12 with v = u + 1.
+// Uses SSE2 sixteen pixels at a time, with a scalar path for the edges.
+void rgbaToYUV420(glm::ivec2 size, const uint8_t* rgba, int stride, uint8_t* y, uint8_t* u, uint8_t* v, int uvStep);
+
+// Streams frames to a file or named pipe as raw video. Paths ending in .y4m get
+// VIDEO_Y4M, anything else VIDEO_NV12. Colour conversion runs on whichever threads
+// call submit(), so several can convert at once, and a writer thread puts the
+// frames out in sequence order whatever order they were converted in.
+class VideoWriter
+{
+public:
+	VideoWriter(const char* path, glm::ivec2 size, int fps);
+	~VideoWriter();
+
+	bool isOpen() const { return m_open; }
+	VideoFormat format() const { return m_format; }
+
+	// Thread safe. Frame sequence numbers must run 0, 1, 2... without gaps. Blocks
+	// while VIDEO_MAX_QUEUED frames are already waiting, so a slow disk pushes back
+	// on the caller instead of growing memory. A null rgba repeats the frame before,
+	// or writes black if there is none, for frames that couldn't be read back. The
+	// frame is written copies times, so a caller on a slower clock than the video's
+	// frame rate can keep playback at the right speed.
+	void submit(uint64_t sequence, const uint8_t* rgba, int stride, uint32_t copies = 1);
+
+private:
+	void writerLoop();
+
+	std::ofstream m_file;
+	bool m_open;
+	VideoFormat m_format;
+	glm::ivec2 m_size;
+	size_t m_frameBytes;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;     // Writer: a frame arrived or quit
+	std::condition_variable m_progress; // Submitters: a frame was written
+	// Converted frames by sequence number, with how many times to write each
+	std::map<uint64_t, std::pair<uint32_t, std::vector<uint8_t>>> m_pending;
+	std::vector<std::vector<uint8_t>> m_spare;
+	uint64_t m_nextWrite = 0;
+	bool m_quit = false;
+	std::thread m_writer;
+};
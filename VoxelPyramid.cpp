@@ -0,0 +1,98 @@
+#include "VoxelPyramid.h"
+#include "Parallel.h"
+
+#define CHILDREN 8
+
+// Combine up to eight children, each given as (material, solid fraction), into one cell.
+// The material with the largest share of the solid volume wins.
+static uint32_t combine(const uint32_t* material, const uint32_t* occupancy, int count)
+{
+	uint32_t total = 0, best = 0, bestWeight = 0;
+	for (int i = 0; i < count; i++)
+	{
+		total += occupancy[i];
+		if (occupancy[i] == 0)
+			continue;
+
+		uint32_t weight = 0;
+		for (int j = 0; j < count; j++)
+			if (material[j] == material[i])
+				weight += occupancy[j];
+
+		if (weight > bestWeight)
+		{
+			best = material[i];
+			bestWeight = weight;
+		}
+	}
+
+	// Children outside the world count as empty, so divide by all eight
+	uint32_t fraction = (total + CHILDREN / 2) / CHILDREN;
+	return (fraction << LOD_OCCUPANCY_SHIFT) | (best & LOD_MATERIAL_MASK);
+}
+
+static uint32_t computeCell(const VoxelPyramid& pyramid, const World& world, int level, glm::ivec3 cell)
+{
+	uint32_t material[CHILDREN], occupancy[CHILDREN];
+	int count = 0;
+
+	const glm::ivec3& below = pyramid.dims[level - 1];
+	for (int i = 0; i < CHILDREN; i++)
+	{
+		glm::ivec3 child = cell * 2 + glm::ivec3(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+		if (child.x >= below.x || child.y >= below.y || child.z >= below.z)
+			continue;
+
+		if (level == 1)
+		{
+			uint32_t voxel = world.voxels[world.index(child)];
+			material[count] = voxel;
+			occupancy[count] = voxel != 0 ? LOD_OCCUPANCY_MAX : 0;
+		}
+		else
+		{
+			uint32_t packed = pyramid.cells[pyramid.index(level - 1, child)];
+			material[count] = packed & LOD_MATERIAL_MASK;
+			occupancy[count] = packed >> LOD_OCCUPANCY_SHIFT;
+		}
+		count++;
+	}
+
+	return combine(material, occupancy, count);
+}
+
+void buildPyramid(VoxelPyramid& pyramid, const World& world)
+{
+	pyramid.dims[0] = world.size;
+	pyramid.offsets[0] = 0;
+
+	int total = 0;
+	for (int level = 1; level < LOD_LEVELS; level++)
+	{
+		pyramid.dims[level] = (pyramid.dims[level - 1] + 1) / 2;
+		pyramid.offsets[level] = total;
+		total += pyramid.dims[level].x * pyramid.dims[level].y * pyramid.dims[level].z;
+	}
+	pyramid.cells.assign(total, 0);
+
+	// Each level only reads the one below, so levels go in order with cells in parallel
+	for (int level = 1; level < LOD_LEVELS; level++)
+	{
+		glm::ivec3 dims = pyramid.dims[level];
+		parallelFor(0, dims.y * dims.z, [&](int row)
+		{
+			int y = row / dims.z, z = row % dims.z;
+			for (int x = 0; x < dims.x; x++)
+				pyramid.cells[pyramid.index(level, { x, y, z })] = computeCell(pyramid, world, level, { x, y, z });
+		});
+	}
+}
+
+void updatePyramid(VoxelPyramid& pyramid, const World& world, glm::ivec3 map)
+{
+	for (int level = 1; level < LOD_LEVELS; level++)
+	{
+		glm::ivec3 cell = map >> level;
+		pyramid.cells[pyramid.index(level, cell)] = computeCell(pyramid, world, level, cell);
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "World.h"
+
+// Levels including the full resolution world as level 0. Must match shader.frag.
+#define LOD_LEVELS 4
+
+// Cell packing: dominant material in the low bits, solid fraction (0 - 255) above
+#define LOD_MATERIAL_MASK 0xFFFFu
+#define LOD_OCCUPANCY_SHIFT 16
+#define LOD_OCCUPANCY_MAX 255u
+
+// Mip pyramid of the world for distant rays. Each level halves the resolution of
+// the one below. A cell stores the fraction of its volume that is solid and the
+// material covering most of that solid volume, so a coarse traversal can shade a
+// hit without looking at the voxels underneath.
+struct VoxelPyramid
+{
+	glm::ivec3 dims[LOD_LEVELS]; // dims[0] is the world size
+	int offsets[LOD_LEVELS];     // Start of each level in cells. Level 0 lives in World::voxels.
+	std::vector<uint32_t> cells; // Levels 1 and up, each laid out like World::voxels
+
+	int index(int level, glm::ivec3 cell) const
+	{
+		return offsets[level] + (cell.y * dims[level].z + cell.z) * dims[level].x + cell.x;
+	}
+};
+
+// Build every level from the world, each level in parallel across its cells
+void buildPyramid(VoxelPyramid& pyramid, const World& world);
+
+// Recompute the one cell per level covering an edited voxel
+void updatePyramid(VoxelPyramid& pyramid, const World& world, glm::ivec3 map);
@@ -0,0 +1,23 @@
+#include "World.h"
+
+void setWorldLayout(World& world, WorldLayout layout)
+{
+	if (world.layout == layout)
+		return;
+
+	World reordered;
+	reordered.size = world.size;
+	reordered.layout = layout;
+	reordered.chunks = (world.size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	if (layout == WORLD_LINEAR)
+		reordered.voxels.assign(size_t(world.size.x) * world.size.y * world.size.z, 0);
+	else
+		reordered.voxels.assign(size_t(reordered.chunks.x) * reordered.chunks.y * reordered.chunks.z * CHUNK_VOXELS, 0);
+
+	for (int y = 0; y < world.size.y; y++)
+		for (int z = 0; z < world.size.z; z++)
+			for (int x = 0; x < world.size.x; x++)
+				reordered.voxels[reordered.index({ x, y, z })] = world.voxels[world.index({ x, y, z })];
+
+	world = std::move(reordered);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Voxels per chunk along each axis. Must match shader.frag.
+#define CHUNK_SHIFT 3
+#define CHUNK_SIZE (1 << CHUNK_SHIFT)
+#define CHUNK_VOXELS (CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE)
+#define CHUNK_BYTES (CHUNK_VOXELS * sizeof(uint32_t))
+
+enum WorldLayout
+{
+	// Rows of x, then z, then y: map.y * width * height + map.z * width + map.x
+	WORLD_LINEAR,
+	// Chunks one after another in linear order, each holding its voxels in Z-order. A
+	// step along any axis mostly stays within the same few cache lines, where linear
+	// order jumps a row or a whole layer for every step along z or y.
+	WORLD_MORTON
+};
+
+// Z-order offset of a voxel within its chunk: the bits of x, y and z interleaved,
+// x lowest. Same as chunk_offset() in shader.frag. Each axis has only eight values,
+// so a table spreads the bits in one load.
+inline uint32_t mortonOffset(glm::ivec3 local)
+{
+	static_assert(CHUNK_SHIFT == 3, "mortonOffset() spreads three bits per axis");
+	static const uint8_t spread[CHUNK_SIZE] = { 0x00, 0x01, 0x08, 0x09, 0x40, 0x41, 0x48, 0x49 };
+	return spread[local.x] | (spread[local.y] << 1) | (spread[local.z] << 2);
+}
+
+// Voxel grid, x -->, z down, y up, with 0 meaning empty. Stored in one of the
+// WorldLayouts, chosen when the world is loaded; index() hides which.
+struct World
+{
+	glm::ivec3 size; // (x, y, z) = (MAP_WIDTH, MAP_DEPTH, MAP_HEIGHT)
+	std::vector<uint32_t> voxels;
+	WorldLayout layout = WORLD_LINEAR;
+	glm::ivec3 chunks; // Chunks along each axis, for WORLD_MORTON
+
+	int index(glm::ivec3 map) const
+	{
+		if (layout == WORLD_LINEAR)
+			return (map.y * size.z + map.z) * size.x + map.x;
+
+		glm::ivec3 chunk = map >> CHUNK_SHIFT;
+		return ((chunk.y * chunks.z + chunk.z) * chunks.x + chunk.x) * CHUNK_VOXELS + int(mortonOffset(map & (CHUNK_SIZE - 1)));
+	}
+
+	bool contains(glm::ivec3 map) const
+	{
+		return map.x >= 0 && map.y >= 0 && map.z >= 0 && map.x < size.x && map.y < size.y && map.z < size.z;
+	}
+
+	// Voxels outside the map read as empty
+	uint32_t at(glm::ivec3 map) const
+	{
+		return contains(map) ? voxels[index(map)] : 0;
+	}
+};
+
+// Reorders the voxels of world into layout. Morton worlds are padded out to whole
+// chunks with empty voxels.
+void setWorldLayout(World& world, WorldLayout layout);
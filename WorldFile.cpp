@@ -0,0 +1,174 @@
+#include "WorldFile.h"
+
+#include <algorithm>
+#include <iostream>
+
+bool WorldFileWriter::open(const char* path, glm::ivec3 size)
+{
+	m_path = path;
+	m_file.open(path, std::ios::binary);
+	if (!m_file)
+	{
+		std::cout << "ERROR::WORLD::FILE_NOT_SUCCESFULLY_WRITTEN " << path << std::endl;
+		return false;
+	}
+
+	glm::ivec3 dims = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	m_header = { WORLD_FILE_MAGIC, WORLD_FILE_VERSION, { size.x, size.y, size.z }, CHUNK_SIZE, 0 };
+	m_table.clear();
+	m_table.reserve(size_t(dims.x) * dims.y * dims.z);
+	m_uniform = 0;
+
+	// The header is rewritten with the table offset once it is known
+	m_file.write((const char*)&m_header, sizeof(m_header));
+	return (bool)m_file;
+}
+
+void WorldFileWriter::addChunk(const uint32_t* voxels)
+{
+	if (std::all_of(voxels, voxels + CHUNK_VOXELS, [voxels](uint32_t v) { return v == voxels[0]; }))
+	{
+		m_table.push_back(WORLD_CHUNK_UNIFORM | voxels[0]);
+		m_uniform++;
+		return;
+	}
+
+	m_table.push_back(uint64_t(m_file.tellp()));
+	m_file.write((const char*)voxels, CHUNK_BYTES);
+}
+
+bool WorldFileWriter::finish()
+{
+	m_header.tableOffset = uint64_t(m_file.tellp());
+	m_file.write((const char*)m_table.data(), m_table.size() * sizeof(uint64_t));
+	m_file.seekp(0);
+	m_file.write((const char*)&m_header, sizeof(m_header));
+	m_file.close();
+	if (!m_file)
+	{
+		std::cout << "ERROR::WORLD::FILE_NOT_SUCCESFULLY_WRITTEN " << m_path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool WorldFileReader::open(const char* path)
+{
+	m_file.open(path, std::ios::binary);
+	WorldFileHeader header;
+	if (!m_file.read((char*)&header, sizeof(header)))
+	{
+		std::cout << "ERROR::WORLD::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+		return false;
+	}
+	if (header.magic != WORLD_FILE_MAGIC || header.version != WORLD_FILE_VERSION || header.chunkSize != CHUNK_SIZE
+		|| header.size[0] <= 0 || header.size[1] <= 0 || header.size[2] <= 0)
+	{
+		std::cout << "ERROR::WORLD::BAD_HEADER " << path << std::endl;
+		return false;
+	}
+
+	m_size = glm::ivec3(header.size[0], header.size[1], header.size[2]);
+	m_dims = (m_size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	m_table.resize(size_t(m_dims.x) * m_dims.y * m_dims.z);
+	m_file.seekg(header.tableOffset);
+	if (!m_file.read((char*)m_table.data(), m_table.size() * sizeof(uint64_t)))
+	{
+		std::cout << "ERROR::WORLD::BAD_CHUNK_TABLE " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool WorldFileReader::readChunk(uint32_t chunk, uint32_t* voxels)
+{
+	uint64_t entry = m_table[chunk];
+	if (entry & WORLD_CHUNK_UNIFORM)
+	{
+		std::fill(voxels, voxels + CHUNK_VOXELS, uint32_t(entry));
+		return true;
+	}
+
+	m_file.seekg(entry);
+	return (bool)m_file.read((char*)voxels, CHUNK_BYTES);
+}
+
+void StreamedWorld::editVoxel(glm::ivec3 map, uint32_t voxel)
+{
+	glm::ivec3 size = m_reader.size(), dims = m_reader.chunkDims(), chunk = map >> CHUNK_SHIFT, local = map & (CHUNK_SIZE - 1);
+	if (glm::any(glm::lessThan(map, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(map, size)))
+		return;
+
+	uint64_t index = (uint64_t(chunk.y) * dims.z + chunk.z) * dims.x + chunk.x;
+	m_edits[index * CHUNK_VOXELS + (local.y * CHUNK_SIZE + local.z) * CHUNK_SIZE + local.x] = voxel;
+}
+
+bool StreamedWorld::read(glm::ivec3 lo, glm::ivec3 size, World& box)
+{
+	box.size = size;
+	box.layout = WORLD_LINEAR;
+	box.voxels.assign(size_t(size.x) * size.y * size.z, 0);
+
+	glm::ivec3 dims = m_reader.chunkDims(), hi = lo + size;
+	glm::ivec3 first = lo >> CHUNK_SHIFT, last = (hi - 1) >> CHUNK_SHIFT;
+	uint32_t voxels[CHUNK_VOXELS];
+	for (int cy = first.y; cy <= last.y; cy++)
+		for (int cz = first.z; cz <= last.z; cz++)
+			for (int cx = first.x; cx <= last.x; cx++)
+			{
+				uint32_t chunk = uint32_t((cy * dims.z + cz) * dims.x + cx);
+				if (!m_reader.readChunk(chunk, voxels))
+				{
+					std::cout << "ERROR::WORLD::BAD_CHUNK " << chunk << std::endl;
+					return false;
+				}
+				uint64_t chunkStart = uint64_t(chunk) * CHUNK_VOXELS;
+				for (auto edit = m_edits.lower_bound(chunkStart); edit != m_edits.end() && edit->first < chunkStart + CHUNK_VOXELS; ++edit)
+					voxels[edit->first - chunkStart] = edit->second;
+
+				// Copy the rows of x that fall in the box
+				glm::ivec3 base = glm::ivec3(cx, cy, cz) * CHUNK_SIZE;
+				glm::ivec3 from = glm::max(lo, base), to = glm::min(hi, base + CHUNK_SIZE);
+				for (int y = from.y; y < to.y; y++)
+					for (int z = from.z; z < to.z; z++)
+						std::copy(&voxels[((y - base.y) * CHUNK_SIZE + z - base.z) * CHUNK_SIZE + from.x - base.x],
+							&voxels[((y - base.y) * CHUNK_SIZE + z - base.z) * CHUNK_SIZE + to.x - base.x],
+							&box.voxels[box.index(glm::ivec3(from.x, y, z) - lo)]);
+			}
+	return true;
+}
+
+bool loadWorldFile(const char* path, World& world)
+{
+	WorldFileReader reader;
+	if (!reader.open(path))
+		return false;
+
+	glm::ivec3 size = reader.size(), dims = reader.chunkDims();
+	if (int64_t(size.x) * size.y * size.z > WORLD_MAX_LOADED_VOXELS)
+	{
+		std::cout << "ERROR::WORLD::TOO_LARGE_TO_LOAD " << path << std::endl;
+		return false;
+	}
+
+	world.size = size;
+	world.layout = WORLD_LINEAR;
+	world.voxels.assign(size_t(size.x) * size.y * size.z, 0);
+	uint32_t voxels[CHUNK_VOXELS];
+	for (uint32_t chunk = 0; chunk < uint32_t(dims.x * dims.y * dims.z); chunk++)
+	{
+		if (!reader.readChunk(chunk, voxels))
+		{
+			std::cout << "ERROR::WORLD::BAD_CHUNK " << chunk << " in " << path << std::endl;
+			return false;
+		}
+
+		// Copy rows of x, clipped to the world at its far edges
+		glm::ivec3 base = glm::ivec3(chunk % dims.x, chunk / (dims.x * dims.z), (chunk / dims.x) % dims.z) * CHUNK_SIZE;
+		int width = std::min(CHUNK_SIZE, size.x - base.x);
+		for (int y = 0; y < std::min(CHUNK_SIZE, size.y - base.y); y++)
+			for (int z = 0; z < std::min(CHUNK_SIZE, size.z - base.z); z++)
+				std::copy_n(&voxels[(y * CHUNK_SIZE + z) * CHUNK_SIZE], width, &world.voxels[world.index(base + glm::ivec3(0, y, z))]);
+	}
+	return true;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "ChunkCache.h"
+#include "World.h"
+
+#include <fstream>
+#include <map>
+#include <string>
+
+// "VXWD"
+#define WORLD_FILE_MAGIC 0x44575856u
+#define WORLD_FILE_VERSION 1
+// Chunk table entries with this bit set hold a voxel value filling the whole chunk in
+// their low 32 bits. Otherwise they hold the file offset of CHUNK_VOXELS raw values.
+#define WORLD_CHUNK_UNIFORM (1ull << 63)
+// Largest world loadWorldFile() will put in a World, which indexes voxels with an int.
+// Larger worlds are read a part at a time through StreamedWorld instead.
+#define WORLD_MAX_LOADED_VOXELS (1ll << 31)
+
+// Chunked binary world, in host byte order:
+//
+//   WorldFileHeader
+//   raw chunks, CHUNK_VOXELS values each, x fastest, then z, then y
+//   chunk table, one uint64_t per chunk in ChunkCache::chunkIndex() order
+//
+// Empty and solid chunks take no space beyond their table entry, so large worlds
+// that are mostly air and rock stay small. Any chunk can be read on its own.
+struct WorldFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	int32_t size[3];
+	uint32_t chunkSize;
+	uint64_t tableOffset;
+};
+
+// Writes chunks as they are produced. Chunks must be added in chunk index order;
+// finish() writes the table and header.
+class WorldFileWriter
+{
+public:
+	bool open(const char* path, glm::ivec3 size);
+	void addChunk(const uint32_t* voxels);
+	bool finish();
+
+	uint64_t uniformChunks() const { return m_uniform; }
+	uint64_t rawChunks() const { return m_table.size() - m_uniform; }
+
+private:
+	std::ofstream m_file;
+	std::string m_path;
+	WorldFileHeader m_header;
+	std::vector<uint64_t> m_table;
+	uint64_t m_uniform = 0;
+};
+
+// Random access to the chunks of a world file
+class WorldFileReader
+{
+public:
+	bool open(const char* path);
+
+	glm::ivec3 size() const { return m_size; }
+	glm::ivec3 chunkDims() const { return m_dims; }
+
+	// Fills CHUNK_VOXELS values, x fastest, then z, then y
+	bool readChunk(uint32_t chunk, uint32_t* voxels);
+
+private:
+	std::ifstream m_file;
+	glm::ivec3 m_size, m_dims;
+	std::vector<uint64_t> m_table;
+};
+
+// A world file read a box at a time, with voxel edits kept in memory on top, for
+// worlds too large to load whole. Each thread reading the world opens its own.
+class StreamedWorld
+{
+public:
+	bool open(const char* path) { return m_reader.open(path); }
+
+	glm::ivec3 size() const { return m_reader.size(); }
+
+	// Ignored outside the world
+	void editVoxel(glm::ivec3 map, uint32_t voxel);
+
+	// Makes box a linear World of the given size holding the voxels from lo on, edits
+	// included. The box must lie within the world.
+	bool read(glm::ivec3 lo, glm::ivec3 size, World& box);
+
+private:
+	WorldFileReader m_reader;
+	// Keyed by chunk index, then voxel within the chunk as the file orders them, so
+	// each chunk's edits sit together
+	std::map<uint64_t, uint32_t> m_edits;
+};
+
+// Reads a whole world file into world
+bool loadWorldFile(const char* path, World& world);
@@ -0,0 +1,252 @@
+#include "WorldGen.h"
+#include "CpuRenderer.h"
+#include "Parallel.h"
+#include "WorldFile.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+// Independent noise fields drawn from one seed
+#define FIELD_TERRAIN 0
+#define FIELD_CAVE_A 100
+#define FIELD_CAVE_B 200
+#define FIELD_BUILDINGS 300
+
+#define CAVE_SAMPLES (CHUNK_SIZE / GEN_CAVE_STEP + 1)
+
+static uint32_t latticeHash(uint32_t seed, int x, int y, int z)
+{
+	return pcgHash(seed ^ pcgHash(uint32_t(x) + pcgHash(uint32_t(y) + pcgHash(uint32_t(z)))));
+}
+
+static float unitFloat(uint32_t hash)
+{
+	return float(hash >> 8) / 16777216.0f;
+}
+
+static float fade(float t)
+{
+	return t * t * (3.0f - 2.0f * t);
+}
+
+// Smoothly interpolated random values on the integer lattice, in [0, 1)
+static float valueNoise(uint32_t seed, glm::fvec3 p)
+{
+	glm::fvec3 cell = glm::floor(p);
+	glm::ivec3 i = glm::ivec3(cell);
+	glm::fvec3 t = p - cell;
+	t = glm::fvec3(fade(t.x), fade(t.y), fade(t.z));
+
+	float corners[8];
+	for (int c = 0; c < 8; c++)
+		corners[c] = unitFloat(latticeHash(seed, i.x + (c & 1), i.y + ((c >> 1) & 1), i.z + (c >> 2)));
+
+	float x00 = glm::mix(corners[0], corners[1], t.x), x10 = glm::mix(corners[2], corners[3], t.x);
+	float x01 = glm::mix(corners[4], corners[5], t.x), x11 = glm::mix(corners[6], corners[7], t.x);
+	return glm::mix(glm::mix(x00, x10, t.y), glm::mix(x01, x11, t.y), t.z);
+}
+
+WorldGenerator::WorldGenerator(const WorldGenSettings& settings)
+	: m_settings(settings)
+{
+	glm::ivec3 size = settings.size;
+	uint32_t seed = pcgHash(settings.seed + FIELD_TERRAIN);
+	m_heights.resize(size_t(size.x) * size.z);
+	parallelFor(0, size.z, [&](int z)
+	{
+		for (int x = 0; x < size.x; x++)
+		{
+			float sum = 0, amplitude = 1, total = 0, frequency = 1.0f / GEN_TERRAIN_SCALE;
+			for (int octave = 0; octave < GEN_TERRAIN_OCTAVES; octave++)
+			{
+				sum += amplitude * valueNoise(seed + octave, glm::fvec3(x, 0, z) * frequency);
+				total += amplitude;
+				amplitude *= 0.5f;
+				frequency *= 2.0f;
+			}
+			int h = int(size.y * (0.2f + 0.5f * sum / total));
+			m_heights[size_t(z) * size.x + x] = glm::clamp(h, 1, size.y);
+		}
+	});
+
+	m_plots = (glm::ivec2(size.x, size.z) + GEN_PLOT - 1) / GEN_PLOT;
+	m_buildings.resize(size_t(m_plots.x) * m_plots.y);
+	parallelFor(0, m_plots.y, [&](int pz)
+	{
+		for (int px = 0; px < m_plots.x; px++)
+		{
+			Building& b = m_buildings[size_t(pz) * m_plots.x + px];
+			b.min = glm::ivec3(0, 1, 0);
+			b.max = glm::ivec3(0);
+
+			uint32_t h = latticeHash(settings.seed + FIELD_BUILDINGS, px, 0, pz);
+			if (unitFloat(h) >= GEN_BUILDING_CHANCE)
+				continue;
+
+			glm::ivec2 footprint;
+			glm::ivec2 corner;
+			for (int i = 0; i < 2; i++)
+			{
+				footprint[i] = 12 + (h = pcgHash(h)) % 21;
+				corner[i] = 4 + (h = pcgHash(h)) % (GEN_PLOT - 8 - footprint[i] + 1);
+			}
+			int storeys = 2 + (h = pcgHash(h)) % 7;
+
+			glm::ivec2 min = glm::ivec2(px, pz) * GEN_PLOT + corner, max = min + footprint - 1;
+			if (max.x >= size.x || max.y >= size.z)
+				continue;
+			int ground = height((min.x + max.x) / 2, (min.y + max.y) / 2);
+			b.min = glm::ivec3(min.x, ground, min.y);
+			b.max = glm::ivec3(max.x, ground + storeys * GEN_STOREY, max.y);
+		}
+	});
+}
+
+uint32_t WorldGenerator::buildingVoxel(const Building& b, glm::ivec3 p) const
+{
+	if (p.y == b.max.y)
+		return GEN_ROOF;
+
+	int level = p.y - b.min.y;
+	bool wallX = p.x == b.min.x || p.x == b.max.x;
+	bool wallZ = p.z == b.min.z || p.z == b.max.z;
+	if (!wallX && !wallZ)
+		return level % GEN_STOREY == 0 ? GEN_WALL : 0;
+
+	// A door in the middle of the front, and windows along every wall but the corners
+	if (p.z == b.min.z && !wallX && level >= 1 && level <= 3 && std::abs(p.x - (b.min.x + b.max.x) / 2) <= 1)
+		return 0;
+	int along = wallX ? p.z - b.min.z : p.x - b.min.x;
+	if (!(wallX && wallZ) && level % GEN_STOREY >= 2 && level % GEN_STOREY <= 3 && along % 4 >= 1 && along % 4 <= 2)
+		return 0;
+	return GEN_WALL;
+}
+
+void WorldGenerator::generateChunk(glm::ivec3 chunk, uint32_t* voxels) const
+{
+	std::fill(voxels, voxels + CHUNK_VOXELS, 0);
+
+	glm::ivec3 size = m_settings.size;
+	glm::ivec3 base = chunk * CHUNK_SIZE;
+	glm::ivec3 end = glm::min(base + CHUNK_SIZE, size);
+
+	// Buildings on the plots under this chunk
+	const Building* buildings[4];
+	int buildingCount = 0;
+	int top = 0;
+	for (int pz = base.z / GEN_PLOT; pz <= (end.z - 1) / GEN_PLOT; pz++)
+		for (int px = base.x / GEN_PLOT; px <= (end.x - 1) / GEN_PLOT; px++)
+		{
+			const Building& b = m_buildings[size_t(pz) * m_plots.x + px];
+			if (b.min.y > b.max.y || b.max.x < base.x || b.min.x >= end.x || b.max.z < base.z || b.min.z >= end.z)
+				continue;
+			buildings[buildingCount++] = &b;
+			top = std::max(top, b.max.y + 1);
+		}
+
+	// Chunks of sky are by far the most common, so skip them before any noise
+	for (int z = base.z; z < end.z; z++)
+		for (int x = base.x; x < end.x; x++)
+			top = std::max(top, height(x, z));
+	if (base.y >= top)
+		return;
+
+	// Both cave fields on a coarse grid over the chunk, in world positions so neighbouring chunks agree
+	float caves[2][CAVE_SAMPLES][CAVE_SAMPLES][CAVE_SAMPLES];
+	for (int field = 0; field < 2; field++)
+	{
+		uint32_t seed = pcgHash(m_settings.seed + (field ? FIELD_CAVE_B : FIELD_CAVE_A));
+		for (int y = 0; y < CAVE_SAMPLES; y++)
+			for (int z = 0; z < CAVE_SAMPLES; z++)
+				for (int x = 0; x < CAVE_SAMPLES; x++)
+					caves[field][y][z][x] = valueNoise(seed, glm::fvec3(base + glm::ivec3(x, y, z) * GEN_CAVE_STEP) / GEN_CAVE_SCALE);
+	}
+	auto cave = [&](glm::ivec3 local)
+	{
+		glm::ivec3 i = local / GEN_CAVE_STEP;
+		glm::fvec3 t = glm::fvec3(local % GEN_CAVE_STEP) / float(GEN_CAVE_STEP);
+		for (int field = 0; field < 2; field++)
+		{
+			float (&f)[CAVE_SAMPLES][CAVE_SAMPLES][CAVE_SAMPLES] = caves[field];
+			float x00 = glm::mix(f[i.y][i.z][i.x], f[i.y][i.z][i.x + 1], t.x);
+			float x10 = glm::mix(f[i.y + 1][i.z][i.x], f[i.y + 1][i.z][i.x + 1], t.x);
+			float x01 = glm::mix(f[i.y][i.z + 1][i.x], f[i.y][i.z + 1][i.x + 1], t.x);
+			float x11 = glm::mix(f[i.y + 1][i.z + 1][i.x], f[i.y + 1][i.z + 1][i.x + 1], t.x);
+			if (std::abs(glm::mix(glm::mix(x00, x10, t.y), glm::mix(x01, x11, t.y), t.z) - 0.5f) >= GEN_CAVE_WIDTH)
+				return false;
+		}
+		return true;
+	};
+
+	for (int y = base.y; y < end.y; y++)
+		for (int z = base.z; z < end.z; z++)
+			for (int x = base.x; x < end.x; x++)
+			{
+				glm::ivec3 p(x, y, z);
+				int ground = height(x, z);
+				uint32_t voxel = 0;
+				if (y < ground)
+				{
+					voxel = y == ground - 1 ? GEN_GRASS : (y >= ground - GEN_DIRT_DEPTH ? GEN_DIRT : GEN_STONE);
+					// Bedrock at the bottom is never carved
+					if (voxel == GEN_STONE && y > 0 && cave(p - base))
+						voxel = 0;
+				}
+
+				for (int i = 0; i < buildingCount; i++)
+				{
+					const Building& b = *buildings[i];
+					if (x < b.min.x || x > b.max.x || z < b.min.z || z > b.max.z || y > b.max.y)
+						continue;
+					if (y >= b.min.y)
+						voxel = buildingVoxel(b, p);
+					else if (y >= ground)
+						voxel = GEN_WALL; // Foundations down to the terrain
+				}
+
+				voxels[ChunkCache::voxelOffset(p, WORLD_LINEAR)] = voxel;
+			}
+}
+
+int generateWorldFile(const char* path, const WorldGenSettings& settings)
+{
+	auto start = std::chrono::steady_clock::now();
+	glm::ivec3 size = settings.size;
+	if (size.x <= 0 || size.y <= 0 || size.z <= 0)
+	{
+		std::cout << "ERROR::WORLD::BAD_SIZE" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	WorldGenerator generator(settings);
+	WorldFileWriter writer;
+	if (!writer.open(path, size))
+		return EXIT_FAILURE;
+
+	// A layer of chunks is generated in parallel, then written in chunk index order
+	// on this thread, so the file is the same whatever the thread count
+	glm::ivec3 dims = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	int layerChunks = dims.x * dims.z;
+	std::vector<uint32_t> layer(size_t(layerChunks) * CHUNK_VOXELS);
+	for (int y = 0; y < dims.y; y++)
+	{
+		parallelFor(0, layerChunks, [&](int i)
+		{
+			generator.generateChunk(glm::ivec3(i % dims.x, y, i / dims.x), &layer[size_t(i) * CHUNK_VOXELS]);
+		}, 16);
+		for (int i = 0; i < layerChunks; i++)
+			writer.addChunk(&layer[size_t(i) * CHUNK_VOXELS]);
+		std::cout << "\rLayer " << y + 1 << " of " << dims.y << std::flush;
+	}
+	std::cout << std::endl;
+
+	if (!writer.finish())
+		return EXIT_FAILURE;
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << "Generated " << size.x << "x" << size.y << "x" << size.z << " world with seed " << settings.seed << " in "
+		<< elapsed.count() << " s: " << writer.rawChunks() << " chunks stored, " << writer.uniformChunks() << " uniform" << std::endl;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "ChunkCache.h"
+
+// Voxel IDs, coloured by the materials in materials.txt
+#define GEN_GRASS 6
+#define GEN_DIRT 5
+#define GEN_STONE 3
+#define GEN_WALL 2
+#define GEN_ROOF 8
+
+// Wavelength of the coarsest terrain octave, and the octaves summed
+#define GEN_TERRAIN_SCALE 256.0f
+#define GEN_TERRAIN_OCTAVES 5
+#define GEN_DIRT_DEPTH 4
+// Caves are carved where two noise fields of this wavelength both come within
+// GEN_CAVE_WIDTH of their midpoint, which leaves winding tunnels. The fields are
+// sampled every GEN_CAVE_STEP voxels and interpolated.
+#define GEN_CAVE_SCALE 40.0f
+#define GEN_CAVE_WIDTH 0.06f
+#define GEN_CAVE_STEP 4
+// Buildings stand on a grid of square plots, at most one per plot
+#define GEN_PLOT 48
+#define GEN_BUILDING_CHANCE 0.3f
+#define GEN_STOREY 6
+
+struct WorldGenSettings
+{
+	glm::ivec3 size;
+	uint32_t seed;
+};
+
+// Procedural worlds for testing at scale:
+//   terrain   fractal value noise height map, grass over dirt over stone
+//   caves     tunnels through the rock below the surface
+//   buildings hollow boxes with floors, windows, a door and a roof on random plots
+//
+// Construction lays out the height map and buildings in parallel. After that each
+// chunk depends on nothing but the seed and its position, so chunks can be made in
+// any order on any number of threads and a world only depends on its seed and size.
+class WorldGenerator
+{
+public:
+	explicit WorldGenerator(const WorldGenSettings& settings);
+
+	int height(int x, int z) const { return m_heights[size_t(z) * m_settings.size.x + x]; }
+
+	// Fills CHUNK_VOXELS values, x fastest, then z, then y, as world files store them.
+	// Voxels past the world edge are empty.
+	void generateChunk(glm::ivec3 chunk, uint32_t* voxels) const;
+
+private:
+	struct Building
+	{
+		glm::ivec3 min, max; // Inclusive, max.y is the roof
+	};
+
+	uint32_t buildingVoxel(const Building& b, glm::ivec3 p) const;
+
+	WorldGenSettings m_settings;
+	glm::ivec2 m_plots;
+	std::vector<int> m_heights;
+	std::vector<Building> m_buildings; // One per plot, empty plots have min.y > max.y
+};
+
+// Generates a whole world straight into a world file (see WorldFile.h), a layer of
+// chunks at a time with the chunks of each layer in parallel, so memory use stays at
+// one layer plus the height map whatever the world size.
+int generateWorldFile(const char* path, const WorldGenSettings& settings);
@@ -0,0 +1,61 @@
+#version 430 core
+
+// One pass of the edge-avoiding a-trous wavelet filter (Dammertz et al. 2010).
+// A 5x5 B3-spline kernel is spread out by step_width, and taps are rejected or
+// down-weighted when the primary hit's face, voxel or distance differ.
+// Mirrored on the CPU in Denoise.cpp, which also sets the per-pass sigma_colour.
+
+#define SIGMA_DEPTH 0.05
+
+in vec4 gl_FragCoord;
+out vec4 pxColour;
+
+uniform sampler2D colour_tex;
+uniform sampler2D guide_tex;
+uniform int step_width;
+uniform float sigma_colour;
+
+const float kernel[3] = float[](3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0);
+
+void main()
+{
+	ivec2 p = ivec2(gl_FragCoord.xy);
+	ivec2 size = textureSize(colour_tex, 0);
+	vec4 c = texelFetch(colour_tex, p, 0);
+	vec4 g = texelFetch(guide_tex, p, 0);
+
+	// Nothing was hit, so there is nothing to filter
+	if (g.a == 0)
+	{
+		pxColour = c;
+		return;
+	}
+
+	vec3 sum = vec3(0);
+	float weights = 0;
+	for (int dy = -2; dy <= 2; dy++)
+	{
+		for (int dx = -2; dx <= 2; dx++)
+		{
+			ivec2 q = p + ivec2(dx, dy) * step_width;
+			if (q.x < 0 || q.y < 0 || q.x >= size.x || q.y >= size.y)
+				continue;
+
+			vec4 gq = texelFetch(guide_tex, q, 0);
+			if (gq.a == 0 || gq.r != g.r || gq.b != g.b)
+				continue;
+
+			vec3 cq = texelFetch(colour_tex, q, 0).rgb;
+			vec3 dc = cq - c.rgb;
+
+			float w = kernel[abs(dx)] * kernel[abs(dy)];
+			w *= exp(-abs(gq.g - g.g) / (SIGMA_DEPTH * step_width * g.g));
+			w *= exp(-dot(dc, dc) / sigma_colour);
+
+			sum += cq * w;
+			weights += w;
+		}
+	}
+
+	pxColour = vec4(sum / weights, 1.0);
+}
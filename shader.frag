@@ -2,38 +2,137 @@
 
 #define FLT_MAX 3.402823466e+38
 
-#define MAP_WIDTH 24
-#define MAP_HEIGHT 24
-#define MAP_DEPTH 4
-
 #define NUM_TEXTURES 8
 #define TEX_WIDTH 64
 #define TEX_HEIGHT 64
 
+#define LIGHT_CELL_SIZE 4
+#define SHADOW_BIAS 1e-3
+
+#define PT_MAX_BOUNCES 4
+#define TWO_PI 6.28318530718
+
+#define AO_BITS 5u
+#define AO_MAX 31u
+
+#define LOD_LEVELS 4
+#define LOD_MATERIAL_MASK 0xFFFFu
+#define LOD_OCCUPANCY_SHIFT 16
+#define LOD_SOLID 128u
+
+#define CHUNK_SHIFT 3
+#define CHUNK_SIZE 8
+#define CHUNK_VOXELS 512u
+#define CHUNK_SLOT_VOXELS 1024u
+#define CHUNK_NOT_RESIDENT 0xFFFFFFFFu
+#define PAGE_SHIFT 2
+#define PAGE_SIZE 4
+#define PAGE_CHUNKS 64u
+#define PAGE_NOT_ALLOCATED 0xFFFFFFFFu
+
+#define FIXED_SHIFT 16
+#define FIXED_ONE 65536
+#define FIXED_INFINITY 0xFFFFFFFFu
+
 in vec4 gl_FragCoord;
-out vec4 pxColour;
+layout(location = 0) out vec4 pxColour;
+// Denoiser guide for the primary hit: (face, distance, voxel, 1), or 0 on a miss
+layout(location = 1) out vec4 guide;
 
 uniform ivec2 w_size;
 uniform float fov;
 uniform vec3 pos;
 uniform vec2 theta;
+// In voxels, all of it whether or not its chunks are resident
+uniform ivec3 world_size;
+uniform ivec3 light_grid_dims;
+uniform sampler3D light_volume;
+uniform vec3 light_volume_size;
+uniform bool use_light_volume;
+uniform bool path_trace;
+uniform uint sample_index;
+uniform bool use_lod;
+uniform bool fixed_dda;
+uniform float lod_pixels;
+uniform ivec3 lod_dims[LOD_LEVELS];
+uniform int lod_offsets[LOD_LEVELS];
+uniform ivec3 chunk_dims;
+uniform ivec3 page_dims;
+// Where the page pool starts in page_table, after the directory
+uniform uint page_pool_offset;
+uniform uint feedback_capacity;
+uniform bool morton_layout;
 
 struct Light {
     vec3 position;
     float intensity;
+    vec3 colour;
+    float radius;
 };
 
+// Must match Material in Materials.h
 struct Material {
-	float specular;
-	float diffuse;
-	float ambient;
-	float shine;
+	vec3 albedo;
+	float roughness;
+	vec3 emissive;
+	float padding;
 };
 
 layout(std430, binding = 3) buffer dataLayout
 {
 	uint textures[NUM_TEXTURES * TEX_WIDTH * TEX_HEIGHT];
-	uint world_map[];
+};
+
+// Indexed by voxel ID, entry 0 standing in for IDs past the end, see Materials.h
+layout(std430, binding = 12) buffer materialLayout
+{
+	Material materials[];
+};
+
+// Resident world chunks, each slot holding CHUNK_VOXELS voxels and then their face
+// AO (AO_BITS of openness per face, see AmbientOcclusion.h), see ChunkCache.h
+layout(std430, binding = 9) buffer chunkPoolLayout
+{
+	uint chunk_pool[];
+};
+
+// Pool page per page of PAGE_CHUNKS chunks, or PAGE_NOT_ALLOCATED, then from
+// page_pool_offset the pages themselves, holding a pool slot per chunk or
+// CHUNK_NOT_RESIDENT, see ChunkCache.h
+layout(std430, binding = 10) buffer pageTableLayout
+{
+	uint page_table[];
+};
+
+// Count of chunks rays looked at this frame, then up to feedback_capacity of their
+// indices, then a seen bit per chunk so each is listed once. Read back to drive
+// streaming, see ChunkFeedback.h.
+layout(std430, binding = 11) buffer chunkFeedbackLayout
+{
+	uint chunk_feedback[];
+};
+
+// Running sum of path samples per pixel, restarted when sample_index is 0
+layout(std430, binding = 7) buffer accumLayout
+{
+	vec4 accum[];
+};
+
+// Coarse levels of the world, see VoxelPyramid.h for the packing
+layout(std430, binding = 8) buffer lodLayout
+{
+	uint lod_cells[];
+};
+
+layout(std430, binding = 4) buffer lightLayout
+{
+	Light lights[];
+};
+
+// (offset, count) pair per culling cell, followed by the light indices
+layout(std430, binding = 5) buffer lightGridLayout
+{
+	uint light_grid[];
 };
 
 mat3 rotationMatrix(vec3 axis, float angle)
@@ -48,105 +147,449 @@ mat3 rotationMatrix(vec3 axis, float angle)
 				oc * axis.z * axis.x - axis.y * s, oc * axis.y * axis.z + axis.x * s, oc * axis.z * axis.z + c);
 }
 
-vec3 cast_ray(const vec3 origin, const vec3 dir)
+// Offset of a voxel within its chunk: Z-order for Morton worlds, the same as
+// mortonOffset() in World.h, otherwise x fastest, then z, then y
+uint chunk_offset(const ivec3 local)
 {
-	ivec3 map = ivec3(origin);
-	ivec3 stepAmount;
+	if (!morton_layout)
+		return uint((local.y * CHUNK_SIZE + local.z) * CHUNK_SIZE + local.x);
+	ivec3 spread = (local & 1) | ((local & 2) << 2) | ((local & 4) << 4);
+	return uint(spread.x | (spread.y << 1) | (spread.z << 2));
+}
+
+// Lists a chunk in the feedback the first time a ray looks at it this frame. The
+// count keeps going past the capacity so the host can tell the list is short.
+void touch_chunk(const uint index)
+{
+	uint word = 1u + feedback_capacity + (index >> 5u), bit = 1u << (index & 31u);
+	if ((chunk_feedback[word] & bit) != 0u || (atomicOr(chunk_feedback[word], bit) & bit) != 0u)
+		return;
+	uint n = atomicAdd(chunk_feedback[0], 1u);
+	if (n < feedback_capacity)
+		chunk_feedback[1u + n] = index;
+}
+
+// Pool slot of a chunk through the directory and its page, or CHUNK_NOT_RESIDENT
+uint chunk_slot(const ivec3 chunk)
+{
+	ivec3 page = chunk >> PAGE_SHIFT, local = chunk & (PAGE_SIZE - 1);
+	uint pool_page = page_table[(page.y * page_dims.z + page.z) * page_dims.x + page.x];
+	if (pool_page == PAGE_NOT_ALLOCATED)
+		return CHUNK_NOT_RESIDENT;
+	return page_table[page_pool_offset + pool_page * PAGE_CHUNKS + uint((local.y * PAGE_SIZE + local.z) * PAGE_SIZE + local.x)];
+}
+
+// Voxel at map through the page table. Chunks that aren't resident yet read as
+// empty and are flagged so the host streams them in.
+uint world_voxel(const ivec3 map)
+{
+	ivec3 chunk = map >> CHUNK_SHIFT;
+	touch_chunk(uint((chunk.y * chunk_dims.z + chunk.z) * chunk_dims.x + chunk.x));
+
+	uint slot = chunk_slot(chunk);
+	if (slot == CHUNK_NOT_RESIDENT)
+		return 0u;
+
+	return chunk_pool[slot * CHUNK_SLOT_VOXELS + chunk_offset(map & (CHUNK_SIZE - 1))];
+}
+
+// Packed face AO of a voxel that was hit, so its chunk is resident
+uint world_ao(const ivec3 map)
+{
+	uint slot = chunk_slot(map >> CHUNK_SHIFT);
+	return chunk_pool[slot * CHUNK_SLOT_VOXELS + CHUNK_VOXELS + chunk_offset(map & (CHUNK_SIZE - 1))];
+}
+
+// Distance along dir to the first boundary on each axis. Axes the ray never crosses
+// get FLT_MAX so they never win next_axis().
+vec3 first_boundaries(const vec3 origin, const vec3 dir, const ivec3 map, const vec3 tDelta)
+{
+	vec3 to_boundary = mix(vec3(map) + 1.0 - origin, origin - vec3(map), lessThan(dir, vec3(0)));
+	return mix(to_boundary * tDelta, vec3(FLT_MAX), equal(dir, vec3(0)));
+}
+
+// One-hot mask of the axis whose boundary the ray crosses next, picked without
+// branches so neighbouring pixels never diverge over it. Ties go the same way as in
+// castRay(): x only when strictly first, then y before z.
+bvec3 next_axis(const vec3 tMax)
+{
+	bool x = all(lessThan(tMax.xx, tMax.yz));
+	bool y = !x && tMax.y < tMax.z;
+	return bvec3(x, y, !(x || y));
+}
+
+// Any-hit traversal for shadow rays. Returns true as soon as a solid voxel is
+// found closer than maxDist. No hit side or distance bookkeeping is needed.
+bool occluded(const vec3 origin, const vec3 dir, const float maxDist)
+{
+	ivec3 map = ivec3(floor(origin));
+	ivec3 stepAmount = ivec3(sign(dir));
 	vec3 tDelta = abs(1.0 / dir);
-	vec3 tMax;
-	uint voxel;
-	int side;
+	vec3 tMax = first_boundaries(origin, dir, map, tDelta);
 
-	if (dir.x < 0)
+	while (true)
 	{
-		stepAmount.x = -1;
-		tMax.x = (origin.x - map.x) * tDelta.x;
+		bvec3 axis = next_axis(tMax);
+		if (min(tMax.x, min(tMax.y, tMax.z)) >= maxDist)
+			return false;
+
+		// Negative coordinates wrap to huge unsigned ones, so one test covers both sides
+		map += ivec3(axis) * stepAmount;
+		if (any(greaterThanEqual(uvec3(map), uvec3(world_size))))
+			return false;
+		tMax = mix(tMax, tMax + tDelta, axis);
+
+		if (world_voxel(map) != 0)
+			return true;
 	}
-	else if (dir.x > 0)
-	{
-		stepAmount.x = 1;
-		tMax.x = (map.x + 1.0 - origin.x) * tDelta.x;
-	}
-	else
+}
+
+vec3 light_contribution(const Light l, const vec3 shadow_origin, const vec3 normal)
+{
+	vec3 to_light = l.position - shadow_origin;
+	float light_dist = length(to_light);
+	if (light_dist >= l.radius)
+		return vec3(0);
+
+	vec3 light_dir = to_light / light_dist;
+	float n_dot_l = dot(normal, light_dir);
+	if (n_dot_l <= 0 || occluded(shadow_origin, light_dir, light_dist))
+		return vec3(0);
+
+	float falloff = 1.0 - light_dist / l.radius;
+	return l.colour * (l.intensity * n_dot_l * falloff * falloff);
+}
+
+uint light_cell(const vec3 point)
+{
+	ivec3 cell = clamp(ivec3(point) / LIGHT_CELL_SIZE, ivec3(0), light_grid_dims - 1);
+	return (cell.y * light_grid_dims.z + cell.z) * light_grid_dims.x + cell.x;
+}
+
+// Sum of direct light from every light in the hit point's culling cell,
+// with a shadow ray towards each light that could contribute
+vec3 direct_light(const vec3 point, const vec3 normal)
+{
+	vec3 shadow_origin = point + normal * SHADOW_BIAS;
+	uint cell_index = light_cell(shadow_origin);
+	uint offset = light_grid[cell_index * 2];
+	uint count = light_grid[cell_index * 2 + 1];
+
+	vec3 total = vec3(0);
+	for (uint i = 0; i < count; i++)
+		total += light_contribution(lights[light_grid[offset + i]], shadow_origin, normal);
+
+	return total;
+}
+
+// Moves a ray from outside the map to the voxel where it enters it, as enterDDA()
+// in Traversal.cpp does. Returns false if the ray misses the map.
+bool enter_map(const vec3 origin, const vec3 dir, const ivec3 stepAmount, const vec3 tDelta, inout ivec3 map, inout vec3 tMax, out int side)
+{
+	ivec3 dims = world_size;
+	float t_near = -FLT_MAX, t_far = FLT_MAX;
+	int axis = -1;
+	for (int i = 0; i < 3; i++)
 	{
-		stepAmount.x = 0;
-		tMax.x = 0;
+		// A ray along an axis stays in the row of voxels it starts in
+		if (dir[i] == 0)
+		{
+			if (origin[i] < 0 || origin[i] >= dims[i])
+				return false;
+			continue;
+		}
+
+		float t0 = -origin[i] / dir[i];
+		float t1 = (dims[i] - origin[i]) / dir[i];
+		if (t0 > t1)
+		{
+			float t = t0;
+			t0 = t1;
+			t1 = t;
+		}
+		if (t0 > t_near)
+		{
+			t_near = t0;
+			axis = i;
+		}
+		t_far = min(t_far, t1);
 	}
 
-	if (dir.y < 0)
+	float t_entry = max(t_near, 0.0);
+	if (axis < 0 || t_entry >= t_far)
+		return false;
+
+	// Clamp the rounded entry point into the map, then step over any boundary the
+	// ray crossed just before entering
+	map = clamp(ivec3(floor(origin + dir * t_entry)), ivec3(0), dims - 1);
+	map[axis] = stepAmount[axis] > 0 ? 0 : dims[axis] - 1;
+	for (int i = 0; i < 3; i++)
 	{
-		stepAmount.y = -1;
-		tMax.y = (origin.y - map.y) * tDelta.y;
+		if (stepAmount[i] == 0)
+			continue;
+		tMax[i] = (stepAmount[i] < 0 ? origin[i] - map[i] : map[i] + 1.0 - origin[i]) * tDelta[i];
+		if (i != axis && tMax[i] < t_entry)
+		{
+			map[i] += stepAmount[i];
+			tMax[i] += tDelta[i];
+			if (map[i] < 0 || map[i] >= dims[i])
+				return false;
+		}
 	}
-	else if (dir.y > 0)
+
+	side = axis == 0 ? 0 : (axis == 2 ? 1 : 2);
+	return true;
+}
+
+// Walks the map from origin until a solid voxel is hit. Returns false if the
+// ray leaves the map first. dist is the distance along dir to the hit face.
+// Rays from outside the map start at the voxel where they enter it.
+bool trace(const vec3 origin, const vec3 dir, out ivec3 map, out ivec3 stepAmount, out int side, out uint voxel, out float dist, out vec3 normal)
+{
+	map = ivec3(floor(origin));
+	stepAmount = ivec3(sign(dir));
+	vec3 tDelta = abs(1.0 / dir);
+	vec3 tMax = first_boundaries(origin, dir, map, tDelta);
+
+	voxel = 0;
+	if (any(lessThan(map, ivec3(0))) || any(greaterThanEqual(map, world_size)))
 	{
-		stepAmount.y = 1;
-		tMax.y = (map.y + 1.0 - origin.y) * tDelta.y;
+		if (!enter_map(origin, dir, stepAmount, tDelta, map, tMax, side))
+			return false;
+		voxel = world_voxel(map);
 	}
-	else
+
+	while (voxel == 0)
 	{
-		stepAmount.y = 0;
-		tMax.y = 0;
+		bvec3 axis = next_axis(tMax);
+		map += ivec3(axis) * stepAmount;
+		if (any(greaterThanEqual(uvec3(map), uvec3(world_size))))
+			return false;
+		tMax = mix(tMax, tMax + tDelta, axis);
+		side = axis.x ? 0 : (axis.y ? 2 : 1);
+		voxel = world_voxel(map);
 	}
 
-	if (dir.z < 0)
+	normal = vec3(0);
+	if (side == 0)
 	{
-		stepAmount.z = -1;
-		tMax.z = (origin.z - map.z) * tDelta.z;
+//		dest = origin + tMax.x * dir;
+		dist = (map.x - origin.x + (1 - stepAmount.x) / 2) / dir.x;
+		normal.x = -stepAmount.x;
 	}
-	else if (dir.z > 0)
+	else if (side == 1)
 	{
-		stepAmount.z = 1;
-		tMax.z = (map.z + 1.0 - origin.z) * tDelta.z;
+//		dest = origin + tMax.z * dir;
+		dist =(map.z - origin.z + (1 - stepAmount.z) / 2) / dir.z;
+		normal.z = -stepAmount.z;
 	}
 	else
 	{
-		stepAmount.z = 0;
-		tMax.z = 0;
+//		dest = origin + tMax.y * dir;
+		dist = (map.y - origin.y + (1 - stepAmount.y) / 2) / dir.y;
+		normal.y = -stepAmount.y;
+	}
+
+	return true;
+}
+
+// frac * tDelta in 16.16, saturating at FIXED_INFINITY
+uint scale_fixed(const uint frac, const uint tDelta)
+{
+	uint hi, lo;
+	umulExtended(frac, tDelta, hi, lo);
+	return hi >= uint(FIXED_ONE) ? FIXED_INFINITY : (hi << FIXED_SHIFT) | (lo >> FIXED_SHIFT);
+}
+
+uint add_fixed(const uint a, const uint b)
+{
+	return a > FIXED_INFINITY - b ? FIXED_INFINITY : a + b;
+}
+
+// Integer-only traversal with 16.16 origin, direction and distances, giving the same
+// hits as castRayFixed() in FixedTraversal.cpp on any GPU or CPU. See there.
+bool trace_fixed(const ivec3 origin, const ivec3 dir, const uint maxDist, out ivec3 map, out ivec3 normal, out uint dist, out uint voxel)
+{
+	ivec3 dims = world_size;
+	map = origin >> FIXED_SHIFT;
+	ivec3 stepAmount;
+	uvec3 tDelta, tMax;
+	for (int i = 0; i < 3; i++)
+	{
+		if ((map[i] < 0 && dir[i] <= 0) || (map[i] >= dims[i] && dir[i] >= 0))
+			return false;
+
+		uint speed = uint(abs(dir[i]));
+		uint frac = uint(origin[i] & (FIXED_ONE - 1));
+		stepAmount[i] = dir[i] < 0 ? -1 : 1;
+		tDelta[i] = speed != 0u ? FIXED_INFINITY / speed : FIXED_INFINITY;
+		tMax[i] = speed != 0u ? scale_fixed(dir[i] < 0 ? frac : uint(FIXED_ONE) - frac, tDelta[i]) : FIXED_INFINITY;
 	}
+	bool entering = any(lessThan(map, ivec3(0))) || any(greaterThanEqual(map, dims));
 
-	do
+	while (true)
 	{
-		if (tMax.x < tMax.y)
+		bool x = all(lessThan(tMax.xx, tMax.yz));
+		int axis = x ? 0 : (tMax.y < tMax.z ? 1 : 2);
+
+		dist = tMax[axis];
+		if (dist >= maxDist)
+			return false;
+
+		map[axis] += stepAmount[axis];
+		tMax[axis] = add_fixed(dist, tDelta[axis]);
+
+		// Outside the map on this axis either means leaving it, or still approaching
+		if (uint(map[axis]) >= uint(dims[axis]))
 		{
-			if (tMax.x < tMax.z)
-			{
-				map.x += stepAmount.x;
-				if (map.x >= MAP_WIDTH || map.x < 0)
-					return vec3(0, 0, 0);
-				tMax.x += tDelta.x;
-				side = 0;
-			}
-			else
-			{
-				map.z += stepAmount.z;
-				if (map.z >= MAP_HEIGHT || map.z < 0)
-					return vec3(0, 0, 0);
-				tMax.z += tDelta.z;
-				side = 1;
-			}
+			if ((map[axis] < 0) == (stepAmount[axis] < 0))
+				return false;
+			continue;
 		}
-		else
+		if (entering)
 		{
-			if (tMax.y < tMax.z)
-			{
-				map.y += stepAmount.y;
-				if (map.y >= MAP_DEPTH || map.y < 0)
-					return vec3(0, 0, 0);
-				tMax.y += tDelta.y;
-				side = 2;
-			}
-			else
-			{
-				map.z += stepAmount.z;
-				if (map.z >= MAP_HEIGHT || map.z < 0)
-					return vec3(0, 0, 0);
-				tMax.z += tDelta.z;
-				side = 1;
-			}
+			if (any(lessThan(map, ivec3(0))) || any(greaterThanEqual(map, dims)))
+				continue;
+			entering = false;
 		}
-		voxel = world_map[map.y * MAP_WIDTH * MAP_HEIGHT + map.z * MAP_WIDTH + map.x];
-	} while (voxel == 0);
+
+		voxel = world_voxel(map);
+		if (voxel != 0u)
+		{
+			normal = ivec3(0);
+			normal[axis] = -stepAmount[axis];
+			return true;
+		}
+	}
+}
+
+// Coarsest level whose cells still cover at least lod_pixels on screen at distance t
+int lod_level(const float t, const float pixel_size)
+{
+	float cell = lod_pixels * t * pixel_size;
+	return cell < 1.0 ? 0 : min(int(log2(cell)) + 1, LOD_LEVELS - 1);
+}
+
+// Next boundary crossing along each axis for a ray in cell map of a grid with
+// the given cell size, in world distance along dir
+vec3 lod_boundaries(const vec3 origin, const vec3 dir, const ivec3 map, const ivec3 stepAmount, const float cell)
+{
+	vec3 tMax;
+	for (int i = 0; i < 3; i++)
+	{
+		if (stepAmount[i] == 0)
+			tMax[i] = FLT_MAX;
+		else
+			tMax[i] = ((map[i] + (stepAmount[i] > 0 ? 1 : 0)) * cell - origin[i]) / dir[i];
+	}
+	return tMax;
+}
+
+// Moves a ray that has just reached dist into the level of detail it wants there,
+// then reads the cell it is in. True if the cell counts as a hit.
+bool lod_visit(const vec3 origin, const vec3 dir, const float pixel_size, const ivec3 stepAmount, const float dist,
+	inout ivec3 map, inout int level, inout float cell, inout ivec3 dims, inout vec3 tMax, out uint voxel)
+{
+	// The cell just entered is found exactly by shifting the finer map down
+	int want = lod_level(dist, pixel_size);
+	if (want > level)
+	{
+		map >>= want - level;
+		level = want;
+		cell = float(1 << level);
+		dims = lod_dims[level];
+		tMax = lod_boundaries(origin, dir, map, stepAmount, cell);
+	}
+
+	if (level == 0)
+	{
+		voxel = world_voxel(map);
+		return voxel != 0;
+	}
+
+	uint lod_cell = lod_cells[lod_offsets[level] + (map.y * dims.z + map.z) * dims.x + map.x];
+	voxel = lod_cell & LOD_MATERIAL_MASK;
+	return (lod_cell >> LOD_OCCUPANCY_SHIFT) >= LOD_SOLID;
+}
+
+// Like trace(), but moves up the voxel pyramid as the ray gets further away so
+// that distant geometry is stepped through in coarse cells. A coarse cell counts
+// as a hit when at least half of it is solid, and reports its dominant material.
+// level is the pyramid level of the hit; map is in that level's cells. Rays from
+// outside the map start at the voxel where they enter it, as in trace().
+bool trace_lod(const vec3 origin, const vec3 dir, const float pixel_size, out ivec3 map, out ivec3 stepAmount, out int side, out uint voxel, out float dist, out vec3 normal, out int level)
+{
+	level = 0;
+	float cell = 1.0;
+	map = ivec3(floor(origin));
+	stepAmount = ivec3(sign(dir));
+	vec3 tDelta = abs(1.0 / dir);
+	vec3 tMax = lod_boundaries(origin, dir, map, stepAmount, cell);
+	ivec3 dims = lod_dims[0];
+
+	bool solid = false;
+	if (any(lessThan(map, ivec3(0))) || any(greaterThanEqual(map, dims)))
+	{
+		if (!enter_map(origin, dir, stepAmount, tDelta, map, tMax, side))
+			return false;
+
+		// The entry voxel's far boundary on the entry axis is one voxel past the entry point
+		int axis = side == 0 ? 0 : (side == 1 ? 2 : 1);
+		dist = tMax[axis] - tDelta[axis];
+		solid = lod_visit(origin, dir, pixel_size, stepAmount, dist, map, level, cell, dims, tMax, voxel);
+	}
+
+	while (!solid)
+	{
+		bvec3 axis = next_axis(tMax);
+		dist = min(tMax.x, min(tMax.y, tMax.z));
+		map += ivec3(axis) * stepAmount;
+		if (any(greaterThanEqual(uvec3(map), uvec3(dims))))
+			return false;
+		tMax = mix(tMax, tMax + tDelta * cell, axis);
+		side = axis.x ? 0 : (axis.y ? 2 : 1);
+		solid = lod_visit(origin, dir, pixel_size, stepAmount, dist, map, level, cell, dims, tMax, voxel);
+	}
+
+	normal = vec3(0);
+	normal[side == 0 ? 0 : (side == 1 ? 2 : 1)] = -stepAmount[side == 0 ? 0 : (side == 1 ? 2 : 1)];
+	return true;
+}
+
+Material material_of(const uint voxel)
+{
+	return materials[voxel < uint(materials.length()) ? voxel : 0u];
+}
+
+vec3 cast_ray(const vec3 origin, const vec3 dir)
+{
+	ivec3 map;
+	ivec3 stepAmount;
+	int side;
+	uint voxel;
+	float dist;
+	vec3 normal;
+
+	int level = 0;
+	if (fixed_dda)
+	{
+		ivec3 fixed_normal;
+		uint fixed_dist;
+		if (!trace_fixed(ivec3(floor(origin * FIXED_ONE)), ivec3(floor(dir * FIXED_ONE)), FIXED_INFINITY, map, fixed_normal, fixed_dist, voxel))
+			return vec3(0, 0, 0);
+		normal = vec3(fixed_normal);
+		stepAmount = ivec3(sign(dir));
+		side = fixed_normal.x != 0 ? 0 : (fixed_normal.z != 0 ? 1 : 2);
+		dist = float(fixed_dist) / FIXED_ONE;
+	}
+	else if (use_lod)
+	{
+		float pixel_size = 2.0 * tan(fov / 2.0) / float(w_size.y);
+		if (!trace_lod(origin, dir, pixel_size, map, stepAmount, side, voxel, dist, normal, level))
+			return vec3(0, 0, 0);
+	}
+	else if (!trace(origin, dir, map, stepAmount, side, voxel, dist, normal))
+		return vec3(0, 0, 0);
 
 //	// ========== TEXTURING ==========
 //
@@ -181,35 +624,21 @@ vec3 cast_ray(const vec3 origin, const vec3 dir)
 //				float((c & 0xFF0000) >> 16) / 255.f);
 
 
-	float dist;
-	vec3 dest;
-	if (side == 0)
-	{
-//		dest = origin + tMax.x * dir;
-		dist = (map.x - origin.x + (1 - stepAmount.x) / 2) / dir.x;
-	}
-	else if (side == 1)
-	{
-//		dest = origin + tMax.z * dir;
-		dist =(map.z - origin.z + (1 - stepAmount.z) / 2) / dir.z;
-	}
-	else
-	{
-//		dest = origin + tMax.y * dir;
-		dist = (map.y - origin.y + (1 - stepAmount.y) / 2) / dir.y;
-	}
-
-	dest = origin + dist * dir;
-
-
+	vec3 dest = origin + dist * dir;
 
-	vec3 col;
-
-	Light l1 = Light(vec3(8, 3, 8), 0.1);
+	// Baked irradiance is sampled half a voxel off the face, in the empty voxel it faces
+	vec3 diffuse;
+	if (use_light_volume)
+		diffuse = textureLod(light_volume, (dest + normal * 0.5) / light_volume_size, 0).rgb;
+	else
+		diffuse = direct_light(dest, normal);
 
-	vec3 light_dir = normalize(l1.position - dest);
-	float diffuse_intensity = l1.intensity * max(0.f, dot(light_dir,dest));
-	float ambient_intensity = 0.1f;
+	// Per-face AO only exists at full resolution
+	uint face = uint(side * 2 + (stepAmount[side == 0 ? 0 : (side == 1 ? 2 : 1)] < 0 ? 1 : 0));
+	uint ao = AO_MAX;
+	if (level == 0)
+		ao = (world_ao(map) >> (face * AO_BITS)) & AO_MAX;
+	float ambient_intensity = 0.2f * float(ao) / AO_MAX;
 
 
 //	float specular_intensity = 0.5f;
@@ -218,43 +647,9 @@ vec3 cast_ray(const vec3 origin, const vec3 dir)
 //	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
 //	float specular = specular_intensity * spec;
 
+	Material material = material_of(voxel);
 
-
-	switch(voxel)
-	{
-	case 1:
-		col = vec3(1, 0.5, 1);
-		break;
-	case 2:
-		col = vec3(1, 1, 1);
-		break;
-	case 3:
-		col = vec3(0.5, 1, 1);
-		break;
-	case 4:
-		col = vec3(0.25, 0.75, 0.5);
-		break;
-	case 5:
-		col = vec3(0.75, 0.25, 0.5);
-		break;
-	case 6:
-		col = vec3(0.5, 0.75, 0.25);
-		break;
-	case 7:
-		col = vec3(0.5, 0.25, 0.75);
-		break;
-	case 8:
-		col = vec3(0.8, 0.1, 0.6);
-		break;
-	case 9:
-		col = vec3(0.1, 0.8, 0.6);
-		break;
-	default:
-		col = vec3(1, 1, 0.5);
-		break;
-	}
-
-	return col * (diffuse_intensity + ambient_intensity);
+	return material.albedo * (diffuse + ambient_intensity) + material.emissive;
 	//return col * (1.0 / dist);
 
 //	while (true)
@@ -262,7 +657,7 @@ vec3 cast_ray(const vec3 origin, const vec3 dir)
 //		vec3 map = origin + t * dir;
 //		ivec3 result = ivec3(map);
 //
-//		uint tile = world_map[result.y * MAP_WIDTH * MAP_HEIGHT + result.z * MAP_WIDTH + result.x];
+//		uint tile = world_voxel(result);
 //		if (tile > 0)
 //		{
 //			Light l1 = Light(vec3(8, 3, 8), 0.1);
@@ -311,7 +706,7 @@ vec3 cast_ray(const vec3 origin, const vec3 dir)
 //			return col * (diffuse_intensity + ambient_intensity);
 //		}
 //
-//		if (result.y >= MAP_DEPTH || result.z >= MAP_WIDTH || result.x >= MAP_HEIGHT)
+//		if (result.y >= world_size.y || result.z >= world_size.x || result.x >= world_size.z)
 //		{
 //			return vec3(0, 0, 0);
 //		}
@@ -324,13 +719,117 @@ vec3 cast_ray(const vec3 origin, const vec3 dir)
 //	}
 }
 
-void main()
+// ========== PATH TRACING ==========
+// Mirrored in CpuRenderer.cpp so the headless renderer converges to the same image
+
+uint pcg_hash(const uint v)
+{
+	uint state = v * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+float random(inout uint seed)
+{
+	seed = pcg_hash(seed);
+	return float(seed >> 8) / 16777216.0;
+}
+
+// Cosine-weighted direction around an axis-aligned normal
+vec3 sample_cosine(const vec3 n, inout uint seed)
+{
+	float u = random(seed);
+	float v = random(seed);
+	float r = sqrt(u);
+	float phi = TWO_PI * v;
+
+	vec3 t = abs(n.x) > 0.5 ? vec3(0, 1, 0) : vec3(1, 0, 0);
+	t = normalize(cross(n, t));
+	vec3 b = cross(n, t);
+	return t * (r * cos(phi)) + b * (r * sin(phi)) + n * sqrt(1 - u);
+}
+
+// Direct light from one light picked at random from the hit point's culling
+// cell, scaled by the number of candidates so the estimate stays unbiased
+vec3 sample_light(const vec3 point, const vec3 normal, inout uint seed)
+{
+	vec3 shadow_origin = point + normal * SHADOW_BIAS;
+	uint cell_index = light_cell(shadow_origin);
+	uint offset = light_grid[cell_index * 2];
+	uint count = light_grid[cell_index * 2 + 1];
+	if (count == 0)
+		return vec3(0);
+
+	uint i = min(uint(random(seed) * count), count - 1);
+	return light_contribution(lights[light_grid[offset + i]], shadow_origin, normal) * float(count);
+}
+
+vec3 path_trace_ray(vec3 origin, vec3 dir, inout uint seed, out vec4 first_hit)
+{
+	first_hit = vec4(0);
+
+	vec3 radiance = vec3(0);
+	vec3 throughput = vec3(1);
+
+	for (int bounce = 0; bounce < PT_MAX_BOUNCES; bounce++)
+	{
+		ivec3 map;
+		ivec3 stepAmount;
+		int side;
+		uint voxel;
+		float dist;
+		vec3 normal;
+		if (!trace(origin, dir, map, stepAmount, side, voxel, dist, normal))
+			break;
+
+		if (bounce == 0)
+			first_hit = vec4(side * 2 + (dot(normal, vec3(1)) > 0 ? 1 : 0), dist, voxel, 1);
+
+		Material material = material_of(voxel);
+		vec3 albedo = material.albedo;
+		vec3 point = origin + dist * dir;
+
+		radiance += throughput * material.emissive + throughput * albedo * sample_light(point, normal, seed);
+
+		// Lambertian bounce: the cosine-weighted pdf cancels everything but albedo.
+		// Smoother materials pull the bounce towards the mirror direction.
+		throughput *= albedo;
+		origin = point + normal * SHADOW_BIAS;
+		vec3 diffuse_dir = sample_cosine(normal, seed);
+		dir = material.roughness < 1.0 ? normalize(mix(reflect(dir, normal), diffuse_dir, material.roughness)) : diffuse_dir;
+	}
+
+	return radiance;
+}
+
+vec3 camera_ray(const vec2 frag_coord)
 {
-    float x =  (2*(gl_FragCoord.x + 0.5)/float(w_size.x)  - 1)*tan(fov/2.)*w_size.x/float(w_size.y);
-    float y = (2*(gl_FragCoord.y + 0.5)/float(w_size.y) - 1)*tan(fov/2.);
+    float x =  (2*(frag_coord.x + 0.5)/float(w_size.x)  - 1)*tan(fov/2.)*w_size.x/float(w_size.y);
+    float y = (2*(frag_coord.y + 0.5)/float(w_size.y) - 1)*tan(fov/2.);
 
 	vec3 dir = rotationMatrix(vec3(0, 1, 0), theta.x) * normalize(vec3(x, y, -1));
 //	dir = rotationMatrix(cross(dir, vec3(0, 1, 0)), theta.y) * dir;
 
-	pxColour = vec4(cast_ray(pos, dir), 1.0);
+	return dir;
+}
+
+void main()
+{
+	if (path_trace)
+	{
+		// One jittered path per pixel per frame, averaged with the previous samples
+		uint pixel = uint(gl_FragCoord.y) * uint(w_size.x) + uint(gl_FragCoord.x);
+		uint seed = pcg_hash(pixel ^ pcg_hash(sample_index));
+		vec2 jitter = vec2(random(seed), random(seed)) - 0.5;
+		vec3 sum = path_trace_ray(pos, camera_ray(gl_FragCoord.xy + jitter), seed, guide);
+		if (sample_index > 0)
+			sum += accum[pixel].rgb;
+
+		accum[pixel] = vec4(sum, 1.0);
+		pxColour = vec4(sum / float(sample_index + 1), 1.0);
+		return;
+	}
+
+	pxColour = vec4(cast_ray(pos, camera_ray(gl_FragCoord.xy)), 1.0);
+	guide = vec4(0);
 }
\ No newline at end of file